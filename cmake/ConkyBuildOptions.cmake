@@ -167,6 +167,10 @@ option(BUILD_BUILTIN_CONFIG "Enable builtin default configuration" true)
 
 option(BUILD_IOSTATS "Enable disk I/O stats" true)
 
+option(BUILD_PROFILE_ALLOCATIONS
+  "Replace the global operator new so profile_objects can count allocations"
+  false)
+
 option(BUILD_OLD_CONFIG "Enable support for the old syntax of configurations"
   true)
 
@@ -222,10 +222,54 @@ int open_fifo(const char *file, int *reported) {
   return fd;
 }
 
+std::string system_root;
+
+const char *system_path(const char *path, std::string &buf) {
+  if (system_root.empty() ||
+      (strncmp(path, "/proc/", 6) != 0 && strcmp(path, "/proc") != 0 &&
+       strncmp(path, "/sys/", 5) != 0)) {
+    return path;
+  }
+  buf.assign(system_root).append(path);
+  return buf.c_str();
+}
+
+class system_root_setting : public conky::simple_config_setting<std::string> {
+  typedef conky::simple_config_setting<std::string> Base;
+
+ protected:
+  virtual void lua_setter(lua::state &l, bool init) {
+    lua::stack_sentry s(l, -2);
+
+    Base::lua_setter(l, init);
+
+    if (init) {
+      system_root = do_convert(l, -1).first;
+      while (!system_root.empty() && system_root.back() == '/') {
+        system_root.pop_back();
+      }
+    }
+
+    ++s;
+  }
+
+  virtual void cleanup(lua::state &l) {
+    lua::stack_sentry s(l, -1);
+
+    system_root.clear();
+    l.pop();
+  }
+
+ public:
+  system_root_setting() : Base("system_root", std::string(), false) {}
+};
+static system_root_setting system_root_config;
+
 FILE *open_file(const char *file, int *reported) {
   FILE *fp = nullptr;
+  std::string rooted;
 
-  fp = fopen(file, "re");
+  fp = fopen(system_path(file, rooted), "re");
 
   if (fp == nullptr) {
     if ((reported == nullptr) || *reported == 0) {
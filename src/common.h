@@ -72,6 +72,13 @@ std::filesystem::path to_real_path(const std::string &source);
 FILE *open_file(const char *file, int *reported);
 int open_fifo(const char *file, int *reported);
 
+/// Directory the /proc and /sys trees are read from, without a trailing
+/// slash; empty for the running system. Set by the `system_root` setting.
+extern std::string system_root;
+/// Returns `path` below `system_root` if it is a /proc or /sys path, using
+/// `buf` to hold the result; `path` itself otherwise.
+const char *system_path(const char *path, std::string &buf);
+
 /// Returns current working directory of conky.
 std::filesystem::path get_cwd();
 /// Returns the username of user/account that started conky.
@@ -119,6 +119,8 @@ void cimlib_cleanup() {
   image_list_start = image_list_end = nullptr;
 }
 
+bool cimlib_has_images() { return image_list_start != nullptr; }
+
 void cimlib_add_image(const char *args) {
   struct image_list_s *cur = nullptr;
   const char *tmp;
@@ -43,6 +43,8 @@ void cimlib_set_cache_flush_interval(long interval);
 void cimlib_render(int x, int y, int width, int height, uint32_t flush_interval,
                    bool draw_blended);
 void cimlib_cleanup(void);
+/* true if any $image was added since the last cimlib_cleanup() */
+bool cimlib_has_images(void);
 
 void print_image_callback(struct text_object *, char *, unsigned int);
 
@@ -115,6 +115,7 @@
 #ifdef BUILD_ICONV
 #include "data/iconv_tools.h"
 #endif /* BUILD_ICONV */
+#include "content/profile.h"
 #include "content/specials.h"
 #include "content/temphelper.h"
 #include "content/template.h"
@@ -124,6 +125,7 @@
 #include "data/top.h"
 #include "logging.h"
 #include "output/nc.h"
+#include "output/text-damage.h"
 
 #ifdef BUILD_MYSQL
 #include "data/mysql.h"
@@ -182,9 +184,6 @@ void clean_up(void);
 static conky::simple_config_setting<bool> disable_auto_reload(
     "disable_auto_reload", false, false);
 
-/* two strings for internal use */
-static char *tmpstring1, *tmpstring2;
-
 enum spacer_state { NO_SPACER = 0, LEFT_SPACER, RIGHT_SPACER };
 template <>
 conky::lua_traits<spacer_state>::Map conky::lua_traits<spacer_state>::map = {
@@ -209,6 +208,8 @@ conky::simple_config_setting<bool> out_to_stdout("out_to_console",
 #endif
                                                  false);
 conky::simple_config_setting<bool> out_to_stderr("out_to_stderr", false, false);
+conky::simple_config_setting<bool> skip_unchanged_output(
+    "skip_unchanged_output", false, false);
 
 int top_cpu, top_mem, top_time;
 #ifdef BUILD_IOSTATS
@@ -433,23 +434,92 @@ conky::gradient_factory *create_gradient_factory(int width, Colour first_colour,
 
 static char *text_buffer;
 
-/* quite boring functions */
+/* Line layout of text_buffer, rebuilt once per update by
+ * build_line_layout().  The size pass and every draw pass (shades, outline
+ * and foreground) replay these segments instead of rescanning text_buffer
+ * and copying each text run into scratch buffers. */
+struct layout_segment {
+  size_t offset;     /* start of the run in layout_text */
+  size_t length;     /* 0 for specials */
+  int special_index; /* index into specials, -1 for text runs */
+  bool has_tab;      /* text run needs tab expansion */
+};
+
+struct layout_line {
+  size_t offset; /* start of the whole line in text_buffer */
+  size_t length;
+  size_t first_segment;
+  size_t segment_count;
+  int first_special;
+  bool has_tab;
+};
+
+/* text_buffer with every newline and SPECIAL_CHAR replaced by '\0', so that
+ * each text run can be handed to the outputs in place */
+static std::vector<char> layout_text;
+static std::vector<layout_segment> layout_segments;
+static std::vector<layout_line> layout_lines;
+/* bumped whenever the layout is rebuilt */
+static unsigned int layout_serial = 0;
+
+static inline const char *layout_run(const layout_segment &seg) {
+  return layout_text.data() + seg.offset;
+}
 
-static inline void for_each_line(char *b, int f(char *, int)) {
-  char *ps, *pe;
-  int special_index = 0; /* specials index */
+static void clear_line_layout() {
+  ++layout_serial;
+  layout_text.clear();
+  layout_segments.clear();
+  layout_lines.clear();
+}
 
-  if (b == nullptr) { return; }
-  for (ps = b, pe = b; *pe != 0; pe++) {
-    if (*pe == '\n') {
-      *pe = '\0';
-      special_index = f(ps, special_index);
-      *pe = '\n';
-      ps = pe + 1;
+/* Splits text_buffer into lines and each line into text runs and specials.
+ * Newlines in text_buffer are replaced by '\0' so whole lines can be drawn
+ * as-is by outputs that don't need per-special handling. */
+static void build_line_layout() {
+  clear_line_layout();
+  if (text_buffer == nullptr) { return; }
+
+  size_t len = strlen(text_buffer);
+  layout_text.assign(text_buffer, text_buffer + len + 1);
+
+  int special_index = 0;
+  size_t run_start = 0;
+  bool run_has_tab = false;
+  layout_line line{0, 0, 0, 0, 0, false};
+
+  auto end_run = [&](size_t end) {
+    if (end > run_start) {
+      layout_segments.push_back(
+          layout_segment{run_start, end - run_start, -1, run_has_tab});
     }
-  }
+    layout_text[end] = '\0';
+    run_has_tab = false;
+  };
 
-  if (ps < pe) { f(ps, special_index); }
+  for (size_t i = 0; i <= len; i++) {
+    char c = text_buffer[i];
+    if (c == '\t') {
+      run_has_tab = true;
+      line.has_tab = true;
+    } else if (c == SPECIAL_CHAR && special_index < special_count) {
+      end_run(i);
+      layout_segments.push_back(layout_segment{i, 0, special_index++, false});
+      run_start = i + 1;
+    } else if (c == '\n' || c == '\0') {
+      end_run(i);
+      /* a trailing newline doesn't start another (empty) line */
+      if (c == '\n' || i > line.offset) {
+        line.length = i - line.offset;
+        line.segment_count = layout_segments.size() - line.first_segment;
+        layout_lines.push_back(line);
+      }
+      text_buffer[i] = '\0';
+      line = layout_line{i + 1, 0, layout_segments.size(), 0, special_index,
+                         false};
+      run_start = i + 1;
+    }
+  }
 }
 
 static void convert_escapes(char *buf) {
@@ -586,8 +656,7 @@ Colour get_current_text_color() { return current_text_color; }
 
 static void extract_variable_text(const char *p) {
   free_text_objects(&global_root_object);
-  delete_block_and_zero(tmpstring1);
-  delete_block_and_zero(tmpstring2);
+  clear_line_layout();
   delete_block_and_zero(text_buffer);
 
   extract_variable_text_internal(&global_root_object, p);
@@ -599,6 +668,72 @@ void parse_conky_vars(struct text_object *root, const char *txt, char *p,
   generate_text_internal(p, p_max_size, *root);
 }
 
+/* Runs a list compiled by compile_text_program(), which must produce the
+ * same output as the walk in generate_text_internal(). */
+static void run_text_program(const text_program &program, char *p,
+                             int p_max_size, char *buff_in) {
+  using op = text_instruction::op;
+  const text_instruction *code = program.code.data();
+  const size_t size = program.code.size();
+  size_t pc = 0;
+  size_t a;
+
+  (void)buff_in;
+  while (pc < size && p_max_size > 0) {
+    const text_instruction &ins = code[pc++];
+    object_profile_scope _profile(ins.obj);
+    switch (ins.code) {
+      case op::LITERAL:
+        a = std::min(ins.len, static_cast<size_t>(p_max_size - 1));
+        memcpy(p, program.literals.data() + ins.offset, a);
+        p[a] = 0;
+        break;
+      case op::PRINT:
+        (*ins.fn.print)(ins.obj, p, p_max_size);
+        a = strlen(p);
+        break;
+      case op::IFTEST:
+        if ((*ins.fn.iftest)(ins.obj) == 0) {
+          LOG_TRACE("ifblock condition false, skipping to else/endif");
+          pc += ins.jump;
+        }
+        continue;
+      case op::JUMP:
+        pc += ins.jump;
+        continue;
+      case op::BAR:
+        new_bar(ins.obj, p, p_max_size, (*ins.fn.value)(ins.obj));
+        a = strlen(p);
+        break;
+      case op::GAUGE:
+        new_gauge(ins.obj, p, p_max_size, (*ins.fn.value)(ins.obj));
+        a = strlen(p);
+        break;
+      case op::GRAPH:
+#ifdef BUILD_GUI
+        new_graph(ins.obj, p, p_max_size, (*ins.fn.value)(ins.obj));
+        a = strlen(p);
+        break;
+#else
+        continue;
+#endif /* BUILD_GUI */
+      case op::PERCENTAGE:
+        percent_print(p, p_max_size, (*ins.fn.percentage)(ins.obj));
+        a = strlen(p);
+        break;
+      default:
+        continue;
+    }
+
+#ifdef BUILD_ICONV
+    iconv_convert(&a, buff_in, p, p_max_size);
+#endif /* BUILD_ICONV */
+    p += a;
+    p_max_size -= a;
+    (*p) = 0;
+  }
+}
+
 /* IFBLOCK jumping algorithm
  *
  * This is easier as it looks like:
@@ -631,8 +766,18 @@ void generate_text_internal(char *p, int p_max_size, struct text_object root) {
 #endif /* BUILD_ICONV */
 
   p[0] = 0;
-  obj = root.next;
+  if (root.program != nullptr) {
+#ifdef BUILD_ICONV
+    run_text_program(*root.program, p, p_max_size, buff_in);
+#else
+    run_text_program(*root.program, p, p_max_size, nullptr);
+#endif /* BUILD_ICONV */
+    obj = nullptr;
+  } else {
+    obj = root.next;
+  }
   while ((obj != nullptr) && p_max_size > 0) {
+    object_profile_scope _profile(obj);
     /* check callbacks for existence and act accordingly */
     if (obj->callbacks.print != nullptr) {
       (*obj->callbacks.print)(obj, p, p_max_size);
@@ -705,7 +850,10 @@ static void generate_text() {
    * any callbacks that were set on startup by construct_text_object(). */
   p = text_buffer;
 
-  generate_text_internal(p, max_user_text.get(*state), global_root_object);
+  {
+    auto _scope = LOG_SCOPE("generate_text_internal");
+    generate_text_internal(p, max_user_text.get(*state), global_root_object);
+  }
   unsigned int mw = max_text_width.get(*state);
   unsigned int tbs = text_buffer_size.get(*state);
   if (mw > 0) {
@@ -751,6 +899,8 @@ static void generate_text() {
     }
   }
 
+  build_line_layout();
+
   double ui = active_update_interval();
   double time = get_time();
   next_update_time += ui;
@@ -774,86 +924,40 @@ int get_border_total() {
          dpi_scale(border_width.get(*state));
 }
 
-void remove_first_char(char *s) { memmove(s, s + 1, strlen(s)); }
+/* width of the rest of \a line, starting at its segment \a from */
+static int get_string_width_special(const layout_line &line, size_t from) {
+  if (display_output() == nullptr || !display_output()->graphical()) {
+    int len = 0;
+    for (size_t i = from; i < line.segment_count; i++) {
+      const layout_segment &seg = layout_segments[line.first_segment + i];
+      len += seg.special_index < 0 ? seg.length : 1;
+    }
+    return len;
+  }
 
-static int get_string_width_special(char *s, int special_index) {
-  char *p, *final;
-  special_node *current = specials;
   int width = 0;
-  long i;
-
-  if (s == nullptr) { return 0; }
-
-  if (display_output() == nullptr || !display_output()->graphical()) {
-    return strlen(s);
-  }
-
-  p = strndup(s, text_buffer_size.get(*state));
-  final = p;
-
-  for (i = 0; i <= special_index; i++) { current = current->next; }
-
-  while (*p != 0) {
-    if (*p == SPECIAL_CHAR) {
-      /* shift everything over by 1 so that the special char
-       * doesn't mess up the size calculation */
-      remove_first_char(p);
-      /*for (i = 0; i < static_cast<long>(strlen(p)); i++) {
-        *(p + i) = *(p + i + 1);
-      }*/
-      if (current->type == text_node_t::GRAPH ||
-          current->type == text_node_t::GAUGE ||
-          current->type == text_node_t::BAR) {
-        width += current->width;
-      }
-      if (current->type == text_node_t::FONT) {
-        // put all following text until the next fontchange/stringend in
-        // influenced_by_font but do not include specials
-        char *influenced_by_font = strdup(p);
-        special_node *current_after_font = current;
-        // influenced_by_font gets special chars removed, so after this loop i
-        // counts the number of letters (not special chars) influenced by font
-        for (i = 0; influenced_by_font[i] != 0; i++) {
-          if (influenced_by_font[i] == SPECIAL_CHAR) {
-            // remove specials and stop at fontchange
-            current_after_font = current_after_font->next;
-            if (current_after_font->type == text_node_t::FONT) {
-              influenced_by_font[i] = 0;
-              break;
-            }
-            remove_first_char(&influenced_by_font[i]);
-          }
-        }
-        // add the length of influenced_by_font in the new font to width
-        int orig_font = selected_font;
-        selected_font = current->font_added;
-        width += calc_text_width(influenced_by_font);
-        selected_font = orig_font;
-        free(influenced_by_font);
-        // make sure the chars counted in the new font are not again counted
-        // in the old font
-        int specials_skipped = 0;
-        while (i > 0) {
-          if (p[specials_skipped] != SPECIAL_CHAR) {
-            remove_first_char(&p[specials_skipped]);
-            // i only counts non-special chars, so only decrement it for those
-            i--;
-          } else {
-            specials_skipped++;
-          }
-        }
-      }
-      current = current->next;
-    } else {
-      p++;
+  int orig_font = selected_font;
+  for (size_t i = from; i < line.segment_count; i++) {
+    const layout_segment &seg = layout_segments[line.first_segment + i];
+    if (seg.special_index < 0) {
+      width += calc_text_width(layout_run(seg));
+      continue;
+    }
+    special_node *current = special_at(seg.special_index);
+    if (current->type == text_node_t::GRAPH ||
+        current->type == text_node_t::GAUGE ||
+        current->type == text_node_t::BAR) {
+      width += current->width;
+    } else if (current->type == text_node_t::FONT) {
+      // text up to the next font change is measured in the new font
+      selected_font = current->font_added;
     }
   }
-  if (strlen(final) > 1) { width += calc_text_width(final); }
-  free(final);
+  selected_font = orig_font;
   return width;
 }
 
-static int text_size_updater(char *s, int special_index);
+static void text_size_updater(const layout_line &line);
 
 int last_font_height;
 void update_text_area() {
@@ -868,7 +972,7 @@ void update_text_area() {
   {
     text_size = conky::vec2i(dpi_scale(minimum_width.get(*state)), 0);
     last_font_height = font_height();
-    for_each_line(text_buffer, text_size_updater);
+    for (const auto &line : layout_lines) { text_size_updater(line); }
 
     text_size = text_size.max(
         conky::vec2i(text_size.x() + 1, dpi_scale(minimum_height.get(*state))));
@@ -934,67 +1038,55 @@ static draw_mode_t draw_mode; /* FG, BG or OUTLINE */
 #ifdef BUILD_GUI
 /*static*/ Colour current_color;
 
-static int text_size_updater(char *s, int special_index) {
+static void text_size_updater(const layout_line &line) {
   int w = 0;
-  char *p;
-  special_node *current = specials;
-
-  for (int i = 0; i < special_index; i++) { current = current->next; }
 
   if (display_output() == nullptr || !display_output()->graphical()) {
-    return 0;
-  }
-  /* get string widths and skip specials */
-  p = s;
-  while (*p != 0) {
-    if (*p == SPECIAL_CHAR) {
-      *p = '\0';
-      w += get_string_width(s);
-      *p = SPECIAL_CHAR;
-
-      if (current->type == text_node_t::BAR ||
-          current->type == text_node_t::GAUGE ||
-          current->type == text_node_t::GRAPH) {
-        w += current->width;
-        if (current->height > last_font_height) {
-          last_font_height = current->height;
-          last_font_height += font_height();
-        }
-      } else if (current->type == text_node_t::OFFSET) {
-        if (current->arg > 0) { w += current->arg; }
-      } else if (current->type == text_node_t::VOFFSET) {
-        last_font_height += current->arg;
-      } else if (current->type == text_node_t::GOTO) {
-        if (current->arg > cur_x) { w = static_cast<int>(current->arg); }
-      } else if (current->type == text_node_t::TAB) {
-        int start = current->arg;
-        int step = current->width;
-
-        if ((step == 0) || step < 0) { step = 10; }
-        w += step - (cur_x - text_start.x() - start) % step;
-      } else if (current->type == text_node_t::FONT) {
-        selected_font = current->font_added;
-        if (font_height() > last_font_height) {
-          last_font_height = font_height();
-        }
+    return;
+  }
+  /* sum up string widths and specials */
+  for (size_t i = 0; i < line.segment_count; i++) {
+    const layout_segment &seg = layout_segments[line.first_segment + i];
+    if (seg.special_index < 0) {
+      w += get_string_width(layout_run(seg));
+      continue;
+    }
+    special_node *current = special_at(seg.special_index);
+
+    if (current->type == text_node_t::BAR ||
+        current->type == text_node_t::GAUGE ||
+        current->type == text_node_t::GRAPH) {
+      w += current->width;
+      if (current->height > last_font_height) {
+        last_font_height = current->height;
+        last_font_height += font_height();
+      }
+    } else if (current->type == text_node_t::OFFSET) {
+      if (current->arg > 0) { w += current->arg; }
+    } else if (current->type == text_node_t::VOFFSET) {
+      last_font_height += current->arg;
+    } else if (current->type == text_node_t::GOTO) {
+      if (current->arg > cur_x) { w = static_cast<int>(current->arg); }
+    } else if (current->type == text_node_t::TAB) {
+      int start = current->arg;
+      int step = current->width;
+
+      if ((step == 0) || step < 0) { step = 10; }
+      w += step - (cur_x - text_start.x() - start) % step;
+    } else if (current->type == text_node_t::FONT) {
+      selected_font = current->font_added;
+      if (font_height() > last_font_height) {
+        last_font_height = font_height();
       }
-
-      special_index++;
-      current = current->next;
-      s = p + 1;
     }
-    p++;
   }
 
-  w += get_string_width(s);
-
   if (w > text_size.x()) { text_size.set_x(w); }
   int mw = dpi_scale(maximum_width.get(*state));
   if (mw > 0) { text_size.set_x(std::min(mw, text_size.x())); }
 
   text_size += conky::vec2i(0, last_font_height);
   last_font_height = font_height();
-  return special_index;
 }
 #endif /* BUILD_GUI */
 
@@ -1039,74 +1131,62 @@ static inline void draw_graph_bars(special_node *current,
   ++j;
 }
 
-static void draw_string(const char *s) {
-  int i;
-  int i2;
-  int pos;
 #ifdef BUILD_GUI
-  int width_of_s;
-#endif /* BUILD_GUI */
-  int max = 0;
-  int added;
-
-  if (s[0] == '\0') { return; }
-
-#ifdef BUILD_GUI
-  width_of_s = get_string_width(s);
-#endif /* BUILD_GUI */
-  if (draw_mode == draw_mode_t::FG) {
-    for (auto output : display_outputs())
-      if (!output->graphical()) output->draw_string(s, 0);
-  }
-  int tbs = text_buffer_size.get(*state);
-  memset(tmpstring1, 0, tbs);
-  memset(tmpstring2, 0, tbs);
-  strncpy(tmpstring1, s, tbs - 1);
-  pos = 0;
-  added = 0;
-
-#ifdef BUILD_GUI
-  if (display_output() && display_output()->graphical()) {
-    max = ((text_size.x() - width_of_s) / std::max(1, get_string_width(" ")));
-  }
-#endif /* BUILD_GUI */
-  /* This code looks for tabs in the text and coverts them to spaces.
-   * The trick is getting the correct number of spaces, and not going
-   * over the window's size without forcing the window larger. */
-  for (i = 0; i < tbs; i++) {
-    if (tmpstring1[i] == '\t') {
-      i2 = 0;
+/* tab-expanded copy of the text run being drawn, reused between calls */
+static std::string expanded_string;
+
+/* This looks for tabs in the text and converts them to spaces.  The trick is
+ * getting the correct number of spaces, and not going over the window's size
+ * without forcing the window larger. */
+static void expand_tabs(const char *s, size_t len, int max) {
+  int pos = 0;
+  int added = 0;
+
+  expanded_string.clear();
+  for (size_t i = 0; i < len; i++) {
+    if (s[i] == '\t') {
+      int i2;
       for (i2 = 0; i2 < (8 - (1 + pos) % 8) && added <= max; i2++) {
-        /* guard against overrun */
-        tmpstring2[std::min(pos + i2, tbs - 1)] = ' ';
+        expanded_string.push_back(' ');
         added++;
       }
       pos += i2;
     } else {
-      /* guard against overrun */
-      tmpstring2[std::min(pos, tbs - 1)] = tmpstring1[i];
+      expanded_string.push_back(s[i]);
       pos++;
     }
   }
+}
+#endif /* BUILD_GUI */
+
+static void draw_string(const char *s, size_t len, bool has_tab) {
+  if (len == 0 || s[0] == '\0') { return; }
+
 #ifdef BUILD_GUI
-  if (display_output() && display_output()->graphical()) {
-    int mw = dpi_scale(maximum_width.get(*state));
-    if (text_size.x() == mw) {
-      /* this means the text is probably pushing the limit,
-       * so we'll chop it */
-    }
-  }
+  int width_of_s = get_string_width(s);
 #endif /* BUILD_GUI */
-  s = tmpstring2;
+  if (draw_mode == draw_mode_t::FG) {
+    for (auto output : display_outputs())
+      if (!output->graphical()) output->draw_string(s, 0);
+  }
 #ifdef BUILD_GUI
   if (display_output() && display_output()->graphical()) {
+    if (has_tab) {
+      int max =
+          (text_size.x() - width_of_s) / std::max(1, get_string_width(" "));
+      expand_tabs(s, len, max);
+      s = expanded_string.c_str();
+      len = expanded_string.size();
+    }
     display_output()->draw_string_at(text_offset.x() + cur_x,
-                                     text_offset.y() + cur_y, s, strlen(s));
+                                     text_offset.y() + cur_y, s,
+                                     static_cast<int>(len));
 
     cur_x += width_of_s;
   }
+#else
+  UNUSED(has_tab);
 #endif /* BUILD_GUI */
-  memcpy(tmpstring1, s, tbs);
 }
 
 #if defined(BUILD_MATH) && defined(BUILD_GUI)
@@ -1141,7 +1221,7 @@ static std::string formatSizeWithUnits(double size, int prec = 1) {
 }
 #endif /* BUILD_MATH && BUILD_GUI */
 
-int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
+static void draw_each_line_inner(const layout_line &line) {
 #ifndef BUILD_GUI
   static int cur_x, cur_y; /* current x and y for drawing */
   (void)cur_y;
@@ -1151,8 +1231,15 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
   int cur_y_add = 0;
   int mw = dpi_scale(maximum_width.get(*state));
 #endif /* BUILD_GUI */
-  char *p = s;
-  int orig_special_index = special_index;
+  const layout_segment *segments =
+      layout_segments.data() + line.first_segment;
+  size_t count = line.segment_count;
+  /* text after the last special is drawn once the line height is known */
+  const layout_segment *tail = nullptr;
+
+  if (count > 0 && segments[count - 1].special_index < 0) {
+    tail = &segments[--count];
+  }
 
 #ifdef BUILD_GUI
   if (display_output() && display_output()->graphical()) {
@@ -1162,25 +1249,17 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
   cur_x = text_start.x();
 #endif /* BUILD_GUI */
 
-  while (*p != 0) {
-    if (*p == SPECIAL_CHAR || last_special_applied > -1) {
+  for (size_t k = 0; k < count; k++) {
+    const layout_segment &seg = segments[k];
+    if (seg.special_index < 0) {
+      draw_string(layout_run(seg), seg.length, seg.has_tab);
+    } else {
 #ifdef BUILD_GUI
       int w = 0;
 #endif /* BUILD_GUI */
 
-      /* draw string before special, unless we're dealing multiline
-       * specials */
-      if (last_special_applied > -1) {
-        special_index = last_special_applied;
-      } else {
-        *p = '\0';
-        draw_string(s);
-        *p = SPECIAL_CHAR;
-        s = p + 1;
-      }
       /* draw special */
-      special_node *current = specials;
-      for (int i = 0; i < special_index; i++) { current = current->next; }
+      special_node *current = special_at(seg.special_index);
       switch (current->type) {
 #ifdef BUILD_GUI
         case text_node_t::HORIZONTAL_LINE:
@@ -1410,7 +1489,7 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
               }
               cur_x += (w / 2) - (font_ascent() * (strlen(tmp_str) / 2));
               cur_y += font_h / 2;
-              draw_string(tmp_str);
+              draw_string(tmp_str, strlen(tmp_str), false);
               free(tmp_str);
               cur_x = tmp_x;
               cur_y = tmp_y;
@@ -1429,7 +1508,7 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
               std::string tmp_str = formatSizeWithUnits(
                   current->scale_log != 0 ? std::pow(10.0, current->scale)
                                           : current->scale);
-              draw_string(tmp_str.c_str());
+              draw_string(tmp_str.c_str(), tmp_str.size(), false);
               cur_x = tmp_x;
               cur_y = tmp_y;
             }
@@ -1502,7 +1581,7 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
           /* TODO: add back in "+ window.border_inner_margin" to the end of
            * this line? */
           int pos_x = text_start.x() + text_size.x() -
-                      get_string_width_special(s, special_index);
+                      get_string_width_special(line, k + 1);
 
           /* printf("pos_x %i text_start.x %i text_size.x %i cur_x %i "
             "get_string_width(p) %i gap_x %i "
@@ -1517,7 +1596,7 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
 
         case text_node_t::ALIGNC: {
           int pos_x = text_size.x() / 2 -
-                      get_string_width_special(s, special_index) / 2 -
+                      get_string_width_special(line, k + 1) / 2 -
                       (cur_x - text_start.x());
           /* int pos_x = text_start_x + text_size.x / 2 -
             get_string_width_special(s) / 2; */
@@ -1550,39 +1629,77 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
 #ifdef BUILD_GUI
       cur_x += w;
 #endif /* BUILD_GUI */
-
-      if (special_index != last_special_applied) {
-        special_index++;
-      } else {
-        special_index = orig_special_index;
-        last_special_applied = -1;
-      }
     }
-    p++;
   }
 
 #ifdef BUILD_GUI
   cur_y += cur_y_add;
 #endif /* BUILD_GUI */
-  draw_string(s);
+  if (tail != nullptr) {
+    draw_string(layout_run(*tail), tail->length, tail->has_tab);
+  }
   for (auto output : display_outputs()) output->line_inner_done();
 #ifdef BUILD_GUI
   if (display_output() && display_output()->graphical()) {
     cur_y += font_descent();
   }
 #endif /* BUILD_GUI */
-  return special_index;
 }
 
-static int draw_line(char *s, int special_index) {
+static void draw_line(const layout_line &line) {
   if (display_output() && display_output()->draw_line_inner_required()) {
-    return draw_each_line_inner(s, special_index, -1);
+    draw_each_line_inner(line);
+    return;
   }
-  draw_string(s);
-  UNUSED(special_index);
-  return 0;
+  draw_string(text_buffer + line.offset, line.length, line.has_tab);
 }
 
+#ifdef BUILD_GUI
+/* signatures of layout_lines, valid while signatures_serial == layout_serial
+ */
+static std::vector<line_signature> layout_signatures;
+static unsigned int signatures_serial = 0;
+/* signatures and bands of the last frame drawn */
+static std::vector<line_signature> drawn_signatures;
+static conky::vec2i drawn_text_start, drawn_text_size;
+
+static const std::vector<line_signature> &line_signatures() {
+  if (signatures_serial == layout_serial) { return layout_signatures; }
+
+  layout_signatures.clear();
+  line_signer signer;
+  for (const auto &line : layout_lines) {
+    signer.add_text(text_buffer + line.offset, line.length);
+    for (size_t i = 0; i < line.segment_count; i++) {
+      const layout_segment &seg = layout_segments[line.first_segment + i];
+      if (seg.special_index >= 0) {
+        signer.add_special(*special_at(seg.special_index));
+      }
+    }
+    layout_signatures.push_back(signer.end_line(line.segment_count));
+  }
+  signatures_serial = layout_serial;
+  return layout_signatures;
+}
+
+bool get_text_damage(std::vector<conky::rect<int>> &bands) {
+  bands.clear();
+  if (text_start != drawn_text_start || text_size != drawn_text_size ||
+      llua_has_draw_hooks()) {
+    return false;
+  }
+#ifdef BUILD_IMLIB2
+  /* images are painted wherever they were asked to go */
+  if (cimlib_has_images()) { return false; }
+#endif /* BUILD_IMLIB2 */
+
+  return diff_text_lines(drawn_signatures, line_signatures(),
+                         conky::rect<int>(text_start, text_size), bands);
+}
+
+void reset_text_damage() { drawn_signatures.clear(); }
+#endif /* BUILD_GUI */
+
 static void draw_text() {
   for (auto output : display_outputs()) output->begin_draw_text();
 #ifdef BUILD_GUI
@@ -1614,8 +1731,28 @@ static void draw_text() {
     }
   }
   setup_fonts();
+
+  /* remember where each line went, for get_text_damage() */
+  auto graphical = [](conky::display_output_base *output) {
+    return output->graphical();
+  };
+  if (draw_mode == draw_mode_t::FG &&
+      std::any_of(display_outputs().begin(), display_outputs().end(),
+                  graphical)) {
+    drawn_signatures = line_signatures();
+    drawn_text_start = text_start;
+    drawn_text_size = text_size;
+    for (size_t i = 0; i < layout_lines.size(); i++) {
+      int top = cur_y;
+      draw_line(layout_lines[i]);
+      drawn_signatures[i].top = std::min(top, cur_y);
+      drawn_signatures[i].bottom = std::max(top, cur_y);
+    }
+    for (auto output : display_outputs()) output->end_draw_text();
+    return;
+  }
 #endif /* BUILD_GUI */
-  for_each_line(text_buffer, draw_line);
+  for (const auto &line : layout_lines) { draw_line(line); }
   for (auto output : display_outputs()) output->end_draw_text();
 }
 
@@ -1671,13 +1808,26 @@ void draw_stuff() {
 #endif /* BUILD_GUI */
   // always draw text
   draw_mode = draw_mode_t::FG;
-  draw_text();
+  {
+    auto _text_scope = LOG_SCOPE("draw_text");
+    draw_text();
+  }
 #ifdef BUILD_GUI
 
   llua_draw_post_hook();
 #endif /* BUILD_GUI */
 
-  for (auto output : display_outputs()) output->end_draw_stuff();
+  for (auto output : display_outputs()) {
+    auto _output_scope = LOG_SCOPE(output->name + ":end_draw_stuff");
+    output->end_draw_stuff();
+  }
+}
+
+static void flush_outputs() {
+  for (auto output : display_outputs()) {
+    auto _scope = LOG_SCOPE(output->name + ":flush");
+    output->flush();
+  }
 }
 
 int need_to_update;
@@ -1942,7 +2092,7 @@ void main_loop() {
       nanosleep(&req, &rem);
       update_text();
       draw_stuff();
-      for (auto output : display_outputs()) output->flush();
+      flush_outputs();
 #ifdef BUILD_GUI
     }
 #endif /* BUILD_GUI */
@@ -1967,7 +2117,10 @@ void main_loop() {
       LOG_INFO("received SIGUSR2, refreshing");
       update_text();
       draw_stuff();
-      for (auto output : display_outputs()) output->flush();
+      flush_outputs();
+      if (profile_objects.get(*state)) {
+        LOG_INFO("object profile: {}", profile_json());
+      }
     }
 
     if (g_sigterm_pending != 0) {
@@ -2057,14 +2210,6 @@ static void reload_config() {
   initialisation(argc_copy, argv_copy);
 }
 
-void free_specials(special_node *&current) {
-  if (current != nullptr) {
-    free_specials(current->next);
-    delete current;
-    current = nullptr;
-  }
-}
-
 void clean_up(void) {
   /* free_update_callbacks(); XXX: some new equivalent of this? */
   free_and_zero(info.cpu_usage);
@@ -2084,8 +2229,7 @@ void clean_up(void) {
   }
 
   free_text_objects(&global_root_object);
-  delete_block_and_zero(tmpstring1);
-  delete_block_and_zero(tmpstring2);
+  clear_line_layout();
   delete_block_and_zero(text_buffer);
   free_and_zero(global_text);
 
@@ -2097,7 +2241,7 @@ void clean_up(void) {
   xmlCleanupParser();
 #endif
 
-  free_specials(specials);
+  free_specials();
 
   clear_net_stats();
   clear_fs_stats();
@@ -2289,6 +2433,7 @@ const struct option longopts[] = {{"help", 0, nullptr, 'h'},
                                   {"text", 1, nullptr, 't'},
                                   {"interval", 1, nullptr, 'u'},
                                   {"pause", 1, nullptr, 'p'},
+                                  {"trace-file", 1, nullptr, 'T'},
 #if defined(__linux__) || defined(__FreeBSD__) ||        \
     defined(__FreeBSD_kernel__) || defined(__HAIKU__) || \
     defined(__NetBSD__) || defined(__OpenBSD__)
@@ -2464,10 +2609,6 @@ void initialisation(int argc, char **argv) {
 
   text_buffer = new char[max_user_text.get(*state)];
   memset(text_buffer, 0, max_user_text.get(*state));
-  tmpstring1 = new char[text_buffer_size.get(*state)];
-  memset(tmpstring1, 0, text_buffer_size.get(*state));
-  tmpstring2 = new char[text_buffer_size.get(*state)];
-  memset(tmpstring2, 0, text_buffer_size.get(*state));
 
   if (!conky::initialize_display_outputs()) {
     SYSTEM_ERR("no usable display output found");
@@ -460,5 +460,6 @@ extern const struct option longopts[];
 
 extern conky::simple_config_setting<bool> out_to_stdout;
 extern conky::simple_config_setting<bool> out_to_stderr;
+extern conky::simple_config_setting<bool> skip_unchanged_output;
 
 #endif /* _conky_h_ */
@@ -31,10 +31,15 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <memory>
+#include <string>
+#include <vector>
 #include "../conky.h"
+#include "../core.h"
 #include "../logging.h"
 #include "config.h"
+#include "text_object.h"
 
 /* find the operand in the given expression
  * returns the index of the first op character or -1 on error
@@ -157,7 +162,7 @@ char *arg_to_string(const char *arg) {
   len = 0;
   while ((*start != 0) && *start == ' ') { start++; }
   if (!(*(start++) == '"')) { return nullptr; }
-  while (start[len] != '"') { len++; }
+  while (start[len] != '"' && start[len] != '\0') { len++; }
   return strndup(start, len);
 }
 double arg_to_double(const char *arg) {
@@ -240,20 +245,265 @@ int compare(const char *expr) {
   return -2;
 }
 
+/*
+ * if_match expressions are split at their operator when the object is
+ * created. Sides without variables are converted once; for the others only
+ * that side is rendered on each evaluation. Expressions whose operator isn't
+ * visible in the config text (e.g. it's produced by a variable) are rendered
+ * whole and parsed with compare() on each evaluation, as before.
+ */
+namespace {
+struct match_value {
+  enum arg_type type = ARG_BAD;
+  long l = 0;
+  double d = 0;
+  const char *s = nullptr;
+  char *cut = nullptr; /* closing quote of a string, replaced by '\0' */
+};
+
+struct match_operand {
+  struct text_object *sub = nullptr; /* nullptr when the side is constant */
+  std::vector<char> text; /* rendered (or constant) text, sized to fit */
+  match_value value;
+};
+
+struct compiled_match {
+  enum match_type mtype = OP_EQ;
+  std::string op;
+  match_operand lhs, rhs;
+  int constant_result = -1; /* >= 0 if both sides are constant */
+};
+
+/* parses an operand in place (the closing quote of a string is cut off) */
+void parse_operand(char *text, match_value &v) {
+  v = match_value();
+  if (*text == '\0') { return; }
+
+  v.type = get_arg_type(text);
+  switch (v.type) {
+    case ARG_STRING: {
+      char *start = strchr(text, '"') + 1;
+      char *end = strchr(start, '"');
+      if (end == nullptr) { /* a lone '"' */
+        v.type = ARG_BAD;
+        break;
+      }
+      *end = '\0';
+      v.cut = end;
+      v.s = start;
+      break;
+    }
+    case ARG_LONG:
+      v.l = strtol(text, nullptr, 10);
+      v.d = static_cast<double>(v.l);
+      break;
+    case ARG_DOUBLE:
+      v.d = strtod(text, nullptr);
+      break;
+    case ARG_BAD:
+      break;
+  }
+}
+
+/* same rules as compare(), returns -2 if the values can't be compared */
+int compare_values(const match_value &a, enum match_type mtype,
+                   const match_value &b) {
+  enum arg_type type1 = a.type, type2 = b.type;
+
+  if (type1 == ARG_BAD || type2 == ARG_BAD) { return -2; }
+  if (type1 == ARG_LONG && type2 == ARG_DOUBLE) { type1 = ARG_DOUBLE; }
+  if (type1 == ARG_DOUBLE && type2 == ARG_LONG) { type2 = ARG_DOUBLE; }
+  if (type1 != type2) { return -2; }
+
+  switch (type1) {
+    case ARG_STRING:
+      return scompare(a.s, mtype, b.s);
+    case ARG_LONG:
+      return lcompare(a.l, mtype, b.l);
+    case ARG_DOUBLE:
+      return dcompare(a.d, mtype, b.d);
+    case ARG_BAD:
+      break;
+  }
+  return -2;
+}
+
+/* like find_match_op(), but skips over variables in unparsed config text */
+int find_text_match_op(const char *expr) {
+  size_t idx = 0;
+
+  if (expr[idx] == '"') {
+    for (idx = 1; expr[idx] && expr[idx] != '"'; idx++);
+    if (expr[idx] == '"') { idx++; }
+  }
+
+  while (expr[idx] != '\0') {
+    switch (expr[idx]) {
+      case '$':
+        idx++;
+        if (expr[idx] == '{') {
+          int depth = 0;
+          for (; expr[idx] != '\0'; idx++) {
+            if (expr[idx] == '{') { depth++; }
+            if (expr[idx] == '}' && --depth == 0) { break; }
+          }
+          if (expr[idx] == '\0') { return -1; }
+          idx++;
+        } else if (expr[idx] == '$') {
+          idx++;
+        } else {
+          while (isalnum(static_cast<unsigned char>(expr[idx])) != 0 ||
+                 expr[idx] == '_') {
+            idx++;
+          }
+        }
+        continue;
+      case '=':
+      case '!':
+        if (expr[idx + 1] != '=') { return -1; }
+        /* falls through */
+      case '<':
+      case '>':
+        return static_cast<int>(idx);
+    }
+    idx++;
+  }
+  return -1;
+}
+
+bool is_constant(struct text_object *root) {
+  for (struct text_object *obj = root->next; obj != nullptr; obj = obj->next) {
+    if (obj->callbacks.print != &gen_print_obj_data_s || obj->sub != nullptr ||
+        obj->callbacks.iftest != nullptr) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Operands are rendered into a scratch buffer per nesting level (an
+ * operand can hold another if_match) and copied out, so each operand only
+ * keeps as much as it needs. */
+std::deque<std::vector<char>> scratch;
+size_t scratch_depth = 0;
+
+void render_operand(match_operand &op) {
+  size_t size = max_user_text.get(*state);
+  if (scratch.size() <= scratch_depth) { scratch.emplace_back(); }
+  std::vector<char> &buf = scratch[scratch_depth];
+  if (buf.size() < size) { buf.resize(size); }
+
+  scratch_depth++;
+  generate_text_internal(buf.data(), size, *op.sub);
+  scratch_depth--;
+  op.text.assign(buf.data(), buf.data() + strlen(buf.data()) + 1);
+}
+
+/* the operand as rendered, with a cut closing quote put back */
+std::string operand_text(const match_operand &op) {
+  std::string text(op.text.data());
+  if (op.value.cut != nullptr) {
+    text += '"';
+    text += op.value.cut + 1;
+  }
+  return text;
+}
+
+void free_operand(match_operand &op) {
+  if (op.sub == nullptr) { return; }
+  free_text_objects(op.sub);
+  free_and_zero(op.sub);
+}
+
+bool compile_operand(match_operand &op, const std::string &text) {
+  op.sub = static_cast<struct text_object *>(
+      calloc(1, sizeof(struct text_object)));
+  extract_variable_text_internal(op.sub, text.c_str());
+  if (!is_constant(op.sub)) { return true; }
+
+  render_operand(op);
+  free_operand(op);
+  parse_operand(op.text.data(), op.value);
+  return op.value.type != ARG_BAD;
+}
+
+compiled_match *compile_match(const char *expr) {
+  int idx = find_text_match_op(expr);
+  if (idx <= 0) { return nullptr; }
+
+  auto match = std::make_unique<compiled_match>();
+  match->op.assign(expr + idx, expr[idx + 1] == '=' ? 2 : 1);
+  match->mtype =
+      static_cast<enum match_type>(get_match_type(match->op.c_str()));
+
+  bool ok =
+      compile_operand(match->lhs, std::string(expr, idx)) &&
+      compile_operand(match->rhs, std::string(expr + idx + match->op.size()));
+  if (ok && match->lhs.sub == nullptr && match->rhs.sub == nullptr) {
+    match->constant_result =
+        compare_values(match->lhs.value, match->mtype, match->rhs.value);
+    ok = match->constant_result != -2;
+  }
+  if (!ok) {
+    free_operand(match->lhs);
+    free_operand(match->rhs);
+    return nullptr;
+  }
+  return match.release();
+}
+
+int check_expression(const char *expression) {
+  int val = compare(expression);
+  if (val == -2) {
+    LOG_ERROR("compare failed for expression '{}'", expression);
+  } else if (val == 0) {
+    return 0;
+  }
+  return 1;
+}
+
+void free_if_match(struct text_object *obj) {
+  auto *match = static_cast<compiled_match *>(obj->data.opaque);
+  if (match == nullptr) { return; }
+  free_operand(match->lhs);
+  free_operand(match->rhs);
+  delete match;
+  obj->data.opaque = nullptr;
+}
+}  // namespace
+
+void init_if_match(struct text_object *obj, const char *arg) {
+  obj->data.opaque = compile_match(arg);
+  if (obj->data.opaque == nullptr) { extract_object_args_to_sub(obj, arg); }
+  obj->callbacks.free = &free_if_match;
+}
+
 int check_if_match(struct text_object *obj) {
+  auto *match = static_cast<compiled_match *>(obj->data.opaque);
+
+  if (match != nullptr) {
+    if (match->constant_result >= 0) { return match->constant_result; }
+
+    for (match_operand *op : {&match->lhs, &match->rhs}) {
+      if (op->sub == nullptr) { continue; }
+      render_operand(*op);
+      parse_operand(op->text.data(), op->value);
+    }
+    int val = compare_values(match->lhs.value, match->mtype, match->rhs.value);
+    if (val == -2) {
+      /* let compare() parse and report what was rendered */
+      return check_expression(
+          (operand_text(match->lhs) + match->op + operand_text(match->rhs))
+              .c_str());
+    }
+    return val;
+  }
+
   std::unique_ptr<char[]> expression(new char[max_user_text.get(*state)]);
-  int val;
-  int result = 1;
 
   generate_text_internal(expression.get(), max_user_text.get(*state),
                          *obj->sub);
   LOG_DEBUG("parsed if_match arg into '{}'", expression.get());
 
-  val = compare(expression.get());
-  if (val == -2) {
-    LOG_ERROR("compare failed for expression '{}'", expression.get());
-  } else if (val == 0) {
-    result = 0;
-  }
-  return result;
+  return check_expression(expression.get());
 }
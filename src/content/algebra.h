@@ -46,6 +46,7 @@ enum arg_type {
 };
 
 int compare(const char *);
+void init_if_match(struct text_object *, const char *);
 int check_if_match(struct text_object *);
 int get_match_type(const char *expr);
 int find_match_op(const char *expr);
@@ -27,6 +27,8 @@
  *
  */
 
+#include <algorithm>
+#include <string_view>
 #include <vector>
 
 #include "../core.h"
@@ -37,6 +39,9 @@ struct combine_data {
   char *left;
   char *seperation;
   char *right;
+  /* renderings of both sides and their rows, reused between updates */
+  std::vector<char> buf[2];
+  std::vector<std::string_view> rows[2];
 };
 
 void parse_combine_arg(struct text_object *obj, const char *arg) {
@@ -68,8 +73,7 @@ void parse_combine_arg(struct text_object *obj, const char *arg) {
     COMMAND_ARG_ERR("combine", "needs arguments: <text1> <text2>");
   }
 
-  cd = static_cast<struct combine_data *>(malloc(sizeof(struct combine_data)));
-  memset(cd, 0, sizeof(struct combine_data));
+  cd = new combine_data{};
 
   cd->left = static_cast<char *>(malloc(endvar[0] - startvar[0] + 1));
   cd->seperation = static_cast<char *>(malloc(startvar[1] - endvar[0] + 1));
@@ -95,97 +99,60 @@ void parse_combine_arg(struct text_object *obj, const char *arg) {
 
 void print_combine(struct text_object *obj, char *p, unsigned int p_max_size) {
   auto *cd = static_cast<struct combine_data *>(obj->data.opaque);
-  std::vector<std::vector<char>> buf;
-  buf.resize(2);
-  buf[0].resize(max_user_text.get(*state));
-  buf[1].resize(max_user_text.get(*state));
-  int i, j;
-  int p_len_remaining = p_max_size - 1;
-  long longest = 0;
-  int nextstart;
-  int nr_rows[2];
-  struct llrows {
-    char *row;
-    struct llrows *next;
-  };
-  struct llrows *ll_rows[2], *current[2];
+  size_t longest = 0;
+  size_t len = 0;
   struct text_object *objsub = obj->sub;
 
   if ((cd == nullptr) || (p_max_size == 0)) { return; }
 
-  p[0] = 0;
-  for (i = 0; i < 2; i++) {
-    nr_rows[i] = 1;
-    nextstart = 0;
-    ll_rows[i] = static_cast<struct llrows *>(malloc(sizeof(struct llrows)));
-    current[i] = ll_rows[i];
-    for (j = 0; j < i; j++) { objsub = objsub->sub; }
-    generate_text_internal(&(buf[i][0]), max_user_text.get(*state), *objsub);
-    for (j = 0; buf[i][j] != 0; j++) {
-      if (buf[i][j] == '\t') { buf[i][j] = ' '; }
-      if (buf[i][j] == '\n') {
-        buf[i][j] = 0;  // the vars inside combine may not have a \n at the end
+  for (int i = 0; i < 2; i++) {
+    std::vector<char> &buf = cd->buf[i];
+    std::vector<std::string_view> &rows = cd->rows[i];
+    size_t j, nextstart = 0;
+
+    if (i == 1) { objsub = objsub->sub; }
+    buf.resize(max_user_text.get(*state));
+    generate_text_internal(buf.data(), buf.size(), *objsub);
+    rows.clear();
+    for (j = 0; buf[j] != 0; j++) {
+      if (buf[j] == '\t') { buf[j] = ' '; }
+      if (buf[j] == '\n') {
+        buf[j] = 0;  // the vars inside combine may not have a \n at the end
       }
-      if (buf[i][j] ==
+      if (buf[j] ==
           2) {  // \002 is used instead of \n to separate lines inside a var
-        buf[i][j] = 0;
-        current[i]->row = strdup(&(buf[i][0]) + nextstart);
-        if (i == 0 && static_cast<long>(strlen(current[i]->row)) > longest) {
-          longest = static_cast<long>(strlen(current[i]->row));
-        }
-        current[i]->next =
-            static_cast<struct llrows *>(malloc(sizeof(struct llrows)));
-        current[i] = current[i]->next;
+        buf[j] = 0;
+        rows.emplace_back(buf.data() + nextstart);
         nextstart = j + 1;
-        nr_rows[i]++;
       }
     }
-    current[i]->row = strdup(&(buf[i][0]) + nextstart);
-    if (i == 0 && static_cast<long>(strlen(current[i]->row)) > longest) {
-      longest = static_cast<long>(strlen(current[i]->row));
-    }
-    current[i]->next = nullptr;
-    current[i] = ll_rows[i];
+    /* a row ends at the first terminator, rows after a \n are still read */
+    rows.emplace_back(buf.data() + nextstart);
   }
-  for (j = 0; j < (nr_rows[0] > nr_rows[1] ? nr_rows[0] : nr_rows[1]); j++) {
-    if (current[0] != nullptr) {
-      strncat(p, current[0]->row, p_len_remaining);
-      p_len_remaining -= strlen(current[0]->row);
-      i = strlen(current[0]->row);
-    } else {
-      i = 0;
-    }
-    while (i < longest) {
-      strncat(p, " ", p_len_remaining);
-      p_len_remaining -= 2;
-      i++;
-    }
-    if (current[1] != nullptr) {
-      p_len_remaining -= strlen(cd->seperation);
-      strncat(p, cd->seperation, p_len_remaining);
-      p_len_remaining -= strlen(current[1]->row);
-      strncat(p, current[1]->row, p_len_remaining);
-    }
-    strncat(p, "\n", p_len_remaining);
-    p_len_remaining -= 2;
-#ifdef HAVE_OPENMP
-#pragma omp parallel for schedule(dynamic, 10)
-#endif /* HAVE_OPENMP */
-    for (i = 0; i < 2; i++) {
-      if (current[i] != nullptr) { current[i] = current[i]->next; }
-    }
+  for (const auto &row : cd->rows[0]) {
+    longest = std::max(longest, row.size());
   }
-#ifdef HAVE_OPENMP
-#pragma omp parallel for schedule(dynamic, 10)
-#endif /* HAVE_OPENMP */
-  for (i = 0; i < 2; i++) {
-    while (ll_rows[i] != nullptr) {
-      current[i] = ll_rows[i];
-      free(current[i]->row);
-      ll_rows[i] = current[i]->next;
-      free(current[i]);
+
+  auto append = [&](std::string_view s) {
+    size_t n = std::min(s.size(), p_max_size - 1 - len);
+    memcpy(p + len, s.data(), n);
+    len += n;
+  };
+  size_t nr_rows = std::max(cd->rows[0].size(), cd->rows[1].size());
+  for (size_t row = 0; row < nr_rows; row++) {
+    size_t width = 0;
+    if (row < cd->rows[0].size()) {
+      append(cd->rows[0][row]);
+      width = cd->rows[0][row].size();
+    }
+    for (; width < longest; width++) { append(" "); }
+    if (row < cd->rows[1].size()) {
+      append(cd->seperation);
+      append(cd->rows[1][row]);
     }
+    append("\n");
   }
+  p[len] = 0;
 }
 
 void free_combine(struct text_object *obj) {
@@ -199,5 +166,6 @@ void free_combine(struct text_object *obj) {
   free_and_zero(obj->sub->sub);
   free_text_objects(obj->sub);
   free_and_zero(obj->sub);
-  free_and_zero(obj->data.opaque);
+  delete cd;
+  obj->data.opaque = nullptr;
 }
@@ -0,0 +1,193 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2024 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "profile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/fmt/fmt.h>
+
+#include "../conky.h"
+#include "../logging.h"
+
+conky::simple_config_setting<bool> profile_objects("profile_objects", false,
+                                                   false);
+
+namespace {
+#ifdef BUILD_PROFILE_ALLOCATIONS
+/* bytes requested from operator new by this thread while an
+ * object_profile_scope was open on it */
+thread_local uint64_t allocated_bytes = 0;
+thread_local int open_scopes = 0;
+#endif /* BUILD_PROFILE_ALLOCATIONS */
+
+/* line -> name -> entry; std::map keeps the entries where they are */
+std::map<long, std::map<std::string, object_profile, std::less<>>> profiles;
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+uint64_t cost(const object_profile &p) { return p.total_ns + p.updater_ns; }
+
+/* entries that were called, most expensive first */
+std::vector<const object_profile *> ranked_profiles() {
+  std::vector<const object_profile *> ranked;
+  for (const auto &[line, names] : profiles) {
+    for (const auto &[name, p] : names) {
+      if (p.calls > 0) { ranked.push_back(&p); }
+    }
+  }
+  std::stable_sort(ranked.begin(), ranked.end(),
+                   [](const object_profile *a, const object_profile *b) {
+                     return cost(*a) > cost(*b);
+                   });
+  return ranked;
+}
+
+/* accounts the run of the callback updating obj's data, if there was a new
+ * one since the last call */
+template <typename Handle>
+void account_updater(object_profile &p, Handle *handle) {
+  if (handle == nullptr) { return; }
+  uint64_t runs = (*handle)->work_runs;
+  if (runs != p.updater_runs) {
+    p.updater_runs = runs;
+    p.updater_ns += (*handle)->last_work_ns;
+  }
+}
+}  // namespace
+
+#ifdef BUILD_PROFILE_ALLOCATIONS
+/* Counting allocations needs the global operator new, which then applies to
+ * the whole program, hence the build option; C allocations made with
+ * malloc() and strdup() are not seen. */
+void *operator new(std::size_t size) {
+  if (open_scopes > 0) { allocated_bytes += size; }
+  if (void *ptr = std::malloc(size != 0 ? size : 1)) { return ptr; }
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) { return ::operator new(size); }
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+#endif /* BUILD_PROFILE_ALLOCATIONS */
+
+struct object_profile *profile_object(const char *name, long line) {
+  auto &names = profiles[line];
+  auto it = names.find(std::string_view(name));
+  if (it == names.end()) {
+    it = names.emplace(name, object_profile{name, line, 0, 0, 0, 0, 0, 0})
+             .first;
+  }
+  return &it->second;
+}
+
+void object_profile_scope::begin() {
+#ifdef BUILD_PROFILE_ALLOCATIONS
+  open_scopes++;
+  allocated = allocated_bytes;
+#endif /* BUILD_PROFILE_ALLOCATIONS */
+  start = std::chrono::steady_clock::now();
+}
+
+void object_profile_scope::finish() {
+  uint64_t ns = elapsed_ns(start);
+  object_profile &p = *obj->profile;
+
+  p.calls++;
+  p.total_ns += ns;
+  p.max_ns = std::max(p.max_ns, ns);
+#ifdef BUILD_PROFILE_ALLOCATIONS
+  open_scopes--;
+  p.alloc_bytes += allocated_bytes - allocated;
+#endif /* BUILD_PROFILE_ALLOCATIONS */
+  account_updater(p, obj->cb_handle);
+  account_updater(p, obj->exec_handle);
+}
+
+std::string profile_json() {
+  std::string json = "{\"objects\":[";
+  bool first = true;
+  for (const object_profile *p : ranked_profiles()) {
+    fmt::format_to(std::back_inserter(json),
+                   "{}{{\"name\":\"{}\",\"line\":{},\"calls\":{},"
+                   "\"total_ns\":{},\"max_ns\":{},\"updater_ns\":{},"
+                   "\"alloc_bytes\":{}}}",
+                   first ? "" : ",", p->name, p->line, p->calls, p->total_ns,
+                   p->max_ns, p->updater_ns, p->alloc_bytes);
+    first = false;
+  }
+  json += "]}";
+  return json;
+}
+
+void parse_profile_arg(struct text_object *obj, const char *arg) {
+  int n = 5;
+  if (arg != nullptr) {
+    /* both ${profile 3} and ${profile top 3} */
+    if (strncmp(arg, "top", 3) == 0) { arg += 3; }
+    if (sscanf(arg, "%d", &n) != 1 && *arg != '\0') {
+      COMMAND_ARG_ERR("profile", "takes the arguments: [top] (n)");
+    }
+  }
+  obj->data.i = std::max(n, 1);
+}
+
+void print_profile(struct text_object *obj, char *p, unsigned int p_max_size) {
+  if (!profile_objects.get(*state)) {
+    snprintf(p, p_max_size, "%s", "profile_objects is off");
+    return;
+  }
+
+  std::string out;
+  auto ranked = ranked_profiles();
+  size_t n = std::min(ranked.size(), static_cast<size_t>(obj->data.i));
+  for (size_t i = 0; i < n; i++) {
+    const object_profile &e = *ranked[i];
+    fmt::format_to(std::back_inserter(out),
+                   "{}{}:{} {:.3f}ms {:.3f}ms max {:.3f}ms upd",
+                   i == 0 ? "" : "\n", e.name, e.line,
+                   e.total_ns / 1e6 / e.calls, e.max_ns / 1e6,
+                   e.updater_ns / 1e6 / e.calls);
+#ifdef BUILD_PROFILE_ALLOCATIONS
+    fmt::format_to(std::back_inserter(out), " {}B", e.alloc_bytes / e.calls);
+#endif /* BUILD_PROFILE_ALLOCATIONS */
+  }
+  snprintf(p, p_max_size, "%s", out.c_str());
+}
@@ -0,0 +1,94 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2024 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "../lua/setting.hh"
+#include "text_object.h"
+
+/* Cost of the text objects parsed from one place in the config
+ *
+ * Objects are keyed by their name and the line of the text they were parsed
+ * from, so all objects of a template or a $combine expansion on one line
+ * share an entry. Times include the objects nested in an object (its
+ * arguments, the sides of a $combine, ...). */
+struct object_profile {
+  std::string name;
+  long line;
+  uint64_t calls;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  /* bytes requested from operator new while the object printed, only
+   * counted when built with BUILD_PROFILE_ALLOCATIONS */
+  uint64_t alloc_bytes;
+  /* time the callback updating the object's data spent in work(), counted
+   * once per run */
+  uint64_t updater_ns;
+  uint64_t updater_runs;
+};
+
+extern conky::simple_config_setting<bool> profile_objects;
+
+/* returns the entry for objects called name on the given line; entries live
+ * as long as the process, so objects can keep pointers to them */
+struct object_profile *profile_object(const char *name, long line);
+
+/* all entries as a JSON document, most expensive first */
+std::string profile_json();
+
+/* Times one callback of an object with a profile entry, the way
+ * generate_text_internal() calls them. */
+class object_profile_scope {
+  struct text_object *obj;
+  std::chrono::steady_clock::time_point start;
+  uint64_t allocated;
+
+  void begin();
+  void finish();
+
+ public:
+  explicit object_profile_scope(struct text_object *obj_)
+      : obj(obj_ != nullptr && obj_->profile != nullptr ? obj_ : nullptr) {
+    if (obj != nullptr) { begin(); }
+  }
+  ~object_profile_scope() {
+    if (obj != nullptr) { finish(); }
+  }
+
+  object_profile_scope(const object_profile_scope &) = delete;
+  object_profile_scope &operator=(const object_profile_scope &) = delete;
+};
+
+void parse_profile_arg(struct text_object *, const char *);
+void print_profile(struct text_object *, char *, unsigned int);
+
+#endif /* _PROFILE_H */
@@ -26,6 +26,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  */
+#include <string>
 #include <vector>
 #include "../conky.h"
 #include "../core.h"
@@ -75,6 +76,9 @@ inline bool scroll_check_skip_byte(char c) {
 #define SCROLL_RIGHT 2
 #define SCROLL_WAIT 3
 
+// place all the lines behind each other with LINESEPARATOR between them
+#define LINESEPARATOR '|'
+
 struct scroll_data {
   char *text;
   unsigned int show;
@@ -84,17 +88,24 @@ struct scroll_data {
   signed int start;
   Colour resetcolor;
   int direction;
+  /* rendering buffer, reused between updates */
+  std::vector<char> buf;
+  /* the inner text as last rendered, and the same with its lines joined;
+   * scrolling goes on over line as long as the inner text does not change */
+  std::string rendered;
+  std::string line;
+  unsigned int colorchanges;
 };
 
 /**
  * Get count of characters to right from (sd->start) position.
  */
-static unsigned int scroll_count_characters_to_right(
-    struct scroll_data *sd, const std::vector<char> &buf) {
+static unsigned int scroll_count_characters_to_right(struct scroll_data *sd,
+                                                     const std::string &buf) {
   unsigned int n = 0;
   unsigned int offset = sd->start;
 
-  while ('\0' != buf[offset] && offset < buf.size()) {
+  while (offset < buf.size() && '\0' != buf[offset]) {
     offset += scroll_character_length(buf[offset]);
     ++n;
   }
@@ -102,26 +113,25 @@ static unsigned int scroll_count_characters_to_right(
   return n;
 }
 
-static void scroll_scroll_left(struct scroll_data *sd,
-                               const std::vector<char> &buf,
+static void scroll_scroll_left(struct scroll_data *sd, const std::string &buf,
                                unsigned int amount) {
-  for (unsigned int i = 0; (i < amount) && (buf[sd->start] != '\0') &&
-                           (static_cast<unsigned int>(sd->start) < buf.size());
+  for (unsigned int i = 0;
+       (i < amount) && (static_cast<unsigned int>(sd->start) < buf.size()) &&
+       (buf[sd->start] != '\0');
        ++i) {
     sd->start += scroll_character_length(buf[sd->start]);
   }
 
-  if (buf[sd->start] == 0 ||
-      static_cast<unsigned int>(sd->start) > strlen(buf.data())) {
+  if (static_cast<unsigned int>(sd->start) >= buf.size() ||
+      buf[sd->start] == 0) {
     sd->start = 0;
   }
 }
 
-static void scroll_scroll_right(struct scroll_data *sd,
-                                const std::vector<char> &buf,
+static void scroll_scroll_right(struct scroll_data *sd, const std::string &buf,
                                 unsigned int amount) {
   for (unsigned int i = 0; i < amount; ++i) {
-    if (sd->start <= 0) { sd->start = static_cast<int>(strlen(&(buf[0]))); }
+    if (sd->start <= 0) { sd->start = static_cast<int>(buf.size()); }
 
     while (--(sd->start) >= 0) {
       if (!scroll_check_skip_byte(buf[sd->start])) { break; }
@@ -204,46 +214,59 @@ void parse_scroll_arg(struct text_object *obj, const char *arg,
 
 void print_scroll(struct text_object *obj, char *p, unsigned int p_max_size) {
   auto *sd = static_cast<struct scroll_data *>(obj->data.opaque);
-  unsigned int j, colorchanges = 0, frontcolorchanges = 0,
-                  visibcolorchanges = 0;
-  std::vector<char> buf(max_user_text.get(*state), static_cast<char>(0));
-
-  if (sd == nullptr) { return; }
-
-  generate_text_internal(&(buf[0]), max_user_text.get(*state), *obj->sub);
-  for (j = 0; buf[j] != 0; j++) {
-    if (buf[j] == '\n') {
-      // place all the lines behind each other with LINESEPARATOR between them
-#define LINESEPARATOR '|'
-      buf[j] = LINESEPARATOR;
-    } else if (buf[j] == SPECIAL_CHAR) {
-      colorchanges++;
+  unsigned int j, frontcolorchanges = 0, visibcolorchanges = 0;
+
+  if ((sd == nullptr) || (p_max_size == 0)) { return; }
+
+  sd->buf.resize(max_user_text.get(*state));
+  generate_text_internal(sd->buf.data(), sd->buf.size(), *obj->sub);
+  if (sd->rendered != sd->buf.data()) {
+    sd->rendered = sd->buf.data();
+    sd->line = sd->rendered;
+    sd->colorchanges = 0;
+    for (char &c : sd->line) {
+      if (c == '\n') {
+        c = LINESEPARATOR;
+      } else if (c == SPECIAL_CHAR) {
+        sd->colorchanges++;
+      }
     }
   }
+  const std::string &buf = sd->line;
+  unsigned int colorchanges = sd->colorchanges;
 
   // no scrolling necessary if the length of the text to scroll is too short
-  if (strlen(&(buf[0])) - colorchanges <= sd->show) {
-    snprintf(p, p_max_size, "%s", &(buf[0]));
+  if (buf.size() - colorchanges <= sd->show) {
+    snprintf(p, p_max_size, "%s", buf.c_str());
     return;
   }
 
   // if length of text changed to shorter so the (sd->start) is already
   // outside of actual text then reset (sd->start)
-  if (static_cast<unsigned int>(sd->start) >= strlen(&(buf[0]))) {
-    sd->start = 0;
-  }
+  if (static_cast<unsigned int>(sd->start) >= buf.size()) { sd->start = 0; }
 
   // make sure a colorchange at the front is not part of the string we are going
   // to show
   while (buf[sd->start] == SPECIAL_CHAR) { sd->start++; }
 
+  // count colorchanges in front of the visible part and place that many
+  // colorchanges in front of the visible part
+  for (j = 0; j < static_cast<unsigned>(sd->start); j++) {
+    if (buf[j] == SPECIAL_CHAR) { frontcolorchanges++; }
+  }
+
+  unsigned int len = 0;
+  auto put = [&](char c) {
+    if (len + 1 < p_max_size) { p[len++] = c; }
+  };
+  for (j = 0; j < frontcolorchanges; j++) { put(SPECIAL_CHAR); }
+
   // place all chars that should be visible in p, including colorchanges
   unsigned int visiblechars;
-  for (j = 0, visiblechars = 0; visiblechars < sd->show;) {
+  const unsigned int visible_end = buf.size() - sd->start;
+  for (j = 0, visiblechars = 0; visiblechars < sd->show && j < visible_end;) {
     char c = buf[sd->start + j];
-    p[j] = c;
-    if (0 == c) { break; }
-
+    put(c);
     ++j;
 
     if (SPECIAL_CHAR == c) {
@@ -251,8 +274,8 @@ void print_scroll(struct text_object *obj, char *p, unsigned int p_max_size) {
     } else {
       int l = scroll_character_length(c);
 
-      while (--l != 0) {
-        p[j] = buf[sd->start + j];
+      while (--l != 0 && j < visible_end) {
+        put(buf[sd->start + j]);
         ++j;
       }
 
@@ -260,30 +283,14 @@ void print_scroll(struct text_object *obj, char *p, unsigned int p_max_size) {
     }
   }
 
-  for (; visiblechars < sd->show; j++, visiblechars++) { p[j] = ' '; }
-  p[j] = 0;
-
-  // count colorchanges in front of the visible part and place that many
-  // colorchanges in front of the visible part
-  for (j = 0; j < static_cast<unsigned>(sd->start); j++) {
-    if (buf[j] == SPECIAL_CHAR) { frontcolorchanges++; }
-  }
-
-  int pwithcolors_len = strlen(p) + 4 + colorchanges - visibcolorchanges;
-  char *pwithcolors = new char[pwithcolors_len];
+  for (; visiblechars < sd->show; visiblechars++) { put(' '); }
 
-  for (j = 0; j < frontcolorchanges; j++) { pwithcolors[j] = SPECIAL_CHAR; }
-  pwithcolors[j] = 0;
-  strcat(pwithcolors, p);
-  unsigned int strend = strlen(pwithcolors);
   // and place the colorchanges not in front or in the visible part behind the
   // visible part
   for (j = 0; j < colorchanges - frontcolorchanges - visibcolorchanges; j++) {
-    pwithcolors[strend + j] = SPECIAL_CHAR;
+    put(SPECIAL_CHAR);
   }
-  pwithcolors[strend + j] = 0;
-  strncpy(p, pwithcolors, p_max_size);
-  delete[] pwithcolors;
+  p[len] = 0;
 
   // scroll
   if (sd->direction == SCROLL_LEFT) {
@@ -46,7 +46,7 @@
 #include "../output/display-output.hh"
 #include "colours.hh"
 
-struct special_node *specials = nullptr;
+std::vector<special_node> specials;
 
 int special_count;
 double maxspeedval = 1e-47; /* The maximum value among the speed graphs */
@@ -430,33 +430,33 @@ done:
  * Printing various special text objects
  */
 
-struct special_node *new_special_t_node() { return new special_node{}; }
-
 /**
- * expands the current global linked list specials to special_count elements
+ * registers the next special, growing specials to special_count elements
  *
  * increases special_count
  * @param[out] buf is set to "\x01\x00" not sure why ???
  * @param[in]  t   special type enum, e.g. alignc, alignr, fg, bg, ...
- * @return pointer to the newly inserted special of type t
+ * @return pointer to the newly inserted special of type t, valid until the
+ *         next call
  **/
 struct special_node *new_special(char *buf, text_node_t t) {
-  special_node *current;
-
   buf[0] = SPECIAL_CHAR;
   buf[1] = '\0';
-  if (specials == nullptr) { specials = new_special_t_node(); }
-  current = specials;
-  /* allocate special_count linked list elements */
-  for (int i = 0; i < special_count; i++) {
-    if (current->next == nullptr) { current->next = new_special_t_node(); }
-    current = current->next;
+  if (special_count >= static_cast<int>(specials.size())) {
+    specials.emplace_back();
   }
+  special_node *current = &specials[special_count];
   current->type = t;
   special_count++;
   return current;
 }
 
+void free_specials() {
+  specials.clear();
+  specials.shrink_to_fit();
+  special_count = 0;
+}
+
 void new_gauge_in_shell(struct text_object *obj, char *p,
                         unsigned int p_max_size, double usage) {
   static const char *gaugevals[] = {"_. ", "\\. ", " | ", " ./", " ._"};
@@ -93,13 +93,19 @@ struct special_node {
   char invertx;
   char inverty;
   int minheight;
-  struct special_node *next;
 };
 
-/* direct access to the registered specials (FIXME: bad encapsulation) */
-extern struct special_node *specials;
+/* direct access to the registered specials (FIXME: bad encapsulation)
+ *
+ * specials are indexed by their position in the generated text; slots are
+ * reused across updates so graphs keep their history */
+extern std::vector<special_node> specials;
 extern int special_count;
 
+inline special_node *special_at(int index) { return &specials[index]; }
+
+void free_specials();
+
 /* forward declare to avoid mutual inclusion between specials.h and
  * text_object.h */
 struct text_object;
@@ -29,6 +29,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <unordered_map>
 #include "../conky.h"
 #include "../logging.h"
 #include "config.h"
@@ -187,3 +188,85 @@ void obj_be_plain_text(struct text_object *obj, const char *text) {
   obj->callbacks.print = &gen_print_obj_data_s;
   obj->callbacks.free = &gen_free_opaque;
 }
+
+struct text_program *compile_text_program(struct text_object *root) {
+  using op = text_instruction::op;
+  auto *program = new text_program;
+  auto &code = program->code;
+  /* index of the first instruction after each jump target */
+  std::unordered_map<const text_object *, size_t> after;
+  /* jumps to patch once their targets have been placed */
+  std::vector<std::pair<size_t, const text_object *>> jumps;
+  /* whether the last instruction is a literal plain text can be merged into */
+  bool in_literal = false;
+
+  for (text_object *obj = root->next; obj != nullptr; obj = obj->next) {
+    text_instruction ins{};
+    ins.obj = obj;
+    const obj_cb &cb = obj->callbacks;
+    bool emit = true;
+
+    if (cb.print == &gen_print_obj_data_s) {
+      size_t len = obj->data.s != nullptr ? strlen(obj->data.s) : 0;
+      if (in_literal) {
+        code.back().len += len;
+      } else if (len > 0) {
+        ins.code = op::LITERAL;
+        ins.offset = program->literals.size();
+        ins.len = len;
+        code.push_back(ins);
+        in_literal = true;
+      }
+      if (len > 0) { program->literals.append(obj->data.s, len); }
+      after[obj] = code.size();
+      continue;
+    }
+
+    if (cb.print == &gen_print_nothing) {
+      emit = false;
+    } else if (cb.print != nullptr) {
+      ins.code = op::PRINT;
+      ins.fn.print = cb.print;
+    } else if (cb.iftest != nullptr) {
+      ins.code = cb.iftest == &gen_false_iftest ? op::JUMP : op::IFTEST;
+      ins.fn.iftest = cb.iftest;
+      /* without a target the old walk just carried on */
+      if (obj->ifblock_next != nullptr) {
+        jumps.emplace_back(code.size(), obj->ifblock_next);
+      } else {
+        emit = ins.code == op::IFTEST;
+      }
+    } else if (cb.barval != nullptr) {
+      ins.code = op::BAR;
+      ins.fn.value = cb.barval;
+    } else if (cb.gaugeval != nullptr) {
+      ins.code = op::GAUGE;
+      ins.fn.value = cb.gaugeval;
+    } else if (cb.graphval != nullptr) {
+      ins.code = op::GRAPH;
+      ins.fn.value = cb.graphval;
+    } else if (cb.percentage != nullptr) {
+      ins.code = op::PERCENTAGE;
+      ins.fn.percentage = cb.percentage;
+    } else {
+      emit = false;
+    }
+
+    /* a literal must not run across a jump target */
+    in_literal = false;
+    if (emit) { code.push_back(ins); }
+    after[obj] = code.size();
+  }
+
+  for (auto &[index, target] : jumps) {
+    auto it = after.find(target);
+    if (it == after.end()) {
+      LOG_DEBUG("ifblock jumps out of its object list, not compiling it");
+      delete program;
+      return nullptr;
+    }
+    code[index].jump = static_cast<int32_t>(it->second - index - 1);
+  }
+
+  return program;
+}
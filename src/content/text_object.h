@@ -35,6 +35,8 @@
 #include "specials.h" /* enum special_types */
 
 #include <cstdint> /* uint8_t */
+#include <string>
+#include <vector>
 
 enum class draw_mode_t : uint32_t {
   BG = static_cast<uint32_t>(text_node_t::BG),
@@ -133,8 +135,56 @@ struct text_object {
    * pointers so we can instantiate them later. */
   exec_cb_handle *exec_handle;
   legacy_cb_handle *cb_handle;
+
+  /* only set on list roots: the list compiled by compile_text_program() */
+  struct text_program *program;
+
+  /* set while profile_objects is on, see profile.h */
+  struct object_profile *profile;
+};
+
+/* A text object list lowered into a flat instruction array
+ *
+ * Runs of plain text are merged into a single literal, if/else objects turn
+ * into relative jumps and each instruction carries the one callback that
+ * generate_text_internal() would pick for its object. endif and objects that
+ * print nothing are dropped.
+ */
+struct text_instruction {
+  enum class op : uint8_t {
+    LITERAL,    /* copy len bytes from the literal pool at offset */
+    PRINT,      /* fn.print */
+    IFTEST,     /* fn.iftest, on zero add jump to the program counter */
+    JUMP,       /* add jump to the program counter */
+    BAR,        /* fn.value */
+    GAUGE,      /* fn.value */
+    GRAPH,      /* fn.value */
+    PERCENTAGE, /* fn.percentage */
+  };
+
+  op code;
+  /* relative to the instruction following this one */
+  int32_t jump;
+  struct text_object *obj;
+  union {
+    void (*print)(struct text_object *, char *, unsigned int);
+    int (*iftest)(struct text_object *);
+    double (*value)(struct text_object *);
+    uint8_t (*percentage)(struct text_object *);
+  } fn;
+  size_t offset;
+  size_t len;
 };
 
+struct text_program {
+  std::vector<text_instruction> code;
+  std::string literals;
+};
+
+/* returns nullptr if the list can't be compiled, generate_text_internal()
+ * then walks the list itself */
+struct text_program *compile_text_program(struct text_object *root);
+
 /* text object list helpers */
 int append_object(struct text_object *root, struct text_object *obj);
 
@@ -80,6 +80,7 @@
 #include "data/hardware/nvidia.h"
 #endif /* BUILD_NVIDIA */
 #include <inttypes.h>
+#include "content/profile.h"
 #include "content/scroll.h"
 #include "content/specials.h"
 #include "content/temphelper.h"
@@ -1094,23 +1095,20 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   END OBJ_ARG(head, nullptr, "head needs arguments")
       init_tailhead("head", arg, obj);
   obj->callbacks.print = &print_head;
-  END OBJ_ARG(lines, nullptr, "lines needs an argument") obj->data.s =
-      STRNDUP_ARG;
+  END OBJ_ARG(lines, nullptr, "lines needs an argument")
+      init_filecount(arg, obj);
   obj->callbacks.print = &print_lines;
-  obj->callbacks.free = &gen_free_opaque;
-  END OBJ_ARG(words, nullptr, "words needs a argument") obj->data.s =
-      STRNDUP_ARG;
+  END OBJ_ARG(words, nullptr, "words needs a argument")
+      init_filecount(arg, obj);
   obj->callbacks.print = &print_words;
-  obj->callbacks.free = &gen_free_opaque;
   END OBJ(loadavg, &update_load_average) scan_loadavg_arg(obj, arg);
   obj->callbacks.print = &print_loadavg;
   END OBJ_IF_ARG(if_empty, nullptr, "if_empty needs an argument") obj->sub =
       static_cast<text_object *>(malloc(sizeof(struct text_object)));
   extract_variable_text_internal(obj->sub, arg);
   obj->callbacks.iftest = &if_empty_iftest;
-  END OBJ_IF_ARG(if_match, nullptr, "if_match needs arguments") obj->sub =
-      static_cast<text_object *>(malloc(sizeof(struct text_object)));
-  extract_variable_text_internal(obj->sub, arg);
+  END OBJ_IF_ARG(if_match, nullptr, "if_match needs arguments")
+      init_if_match(obj, arg);
   obj->callbacks.iftest = &check_if_match;
   END OBJ_IF_ARG(if_existing, nullptr, "if_existing needs an argument or two")
       obj->data.s = STRNDUP_ARG;
@@ -1284,9 +1282,10 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   obj->callbacks.print = &print_format_time;
   END OBJ(nodename, nullptr) obj->callbacks.print = &print_nodename;
   END OBJ(nodename_short, nullptr) obj->callbacks.print = &print_nodename_short;
-  END OBJ_ARG(cmdline_to_pid, nullptr,
+  END OBJ_ARG(cmdline_to_pid, &update_top,
               "cmdline_to_pid needs a command line as argument")
-      scan_cmdline_to_pid_arg(obj, arg, free_at_crash);
+      top_running = 1;
+  scan_cmdline_to_pid_arg(obj, arg, free_at_crash);
   obj->callbacks.print = &print_cmdline_to_pid;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ_ARG(pid_chroot, nullptr, "pid_chroot needs a pid as argument")
@@ -1426,6 +1425,8 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   END OBJ(processes, &update_total_processes)
 #endif
       obj->callbacks.print = &print_processes;
+  END OBJ(profile, nullptr) parse_profile_arg(obj, arg);
+  obj->callbacks.print = &print_profile;
 #ifdef __linux__
   END OBJ(distribution, 0) obj->callbacks.print = &print_distribution;
   END OBJ(running_processes, &update_top) top_running = 1;
@@ -1814,27 +1815,27 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
 #endif /* BUILD_RSS */
   END OBJ_ARG(lua, nullptr,
               "lua needs arguments: <function name> [function parameters]")
-      obj->data.s = STRNDUP_ARG;
+      llua_init_call(obj, arg);
   obj->callbacks.print = &print_lua;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &llua_free_call;
   END OBJ_ARG(
       lua_parse, nullptr,
       "lua_parse needs arguments: <function name> [function parameters]")
-      obj->data.s = STRNDUP_ARG;
+      llua_init_call(obj, arg);
   obj->callbacks.print = &print_lua_parse;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &llua_free_call;
   END OBJ_ARG(lua_bar, nullptr,
               "lua_bar needs arguments: <height>,<width> <function name> "
               "[function parameters]") arg = scan_bar(obj, arg, 100);
   if (arg != nullptr) {
-    obj->data.s = STRNDUP_ARG;
+    llua_init_call(obj, arg);
   } else {
     COMMAND_ARG_ERR("lua_bar",
                     "lua_bar needs arguments: <height>,<width> <function name> "
                     "[function parameters]");
   }
   obj->callbacks.barval = &lua_barval;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &llua_free_call;
 #ifdef BUILD_GUI
   END OBJ_ARG(
       lua_graph, nullptr,
@@ -1845,7 +1846,8 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
              buf != nullptr ? graph_data_key{fmt::format("lua:{}", buf)}
                             : graph_parent_obj_key);
   if (buf != nullptr) {
-    obj->data.s = buf;
+    llua_init_call(obj, buf);
+    free(buf);
   } else {
     COMMAND_ARG_ERR(
         "lua_graph",
@@ -1853,12 +1855,12 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
         "[gradient colour 1] [gradient colour 2] [scale] [-t] [-l]");
   }
   obj->callbacks.graphval = &lua_barval;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &llua_free_call;
   END OBJ_ARG(lua_gauge, nullptr,
               "lua_gauge needs arguments: <height>,<width> <function name> "
               "[function parameters]") arg = scan_gauge(obj, arg, 100);
   if (arg != nullptr) {
-    obj->data.s = STRNDUP_ARG;
+    llua_init_call(obj, arg);
   } else {
     COMMAND_ARG_ERR(
         "lua_gauge",
@@ -1866,7 +1868,7 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
         "[function parameters]");
   }
   obj->callbacks.gaugeval = &lua_barval;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &llua_free_call;
 #endif /* BUILD_GUI */
 #ifdef BUILD_HDDTEMP
   END OBJ(hddtemp, &update_hddtemp) if (arg) obj->data.s = STRNDUP_ARG;
@@ -2063,6 +2065,11 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
 #undef __OBJ_ARG
 #undef END
 
+  /* lines of the text are counted from 0 */
+  if (profile_objects.get(*state)) {
+    obj->profile = profile_object(s, line + 1);
+  }
+
   obj_guard.release();
   return obj;
 }
@@ -2248,6 +2255,8 @@ int extract_variable_text_internal(struct text_object *retval,
     LOG_WARNING("one or more $endif's are missing");
   }
 
+  retval->program = compile_text_program(retval);
+
   free(orig_p);
   return 0;
 }
@@ -2263,6 +2272,10 @@ void extract_object_args_to_sub(struct text_object *obj, const char *args) {
 void free_text_objects(struct text_object *root) {
   struct text_object *obj;
 
+  if (root != nullptr) {
+    delete root->program;
+    root->program = nullptr;
+  }
   if ((root != nullptr) && (root->prev != nullptr)) {
     for (obj = root->prev; obj != nullptr; obj = root->prev) {
       root->prev = obj->prev;
@@ -23,170 +23,221 @@
  */
 
 #include <libical/ical.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "../conky.h"
 #include "../logging.h"
+#include "../update-cb.hh"
+#include "ical.h"
 
+namespace {
+/* summaries of the upcoming events, soonest first */
+typedef std::shared_ptr<const std::vector<std::string>> ical_summaries;
+
+/* a VEVENT and its next occurrence */
 struct ical_event {
   icaltimetype start;
   icalcomponent *event;
-  ical_event *next, *prev;
+  icalrecur_iterator *recur; /* nullptr unless the event has an RRULE */
 };
 
-struct obj_ical {
-  struct ical_event *list;
-  icalcomponent *comps;
-  icalparser *parser;
-  unsigned int num;
-};
+bool starts_later(const ical_event &a, const ical_event &b) {
+  return icaltime_compare(a.start, b.start) > 0;
+}
 
 char *read_stream(char *s, size_t size, void *d) {
-  return fgets(s, size, (FILE *)d);
+  return fgets(s, size, static_cast<FILE *>(d));
 }
 
-struct ical_event *add_event(struct ical_event *listend,
-                             icalcomponent *new_ev) {
-  struct ical_event *ev_new, *ev_cur;
-  icaltimetype start;
+/* Keeps the events of one file ordered by their next occurrence. The file is
+ * parsed again only when its mtime or size changes; otherwise an update only
+ * looks at the soonest event, and a recurring event is stepped past the
+ * instances that expired since the last update. */
+class ical_cb : public conky::callback<ical_summaries, std::string> {
+  typedef conky::callback<ical_summaries, std::string> Base;
+
+  icalcomponent *comps = nullptr;
+  /* sorted by starts_later, so the soonest event is at the back */
+  std::vector<ical_event> upcoming;
+  struct timespec mtime {};
+  off_t size = -1;
+  bool reported = false;
+
+  void clear() {
+    for (ical_event &ev : upcoming) {
+      if (ev.recur != nullptr) { icalrecur_iterator_free(ev.recur); }
+    }
+    upcoming.clear();
+    if (comps != nullptr) { icalcomponent_free(comps); }
+    comps = nullptr;
+  }
+
+  bool reload(const icaltimetype &now);
+  bool expire(const icaltimetype &now);
+  void publish();
+
+ protected:
+  virtual void work();
 
-  start = icalcomponent_get_dtstart(new_ev);
-  if (icaltime_compare(
-          start, icaltime_from_timet_with_zone(time(nullptr), 0, NULL)) <= 0) {
+ public:
+  ical_cb(uint32_t period, const std::string &file)
+      : Base(period, false, Base::Tuple(file)) {}
+  ~ical_cb() { clear(); }
+};
+
+/* Returns true if the events were replaced. */
+bool ical_cb::reload(const icaltimetype &now) {
+  const std::string &file = get<0>();
+  struct stat st {};
+
+  if (stat(file.c_str(), &st) != 0) {
+    if (!reported) { LOG_WARNING("can't read file '{}'", file); }
+    reported = true;
+    return false;
+  }
+  if (size == st.st_size && mtime.tv_sec == st.st_mtim.tv_sec &&
+      mtime.tv_nsec == st.st_mtim.tv_nsec) {
+    return false;
+  }
+
+  FILE *fp = fopen(file.c_str(), "re");
+  if (fp == nullptr) {
+    if (!reported) { LOG_WARNING("can't read file '{}'", file); }
+    reported = true;
+    return false;
+  }
+  icalparser *parser = icalparser_new();
+  icalparser_set_gen_data(parser, fp);
+  icalcomponent *allc = icalparser_parse(parser, read_stream);
+  icalparser_free(parser);
+  fclose(fp);
+
+  clear();
+  comps = allc;
+  mtime = st.st_mtim;
+  size = st.st_size;
+  reported = false;
+
+  if (comps == nullptr) {
+    LOG_WARNING("no ical events available");
+    return true;
+  }
+  for (icalcomponent *c =
+           icalcomponent_get_first_component(comps, ICAL_VEVENT_COMPONENT);
+       c != nullptr;
+       c = icalcomponent_get_next_component(comps, ICAL_VEVENT_COMPONENT)) {
+    ical_event ev{icalcomponent_get_dtstart(c), c, nullptr};
     icalproperty *rrule =
-        icalcomponent_get_first_property(new_ev, ICAL_RRULE_PROPERTY);
-    if (rrule) {
-      icalrecur_iterator *ritr =
-          icalrecur_iterator_new(icalproperty_get_rrule(rrule), start);
-      icaltimetype nexttime = icalrecur_iterator_next(ritr);
-      while (!icaltime_is_null_time(nexttime)) {
-        if (icaltime_compare(nexttime, icaltime_from_timet_with_zone(
-                                           time(nullptr), 0, NULL)) > 0) {
-          start = nexttime;
-          break;
-        }
-        nexttime = icalrecur_iterator_next(ritr);
+        icalcomponent_get_first_property(c, ICAL_RRULE_PROPERTY);
+
+    if (rrule != nullptr) {
+      struct icalrecurrencetype rule = icalproperty_get_rrule(rrule);
+
+      ev.recur = icalrecur_iterator_new(rule, ev.start);
+#if ICAL_MAJOR_VERSION >= 3
+      /* jump close to now instead of stepping from DTSTART; libical refuses
+       * this for rules with a COUNT, which are bounded anyway */
+      if (ev.recur != nullptr && rule.count == 0 &&
+          icaltime_compare(ev.start, now) <= 0) {
+        icalrecur_iterator_set_start(ev.recur, now);
       }
-      icalrecur_iterator_free(ritr);
-    } else
-      return nullptr;
+#endif
+    }
+    upcoming.push_back(ev);
   }
-  ev_new = (struct ical_event *)malloc(sizeof(struct ical_event));
-  memset(ev_new, 0, sizeof(struct ical_event));
-  ev_new->event = new_ev;
-  ev_new->start = start;
-  if (listend) {  // list already contains events
-    ev_cur = listend;
-    while (icaltime_compare(ev_new->start, ev_cur->start) <= 0) {
-      if (!ev_cur->prev) {  // ev_new starts first
-        ev_new->next = ev_cur;
-        ev_cur->prev = ev_new;
-        return listend;
-      }
-      ev_cur = ev_cur->prev;
+  if (upcoming.empty()) { LOG_WARNING("no ical events available"); }
+  std::sort(upcoming.begin(), upcoming.end(), starts_later);
+  return true;
+}
+
+/* Drops the events that started by now, moving recurring ones to their next
+ * occurrence. Returns true if the order changed. */
+bool ical_cb::expire(const icaltimetype &now) {
+  bool changed = false;
+
+  while (!upcoming.empty() &&
+         icaltime_compare(upcoming.back().start, now) <= 0) {
+    ical_event ev = upcoming.back();
+    upcoming.pop_back();
+    changed = true;
+
+    icaltimetype next = icaltime_null_time();
+    if (ev.recur != nullptr) {
+      do {
+        next = icalrecur_iterator_next(ev.recur);
+      } while (!icaltime_is_null_time(next) &&
+               icaltime_compare(next, now) <= 0);
     }
-    if (ev_cur == listend) {  // ev_new starts last
-      ev_cur->next = ev_new;
-      ev_new->prev = ev_cur;
-      return ev_new;
+    if (icaltime_is_null_time(next)) {
+      if (ev.recur != nullptr) { icalrecur_iterator_free(ev.recur); }
+      continue;
     }
-    // ev_new somewhere in the middle
-    ev_new->prev = ev_cur;
-    ev_new->next = ev_cur->next;
-    ev_cur->next->prev = ev_new;
-    ev_cur->next = ev_new;
-    return listend;
+    ev.start = next;
+    upcoming.insert(std::upper_bound(upcoming.begin(), upcoming.end(), ev,
+                                     starts_later),
+                    ev);
   }
-  return ev_new;
+  return changed;
+}
+
+void ical_cb::publish() {
+  auto summaries = std::make_shared<std::vector<std::string>>();
+
+  summaries->reserve(upcoming.size());
+  for (auto ev = upcoming.rbegin(); ev != upcoming.rend(); ++ev) {
+    const char *summary = icalcomponent_get_summary(ev->event);
+    summaries->emplace_back(summary != nullptr ? summary : "");
+  }
+
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result = std::move(summaries);
+}
+
+void ical_cb::work() {
+  icaltimetype now = icaltime_from_timet_with_zone(time(nullptr), 0, nullptr);
+  bool reloaded = reload(now);
+
+  if (expire(now) || reloaded) { publish(); }
 }
 
+struct obj_ical {
+  conky::callback_handle<ical_cb> cb;
+  unsigned int num;
+};
+}  // namespace
+
 void parse_ical_args(struct text_object *obj, const char *arg,
                      void *free_at_crash, void *free_at_crash2) {
-  char *filename = strdup(arg);
-  FILE *file;
-  icalparser *parser;
-  icalcomponent *allc, *curc;
-  struct ical_event *ll_start, *ll_end, *ll_new;
-  struct obj_ical *opaque;
+  std::vector<char> filename(strlen(arg) + 1);
   unsigned int num;
 
-  if (sscanf(arg, "%d %s", &num, filename) != 2) {
-    free(filename);
+  if (sscanf(arg, "%u %s", &num, filename.data()) != 2) {
     COMMAND_ARG_ERR("ical", "wrong number of arguments for $ical");
   }
-  file = fopen(filename, "r");
-  if (!file) {
-    SYSTEM_ERR("can't read file '{}'", filename);
-    free(filename);
-    return;
-  }
-  free(filename);
-  parser = icalparser_new();
-  icalparser_set_gen_data(parser, file);
-  allc = icalparser_parse(parser, read_stream);
-  fclose(file);
-  curc = icalcomponent_get_first_component(allc, ICAL_VEVENT_COMPONENT);
-  if (!curc) {
-    icalparser_free(parser);
-    icalcomponent_free(allc);
-    LOG_WARNING("no ical events available");
-    return;
+  if (access(filename.data(), R_OK) != 0) {
+    SYSTEM_ERR("can't read file '{}'", filename.data());
   }
-  ll_start = add_event(nullptr, curc);
-  ll_end = ll_start;
-  while (1) {
-    curc = icalcomponent_get_next_component(allc, ICAL_VEVENT_COMPONENT);
-    if (!curc) break;
-    ll_new = add_event(ll_end, curc);
-    if (!ll_start) {  // first component was not added
-      ll_start = ll_new;
-      ll_end = ll_new;
-    } else if (ll_start->prev) {
-      ll_start = ll_start->prev;
-    } else if (ll_end->next) {
-      ll_end = ll_end->next;
-    }
-  }
-  opaque = (struct obj_ical *)malloc(sizeof(struct obj_ical));
-  opaque->list = ll_start;
-  opaque->parser = parser;
-  opaque->comps = allc;
-  opaque->num = num;
-  obj->data.opaque = opaque;
-  free(opaque);
+  obj->data.opaque = new obj_ical{
+      conky::register_cb<ical_cb>(1, std::string(filename.data())), num};
 }
 
 void print_ical(struct text_object *obj, char *p, unsigned int p_max_size) {
-  struct obj_ical *ical_obj = (struct obj_ical *)obj->data.opaque;
-  struct ical_event *ll_current;
-
-  if (!ical_obj) return;
-  ll_current = ical_obj->list;
-  unsigned int i = 1;
-  while (1) {
-    if (!ll_current) return;
-    if (i > ical_obj->num) return;
-    if (i == ical_obj->num) break;
-    if (i < ical_obj->num) {
-      ll_current = ll_current->next;
-      i++;
-    }
-  }
-  snprintf(p, p_max_size, "%s",
-           icalproperty_get_summary(icalcomponent_get_first_property(
-               ll_current->event, ICAL_SUMMARY_PROPERTY)));
+  auto *ical = static_cast<obj_ical *>(obj->data.opaque);
+
+  if (ical == nullptr) { return; }
+  ical_summaries events = ical->cb->get_result_copy();
+  if (!events || ical->num == 0 || ical->num > events->size()) { return; }
+  snprintf(p, p_max_size, "%s", (*events)[ical->num - 1].c_str());
 }
 
 void free_ical(struct text_object *obj) {
-  struct obj_ical *ical_free_me = (struct obj_ical *)obj->data.opaque;
-
-  if (!ical_free_me) return;
-  icalcomponent_free(ical_free_me->comps);
-  icalparser_free(ical_free_me->parser);
-  while (ical_free_me->list) {
-    if (ical_free_me->list->next) {
-      ical_free_me->list = ical_free_me->list->next;
-      free_and_zero(ical_free_me->list->prev);
-    } else
-      free_and_zero(ical_free_me->list);
-  }
-  free(obj->data.opaque);
+  delete static_cast<obj_ical *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
 }
@@ -23,8 +23,14 @@
  */
 
 #include "ccurl_thread.h"
+#include <algorithm>
 #include <cmath>
+#include <strings.h>
+#include <condition_variable>
+#include <functional>
 #include <mutex>
+#include <thread>
+#include <vector>
 #include "../../conky.h"
 #include "../../content/text_object.h"
 #include "../../logging.h"
@@ -40,8 +46,184 @@
  * create any curl-based object (see rss).  Below is an
  * implementation of a curl-only object ($curl) which can also be used as an
  * example.
+ *
+ * The update callbacks of these objects don't get threads of their own:
+ * their work() queues a transfer on a single thread driving a shared multi
+ * handle, which also runs process_data() when the transfer is over.
  */
 
+namespace {
+/*
+ * Owns the multi handle and the thread running it. Transfers are queued by
+ * submit() and added to the multi handle by the transfer thread, which is the
+ * only one touching it; curl_multi_wakeup() interrupts its poll.
+ */
+class curl_engine {
+  typedef priv::curl_internal transfer;
+
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::vector<transfer *> pending;
+  std::vector<transfer *> active;
+  std::vector<transfer *> cancelled;
+  transfer *completing;
+  std::thread thread;
+  bool stopping;
+
+  CURLM *multi;
+  CURLSH *share;
+  std::mutex share_locks[CURL_LOCK_DATA_LAST];
+
+  static void lock_share(CURL *, curl_lock_data data, curl_lock_access,
+                         void *userptr) {
+    static_cast<curl_engine *>(userptr)->share_locks[data].lock();
+  }
+  static void unlock_share(CURL *, curl_lock_data data, void *userptr) {
+    static_cast<curl_engine *>(userptr)->share_locks[data].unlock();
+  }
+
+  static bool erase(std::vector<transfer *> &list, transfer *t) {
+    auto it = std::find(list.begin(), list.end(), t);
+    if (it == list.end()) { return false; }
+    list.erase(it);
+    return true;
+  }
+
+  bool queued(transfer *t) {
+    return completing == t ||
+           std::find(pending.begin(), pending.end(), t) != pending.end() ||
+           std::find(active.begin(), active.end(), t) != active.end();
+  }
+
+  void run() {
+    conky::log::set_thread_name("curl");
+    std::vector<std::pair<transfer *, CURLcode>> done;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!stopping) {
+      for (transfer *t : cancelled) {
+        if (erase(active, t)) { curl_multi_remove_handle(multi, t->curl); }
+      }
+      if (!cancelled.empty()) { finished.notify_all(); }
+      cancelled.clear();
+
+      for (transfer *t : pending) {
+        CURLMcode res = curl_multi_add_handle(multi, t->curl);
+        if (res != CURLM_OK) {
+          LOG_ERROR("curl: can't start transfer: {}",
+                    curl_multi_strerror(res));
+          done.emplace_back(t, CURLE_FAILED_INIT);
+        } else {
+          active.push_back(t);
+        }
+      }
+      pending.clear();
+      lock.unlock();
+
+      int running = 0;
+      curl_multi_perform(multi, &running);
+      int queued = 0;
+      while (CURLMsg *msg = curl_multi_info_read(multi, &queued)) {
+        if (msg->msg != CURLMSG_DONE) { continue; }
+        char *t = nullptr;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &t);
+        done.emplace_back(reinterpret_cast<transfer *>(t), msg->data.result);
+      }
+      for (auto &d : done) { curl_multi_remove_handle(multi, d.first->curl); }
+
+      lock.lock();
+      for (auto &d : done) {
+        erase(active, d.first);
+        if (std::find(cancelled.begin(), cancelled.end(), d.first) !=
+            cancelled.end()) {
+          continue;
+        }
+        completing = d.first;
+        lock.unlock();
+        d.first->finish_transfer(d.second);
+        lock.lock();
+        completing = nullptr;
+      }
+      if (!done.empty()) { finished.notify_all(); }
+      done.clear();
+      if (stopping || !pending.empty() || !cancelled.empty()) { continue; }
+
+      lock.unlock();
+      curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+      lock.lock();
+    }
+
+    for (transfer *t : active) {
+      curl_multi_remove_handle(multi, t->curl);
+      t->busy = false;
+    }
+    for (transfer *t : pending) { t->busy = false; }
+    active.clear();
+    pending.clear();
+    cancelled.clear();
+    finished.notify_all();
+  }
+
+ public:
+  curl_engine()
+      : completing(nullptr),
+        stopping(false),
+        multi(curl_multi_init()),
+        share(curl_share_init()) {
+    if (multi == nullptr || share == nullptr) {
+      SYSTEM_ERR("failed to initialize curl transfer engine");
+    }
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock_share);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock_share);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  }
+
+  // never destroyed: easy handles owned by callbacks may outlive main() and
+  // still refer to the share handle
+  static curl_engine &get() {
+    static auto *engine = new curl_engine;
+    return *engine;
+  }
+
+  void attach(CURL *curl) { curl_easy_setopt(curl, CURLOPT_SHARE, share); }
+
+  bool submit(transfer *t) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping) { return false; }
+    if (!thread.joinable()) { thread = std::thread(&curl_engine::run, this); }
+    pending.push_back(t);
+    curl_multi_wakeup(multi);
+    return true;
+  }
+
+  void wait(transfer *t) {
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this, t] { return !queued(t); });
+  }
+
+  void cancel(transfer *t) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (erase(pending, t) || !queued(t)) { return; }
+    cancelled.push_back(t);
+    curl_multi_wakeup(multi);
+    finished.wait(lock, [this, t] { return !queued(t); });
+  }
+
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+      curl_multi_wakeup(multi);
+    }
+    if (thread.joinable()) { thread.join(); }
+  }
+};
+}  // namespace
+
+void ccurl_engine_shutdown() { curl_engine::get().shutdown(); }
+
 namespace priv {
 /* callback used by curl for parsing the header data */
 size_t curl_internal::parse_header_cb(void *ptr, size_t size, size_t nmemb,
@@ -50,14 +232,17 @@ size_t curl_internal::parse_header_cb(void *ptr, size_t size, size_t nmemb,
   const char *value = static_cast<const char *>(ptr);
   size_t realsize = size * nmemb;
 
-  if (realsize > 0 &&
-      (value[realsize - 1] == '\r' || value[realsize - 1] == 0)) {
+  // header lines end in "\r\n", which must not end up in the validators
+  while (realsize > 0 &&
+         (value[realsize - 1] == '\r' || value[realsize - 1] == '\n' ||
+          value[realsize - 1] == 0)) {
     --realsize;
   }
 
-  if (strncmp(value, "Last-Modified: ", 15) == EQUAL) {
+  // header names are case-insensitive and always lowercase with HTTP/2
+  if (realsize >= 15 && strncasecmp(value, "Last-Modified: ", 15) == EQUAL) {
     obj->last_modified = std::string(value + 15, realsize - 15);
-  } else if (strncmp(value, "ETag: ", 6) == EQUAL) {
+  } else if (realsize >= 6 && strncasecmp(value, "ETag: ", 6) == EQUAL) {
     obj->etag = std::string(value + 6, realsize - 6);
   }
 
@@ -76,9 +261,16 @@ size_t curl_internal::write_cb(void *ptr, size_t size, size_t nmemb,
   return realsize;
 }
 
-curl_internal::curl_internal(const std::string &url) : curl(curl_easy_init()) {
+curl_internal::curl_internal(const std::string &url)
+    : curl(curl_easy_init()),
+      request_headers(nullptr),
+      data_hash(0),
+      have_data(false),
+      busy(false) {
   if (!curl) { SYSTEM_ERR("failed to initialize curl session"); }
 
+  curl_engine::get().attach(curl);
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, this);
   curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1);
   curl_easy_setopt(curl, CURLOPT_HEADERDATA, this);
   curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, parse_header_cb);
@@ -107,41 +299,67 @@ curl_internal::curl_internal(const std::string &url) : curl(curl_easy_init()) {
   curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
 }
 
-/* fetch our datums */
-void curl_internal::do_work() {
-  CURLcode res;
-  struct headers_ {
-    struct curl_slist *h;
+curl_internal::~curl_internal() {
+  cancel_transfer();
+  if (curl) curl_easy_cleanup(curl);
+  curl_slist_free_all(request_headers);
+}
 
-    headers_() : h(nullptr) {}
-    ~headers_() { curl_slist_free_all(h); }
-  } headers;
+/* fetch our datums */
+void curl_internal::start_transfer() {
+  if (busy.exchange(true)) {
+    LOG_DEBUG("curl: previous transfer still running");
+    return;
+  }
 
   data.clear();
-
-  if (!last_modified.empty()) {
-    headers.h = curl_slist_append(
-        headers.h, ("If-Modified-Since: " + last_modified).c_str());
-    last_modified.clear();
+  curl_slist_free_all(request_headers);
+  request_headers = nullptr;
+
+  // the validators are only resent when the response carries new ones, a 304
+  // doesn't have to repeat them
+  sent_last_modified.clear();
+  sent_etag.clear();
+  sent_last_modified.swap(last_modified);
+  sent_etag.swap(etag);
+  if (!sent_last_modified.empty()) {
+    request_headers = curl_slist_append(
+        request_headers, ("If-Modified-Since: " + sent_last_modified).c_str());
+  }
+  if (!sent_etag.empty()) {
+    request_headers = curl_slist_append(
+        request_headers, ("If-None-Match: " + sent_etag).c_str());
   }
-  if (!etag.empty()) {
-    headers.h =
-        curl_slist_append(headers.h, ("If-None-Match: " + etag).c_str());
-    etag.clear();
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request_headers);
+
+  if (!curl_engine::get().submit(this)) {
+    last_modified.swap(sent_last_modified);
+    etag.swap(sent_etag);
+    busy = false;
   }
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers.h);
+}
 
-  res = curl_easy_perform(curl);
+void curl_internal::finish_transfer(CURLcode res) {
   if (res == CURLE_OK) {
     long http_status_code;
 
     if (curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_status_code) ==
         CURLE_OK) {
       switch (http_status_code) {
-        case 200:
+        case 200: {
+          std::size_t hash = std::hash<std::string>()(data);
+          if (have_data && hash == data_hash) {
+            LOG_DEBUG("curl: data unchanged, not processing it again");
+            break;
+          }
           process_data();
+          data_hash = hash;
+          have_data = true;
           break;
+        }
         case 304:
+          if (last_modified.empty()) { last_modified.swap(sent_last_modified); }
+          if (etag.empty()) { etag.swap(sent_etag); }
           break;
         default:
           LOG_ERROR("curl: no data from server, got HTTP status {}",
@@ -154,6 +372,17 @@ void curl_internal::do_work() {
   } else {
     LOG_ERROR("curl request failed: {}", curl_easy_strerror(res));
   }
+  busy = false;
+}
+
+void curl_internal::cancel_transfer() {
+  if (busy) { curl_engine::get().cancel(this); }
+  busy = false;
+}
+
+void curl_internal::do_work() {
+  start_transfer();
+  curl_engine::get().wait(this);
 }
 }  // namespace priv
 
@@ -30,6 +30,10 @@
 #include "../../logging.h"
 #include "../../update-cb.hh"
 
+#include <atomic>
+#include <cstddef>
+#include <string>
+
 namespace priv {
 // factored out stuff that does not depend on the template parameters
 class curl_internal {
@@ -38,21 +42,38 @@ class curl_internal {
   std::string etag;
   std::string data;
   CURL *curl;
+  // request headers and validators of the transfer in progress
+  struct curl_slist *request_headers;
+  std::string sent_last_modified;
+  std::string sent_etag;
+  // hash of the last body handed to process_data(), used to skip parsing
+  // when a server ignores the conditional request and resends the same data
+  std::size_t data_hash;
+  bool have_data;
+  // set from start_transfer() until finish_transfer() returns
+  std::atomic<bool> busy;
 
   static size_t parse_header_cb(void *ptr, size_t size, size_t nmemb,
                                 void *data);
   static size_t write_cb(void *ptr, size_t size, size_t nmemb, void *data);
 
+  // queues a transfer of the uri and returns; does nothing while the
+  // previous one is still running
+  void start_transfer();
+  // called on the transfer thread once the transfer is over
+  void finish_transfer(CURLcode res);
+  // drops a queued or running transfer, waiting for finish_transfer() if it
+  // is being called
+  void cancel_transfer();
+  // start_transfer() and wait for it to finish
   void do_work();
 
-  // called by do_work() after downloading data from the uri
+  // called on the transfer thread after downloading data from the uri
   // it should populate the result variable
   virtual void process_data() = 0;
 
   explicit curl_internal(const std::string &url);
-  virtual ~curl_internal() {
-    if (curl) curl_easy_cleanup(curl);
-  }
+  virtual ~curl_internal();
 };
 }  // namespace priv
 
@@ -67,9 +88,13 @@ class curl_callback : public conky::callback<Result, std::string, Keys...>,
   typedef priv::curl_internal Base2;
 
  protected:
+  // work() only queues the transfer, the transfer thread does the rest
+  virtual bool needs_thread() const { return false; }
+  virtual void cancel() { cancel_transfer(); }
+
   virtual void work() {
     LOG_DEBUG("reading curl data from '{}'", std::get<0>(Base1::tuple).c_str());
-    do_work();
+    start_transfer();
   }
 
  public:
@@ -77,6 +102,15 @@ class curl_callback : public conky::callback<Result, std::string, Keys...>,
       : Base1(period, false, tuple), Base2(std::get<0>(tuple)) {}
 };
 
+/*
+ * All transfers go through one multi handle driven by a single event thread,
+ * so connections, DNS lookups and TLS sessions are reused between urls and
+ * no thread is parked per url.
+ */
+
+/* stops the transfer thread, pending transfers are dropped */
+void ccurl_engine_shutdown();
+
 /* $curl exports begin */
 
 /* runs instance of $curl */
@@ -27,8 +27,21 @@
 
 #include "libtcp-portmon.h"
 
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
 #include <cstdio>
 #include <cstring>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 #include "../../logging.h"
@@ -147,12 +160,75 @@ struct _tcp_port_monitor_t {
   const _tcp_port_monitor_t &operator=(const _tcp_port_monitor_t &);
 };
 
+namespace {
+/* ---------------------------------------------------------------------
+ * A run of local ports [first, next segment's first) and the monitors
+ * whose ranges cover it
+ * --------------------------------------------------------------------- */
+struct port_segment {
+  uint32_t first;
+  std::vector<tcp_port_monitor_t *> monitors;
+};
+}  // namespace
+
 /* -----------------------------
  * A tcp port monitor collection
  * ----------------------------- */
 struct _tcp_port_monitor_collection_t {
   /* hash table of monitors */
   monitor_hash_t hash;
+  /* the monitors by port, sorted by segment start, so a connection finds
+   * its monitors in O(log n) */
+  std::vector<port_segment> index;
+  /* where connections are read from */
+  enum tcp_port_monitor_source source = TCP_SOURCE_AUTO;
+  /* sock_diag socket, -1 until opened */
+  int diag_fd = -1;
+  /* sock_diag turned out to be unusable, stick to /proc */
+  bool diag_failed = false;
+
+  _tcp_port_monitor_collection_t() = default;
+  ~_tcp_port_monitor_collection_t() {
+    if (diag_fd >= 0) { close(diag_fd); }
+  }
+
+  /* rebuilds index after the monitors changed */
+  void rebuild_index() {
+    std::vector<uint32_t> bounds;
+
+    for (auto &monitor : hash) {
+      bounds.push_back(monitor.first.first);
+      bounds.push_back(uint32_t(monitor.first.second) + 1);
+    }
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    index.clear();
+    for (uint32_t first : bounds) {
+      port_segment segment{first, {}};
+      for (auto &monitor : hash) {
+        if (monitor.first.first <= first && first <= monitor.first.second) {
+          segment.monitors.push_back(&monitor.second);
+        }
+      }
+      index.push_back(std::move(segment));
+    }
+  }
+
+  /* the monitors interested in connections on the local port */
+  const std::vector<tcp_port_monitor_t *> *monitors_for(in_port_t port) const {
+    auto i = std::upper_bound(
+        index.begin(), index.end(), uint32_t(port),
+        [](uint32_t p, const port_segment &s) { return p < s.first; });
+    if (i == index.begin()) { return nullptr; }
+    --i;
+    return i->monitors.empty() ? nullptr : &i->monitors;
+  }
+
+ private:
+  _tcp_port_monitor_collection_t(const _tcp_port_monitor_collection_t &);
+  const _tcp_port_monitor_collection_t &operator=(
+      const _tcp_port_monitor_collection_t &);
 };
 
 namespace {
@@ -192,46 +268,40 @@ void rebuild_tcp_port_monitor_peek_table(monitor_hash_t::value_type &monitor,
   monitor.second.rebuild_peek_table();
 }
 
-void show_connection_to_tcp_port_monitor(monitor_hash_t::value_type &monitor,
-                                         void *p_void) {
-  /* The monitor gets to look at each connection to see if it falls within
-   * the monitor's port range of interest.  Connections of interest are first
-   * looked up in the hash to see if they are already there.  If they are, we
-   * reset the age of the connection so it is not deleted.  If the connection
-   * is not in the hash, we add it, but only if we haven't exceeded the
-   * maximum connection limit for the monitor.
+void show_connection_to_tcp_port_monitor(tcp_port_monitor_t &monitor,
+                                         const tcp_connection_t &connection) {
+  /* The monitor gets to look at a connection within its port range of
+   * interest.  The connection is first looked up in the hash to see if it's
+   * already there.  If it is, we reset the age of the connection so it is
+   * not deleted.  If the connection is not in the hash, we add it, but only
+   * if we haven't exceeded the maximum connection limit for the monitor.
    * The function takes O(1) time. */
 
-  tcp_connection_t *p_connection;
+  /* first check the hash to see if the connection is already there. */
+  connection_hash_t::iterator i = monitor.hash.find(connection);
+  if (i != monitor.hash.end()) {
+    /* it's already in the hash.  reset the age of the connection. */
+    i->second = TCP_CONNECTION_STARTING_AGE;
 
-  if (!p_void) { return; }
-
-  /* This p_connection is on caller's stack and not the heap.
-   * If we are interested, we will create a copy of the connection
-   * (on the heap) and add it to our list. */
-  p_connection = (tcp_connection_t *)p_void;
-
-  /* inspect the local port number of the connection to see if we're
-   * interested. */
-  if ((monitor.first.first <= p_connection->local_port) &&
-      (p_connection->local_port <= monitor.first.second)) {
-    /* the connection is in the range of the monitor. */
+    return;
+  }
 
-    /* first check the hash to see if the connection is already there. */
-    connection_hash_t::iterator i = monitor.second.hash.find(*p_connection);
-    if (i != monitor.second.hash.end()) {
-      /* it's already in the hash.  reset the age of the connection. */
-      i->second = TCP_CONNECTION_STARTING_AGE;
+  /* Connection is not yet in the hash.
+   * Add it if max_connections not exceeded. */
+  if (monitor.hash.size() < monitor.p_peek.size()) {
+    monitor.hash.insert(
+        connection_hash_t::value_type(connection, TCP_CONNECTION_STARTING_AGE));
+  }
+}
 
-      return;
-    }
+/* shows the connection to each port monitor whose range has its local port */
+void show_connection_to_collection(tcp_port_monitor_collection_t *p_collection,
+                                   const tcp_connection_t &connection) {
+  auto monitors = p_collection->monitors_for(connection.local_port);
+  if (!monitors) { return; }
 
-    /* Connection is not yet in the hash.
-     * Add it if max_connections not exceeded. */
-    if (monitor.second.hash.size() < monitor.second.p_peek.size()) {
-      monitor.second.hash.insert(connection_hash_t::value_type(
-          *p_connection, TCP_CONNECTION_STARTING_AGE));
-    }
+  for (auto monitor : *monitors) {
+    show_connection_to_tcp_port_monitor(*monitor, connection);
   }
 }
 
@@ -266,27 +336,198 @@ bool is_4on6(const struct in6_addr *addr) {
   return !std::memcmp(&addr->s6_addr, prefix_4on6, sizeof(prefix_4on6));
 }
 
+/* fills sa with the address, returns its length */
+socklen_t to_sockaddr(union sockaddr_in46 *sa, const struct in6_addr *addr) {
+  std::memset(sa, 0, sizeof(*sa));
+
+  if (is_4on6(addr)) {
+    sa->sa4.sin_family = AF_INET;
+    std::memcpy(&sa->sa4.sin_addr.s_addr, &addr->s6_addr[12], 4);
+    return sizeof(sa->sa4);
+  }
+  sa->sa6.sin6_family = AF_INET6;
+  std::memcpy(&sa->sa6.sin6_addr, addr, sizeof(struct in6_addr));
+  return sizeof(sa->sa6);
+}
+
+/* ------------------------------------------------------------------------
+ * A cache of host names
+ *
+ * Names are looked up one at a time by a background thread, so a slow
+ * resolver never holds up drawing.  A name is kept for HOST_CACHE_TTL
+ * seconds and an address without one for HOST_CACHE_NEGATIVE_TTL seconds.
+ * At most HOST_LOOKUPS_QUEUED addresses wait for a lookup; others are
+ * queued on a later print once there is room.
+ * ------------------------------------------------------------------------ */
+#define HOST_CACHE_TTL 600
+#define HOST_CACHE_NEGATIVE_TTL 60
+#define HOST_CACHE_MAX_ENTRIES 1024
+#define HOST_LOOKUPS_QUEUED 32
+
+class getnameinfo_resolver : public tcp_host_resolver {
+ public:
+  std::string resolve(const struct sockaddr *sa, socklen_t len) override {
+    char host[NI_MAXHOST];
+
+    if (getnameinfo(sa, len, host, sizeof(host), nullptr, 0, NI_NAMEREQD)) {
+      return std::string();
+    }
+    return host;
+  }
+};
+
+struct in6_addr_hash {
+  size_t operator()(const struct in6_addr &a) const {
+    size_t hash = 0;
+
+    for (size_t i = 0; i < sizeof(a.s6_addr); ++i)
+      hash = hash * 47 + a.s6_addr[i];
+
+    return hash;
+  }
+};
+
+struct in6_addr_equal {
+  bool operator()(const struct in6_addr &a, const struct in6_addr &b) const {
+    return !std::memcmp(&a, &b, sizeof(a));
+  }
+};
+
+struct host_cache_entry {
+  /* empty while unknown or when the address has no name */
+  std::string name;
+  /* when to look the address up again */
+  std::time_t expires;
+  /* queued or being looked up */
+  bool pending;
+};
+
+class host_cache {
+ public:
+  host_cache() : resolver(std::make_shared<getnameinfo_resolver>()) {}
+
+  /* copies the cached name of addr into name and returns true if there is
+   * one; queues a lookup if it's missing or out of date */
+  bool lookup(const struct in6_addr &addr, std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::time_t now = std::time(nullptr);
+
+    auto i = entries.find(addr);
+    if (i == entries.end()) {
+      if (entries.size() >= HOST_CACHE_MAX_ENTRIES) { prune(now); }
+      if (entries.size() >= HOST_CACHE_MAX_ENTRIES) { return false; }
+      i = entries.emplace(addr, host_cache_entry{std::string(), 0, false})
+              .first;
+    }
+
+    /* an expired name is still printed until the new one arrives */
+    if (!i->second.pending && i->second.expires <= now &&
+        queue.size() < HOST_LOOKUPS_QUEUED) {
+      i->second.pending = true;
+      queue.push_back(addr);
+      start();
+      wakeup.notify_one();
+    }
+
+    if (i->second.name.empty()) { return false; }
+    name = i->second.name;
+    return true;
+  }
+
+  void set_resolver(std::shared_ptr<tcp_host_resolver> new_resolver) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!new_resolver) {
+      new_resolver = std::make_shared<getnameinfo_resolver>();
+    }
+    resolver = std::move(new_resolver);
+    entries.clear();
+    queue.clear();
+    /* lookups already running belong to the old resolver */
+    ++generation;
+  }
+
+ private:
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  std::unordered_map<struct in6_addr, host_cache_entry, in6_addr_hash,
+                     in6_addr_equal>
+      entries;
+  std::deque<struct in6_addr> queue;
+  std::shared_ptr<tcp_host_resolver> resolver;
+  unsigned long generation = 0;
+  bool started = false;
+
+  /* drops the entries that have expired and aren't being looked up */
+  void prune(std::time_t now) {
+    for (auto i = entries.begin(); i != entries.end();) {
+      if (!i->second.pending && i->second.expires <= now)
+        i = entries.erase(i);
+      else
+        ++i;
+    }
+  }
+
+  void start() {
+    if (started) { return; }
+    started = true;
+    /* the cache is never destroyed, so the thread can simply be left
+     * behind when conky exits, even in the middle of a slow lookup */
+    std::thread(&host_cache::run, this).detach();
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (;;) {
+      wakeup.wait(lock, [this] { return !queue.empty(); });
+
+      struct in6_addr addr = queue.front();
+      queue.pop_front();
+      std::shared_ptr<tcp_host_resolver> current = resolver;
+      unsigned long lookup_generation = generation;
+      lock.unlock();
+
+      union sockaddr_in46 sa;
+      socklen_t slen = to_sockaddr(&sa, &addr);
+      std::string name = current->resolve(&sa.sa, slen);
+
+      lock.lock();
+      if (lookup_generation != generation) { continue; }
+      auto i = entries.find(addr);
+      if (i == entries.end()) { continue; }
+      i->second.name = name;
+      i->second.expires =
+          std::time(nullptr) +
+          (name.empty() ? HOST_CACHE_NEGATIVE_TTL : HOST_CACHE_TTL);
+      i->second.pending = false;
+    }
+  }
+};
+
+host_cache &get_host_cache() {
+  static host_cache *cache = new host_cache();
+  return *cache;
+}
+
 /* converts the address to appropriate textual representation (IPv6, IPv4 or
  * fqdn) */
 void print_host(char *p_buffer, size_t buffer_size, const struct in6_addr *addr,
                 int fqdn) {
-  union sockaddr_in46 sa;
-  socklen_t slen;
+  if (fqdn) {
+    std::string name;
 
-  std::memset(&sa, 0, sizeof(sa));
-
-  if (is_4on6(addr)) {
-    sa.sa4.sin_family = AF_INET;
-    std::memcpy(&sa.sa4.sin_addr.s_addr, &addr->s6_addr[12], 4);
-    slen = sizeof(sa.sa4);
-  } else {
-    sa.sa6.sin6_family = AF_INET6;
-    std::memcpy(&sa.sa6.sin6_addr, addr, sizeof(struct in6_addr));
-    slen = sizeof(sa.sa6);
+    if (get_host_cache().lookup(*addr, name)) {
+      std::snprintf(p_buffer, buffer_size, "%s", name.c_str());
+      return;
+    }
   }
 
+  union sockaddr_in46 sa;
+  socklen_t slen = to_sockaddr(&sa, addr);
+
   getnameinfo(&sa.sa, slen, p_buffer, buffer_size, nullptr, 0,
-              fqdn ? 0 : NI_NUMERICHOST);
+              NI_NUMERICHOST);
 }
 
 /* converts the textual representation of an IPv4 or IPv6 address to struct
@@ -338,16 +579,201 @@ void process_file(tcp_port_monitor_collection_t *p_collection,
     // if ((inode == 0) || (state != TCP_ESTABLISHED)) {
     if ((inode == 0) || (state != 1)) { continue; }
 
+    /* only the port monitors care about, skip the address conversion for
+     * everything else */
+    if (!p_collection->monitors_for(conn.local_port)) { continue; }
+
     string_to_addr(&conn.local_addr, local_addr);
     string_to_addr(&conn.remote_addr, remote_addr);
 
-    /* show the connection to each port monitor. */
-    for_each_tcp_port_monitor_in_collection(
-        p_collection, &show_connection_to_tcp_port_monitor, (void *)&conn);
+    show_connection_to_collection(p_collection, conn);
   }
 
   std::fclose(fp);
 }
+
+/* -------------------------------------------------------------------------
+ * sock_diag
+ *
+ * The kernel is asked over NETLINK_SOCK_DIAG for established connections
+ * only and, with a bytecode filter, only for the local ports that are
+ * monitored.  That spares formatting and parsing every socket on the box
+ * as text.
+ * ------------------------------------------------------------------------- */
+
+/* most port ranges put into a bytecode filter, beyond that the index does
+ * all the filtering */
+#define DIAG_FILTER_MAX_RANGES 64
+
+/* appends a bytecode operation */
+void diag_op(std::vector<char> &bc, uint8_t code, uint8_t yes, uint16_t no) {
+  struct inet_diag_bc_op op = {code, yes, no};
+  const char *p = reinterpret_cast<const char *>(&op);
+  bc.insert(bc.end(), p, p + sizeof(op));
+}
+
+/* Builds a filter accepting local ports in any monitored range.  A range
+ * test is "sport >= first" and "sport <= last", jumping to the next range
+ * on failure.  A JMP after each but the last range skips to the end, which
+ * accepts; jumping 4 bytes past the end rejects. */
+std::vector<char> diag_port_filter(
+    const tcp_port_monitor_collection_t *p_collection) {
+  std::vector<std::pair<uint32_t, uint32_t> > ranges;
+  std::vector<char> bc;
+
+  for (auto &monitor : p_collection->hash) {
+    ranges.emplace_back(monitor.first.first, monitor.first.second);
+  }
+  std::sort(ranges.begin(), ranges.end());
+
+  /* merge overlapping and adjacent ranges */
+  std::vector<std::pair<uint32_t, uint32_t> > merged;
+  for (auto &range : ranges) {
+    if (!merged.empty() && range.first <= merged.back().second + 1) {
+      merged.back().second = std::max(merged.back().second, range.second);
+    } else {
+      merged.push_back(range);
+    }
+  }
+  if (merged.empty() || merged.size() > DIAG_FILTER_MAX_RANGES) { return bc; }
+
+  for (size_t i = 0; i < merged.size(); ++i) {
+    bool last = i + 1 == merged.size();
+    /* "no" targets: the next range, or the reject offset after the last */
+    diag_op(bc, INET_DIAG_BC_S_GE, 8, 20);
+    diag_op(bc, 0, 0, merged[i].first);
+    diag_op(bc, INET_DIAG_BC_S_LE, 8, 12);
+    diag_op(bc, 0, 0, merged[i].second);
+    if (!last) {
+      /* past the ranges left: 20 bytes each, the last one 16, plus this */
+      diag_op(bc, INET_DIAG_BC_JMP, 4, 20 * (merged.size() - i - 1));
+    }
+  }
+  return bc;
+}
+
+/* converts an address from inet_diag_sockid to struct in6_addr */
+void diag_to_addr(struct in6_addr *addr, int family, const __be32 *diag) {
+  if (family == AF_INET) {
+    std::memcpy(addr->s6_addr, prefix_4on6, sizeof(prefix_4on6));
+    std::memcpy(&addr->s6_addr[sizeof(prefix_4on6)], diag, 4);
+  } else {
+    std::memcpy(addr->s6_addr, diag, sizeof(addr->s6_addr));
+  }
+}
+
+/* Dumps the established connections of one address family into the
+ * collection.  Returns 0 on success, or the errno of what went wrong. */
+int diag_dump(tcp_port_monitor_collection_t *p_collection, int family,
+              const std::vector<char> &filter) {
+  struct {
+    struct nlmsghdr nlh;
+    struct inet_diag_req_v2 req;
+  } request;
+  struct rtattr attr;
+  struct sockaddr_nl kernel;
+  struct iovec iov[3];
+  struct msghdr msg;
+
+  std::memset(&request, 0, sizeof(request));
+  request.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+  request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.req.sdiag_family = family;
+  request.req.sdiag_protocol = IPPROTO_TCP;
+  request.req.idiag_states = 1 << TCP_ESTABLISHED;
+
+  attr.rta_type = INET_DIAG_REQ_BYTECODE;
+  attr.rta_len = RTA_LENGTH(filter.size());
+
+  iov[0].iov_base = &request;
+  iov[0].iov_len = sizeof(request);
+  iov[1].iov_base = &attr;
+  iov[1].iov_len = sizeof(attr);
+  iov[2].iov_base = const_cast<char *>(filter.data());
+  iov[2].iov_len = filter.size();
+  request.nlh.nlmsg_len = sizeof(request);
+  if (!filter.empty()) { request.nlh.nlmsg_len += RTA_ALIGN(attr.rta_len); }
+
+  std::memset(&kernel, 0, sizeof(kernel));
+  kernel.nl_family = AF_NETLINK;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &kernel;
+  msg.msg_namelen = sizeof(kernel);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = filter.empty() ? 1 : 3;
+
+  if (sendmsg(p_collection->diag_fd, &msg, 0) < 0) { return errno; }
+
+  alignas(struct nlmsghdr) char buf[32768];
+  for (;;) {
+    ssize_t len = recv(p_collection->diag_fd, buf, sizeof(buf), 0);
+    if (len < 0) {
+      if (errno == EINTR) { continue; }
+      return errno;
+    }
+    if (len == 0) { return EIO; }
+
+    auto nlh = reinterpret_cast<struct nlmsghdr *>(buf);
+    for (; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+      if (nlh->nlmsg_type == NLMSG_DONE) { return 0; }
+      if (nlh->nlmsg_type == NLMSG_ERROR) {
+        auto err = static_cast<struct nlmsgerr *>(NLMSG_DATA(nlh));
+        return err->error ? -err->error : EIO;
+      }
+      if (nlh->nlmsg_type != SOCK_DIAG_BY_FAMILY) { continue; }
+
+      auto diag = static_cast<struct inet_diag_msg *>(NLMSG_DATA(nlh));
+      if (diag->idiag_inode == 0) { continue; }
+
+      tcp_connection_t conn;
+      conn.local_port = ntohs(diag->id.idiag_sport);
+      conn.remote_port = ntohs(diag->id.idiag_dport);
+      if (!p_collection->monitors_for(conn.local_port)) { continue; }
+
+      diag_to_addr(&conn.local_addr, diag->idiag_family, diag->id.idiag_src);
+      diag_to_addr(&conn.remote_addr, diag->idiag_family, diag->id.idiag_dst);
+      show_connection_to_collection(p_collection, conn);
+    }
+  }
+}
+
+/* Reads connections over sock_diag.  Returns false if that isn't possible,
+ * before anything was added to the collection. */
+bool process_diag(tcp_port_monitor_collection_t *p_collection) {
+  if (p_collection->diag_fd < 0) {
+    p_collection->diag_fd =
+        socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (p_collection->diag_fd < 0) {
+      LOG_DEBUG("sock_diag unavailable: {}", std::strerror(errno));
+      return false;
+    }
+  }
+
+  std::vector<char> filter = diag_port_filter(p_collection);
+  const int families[] = {AF_INET, AF_INET6};
+  for (size_t i = 0; i < sizeof(families) / sizeof(families[0]); ++i) {
+    int err = diag_dump(p_collection, families[i], filter);
+    if (err == EINVAL && !filter.empty()) {
+      /* a kernel that won't take the filter still dumps without it, and
+       * nothing was added yet for this family */
+      LOG_DEBUG("sock_diag rejected the port filter, dumping everything");
+      filter.clear();
+      err = diag_dump(p_collection, families[i], filter);
+    }
+    if (err != 0) {
+      if (i == 0) {
+        LOG_DEBUG("sock_diag dump failed: {}", std::strerror(err));
+        return false;
+      }
+      /* IPv6 may be missing altogether */
+      if (err != ENOENT && err != EAFNOSUPPORT) {
+        LOG_ERROR("sock_diag dump of IPv6 connections failed: {}",
+                  std::strerror(err));
+      }
+    }
+  }
+  return true;
+}
 }  // namespace
 
 /* ----------------------------------------------------------------------
@@ -468,8 +894,18 @@ void update_tcp_port_monitor_collection(
     tcp_port_monitor_collection_t *p_collection) {
   if (!p_collection) { return; }
 
-  process_file(p_collection, "/proc/net/tcp");
-  process_file(p_collection, "/proc/net/tcp6");
+  bool read = false;
+  if (p_collection->source != TCP_SOURCE_PROC && !p_collection->diag_failed) {
+    read = process_diag(p_collection);
+    /* when asked for netlink alone there is nothing to fall back to */
+    if (!read && p_collection->source == TCP_SOURCE_AUTO) {
+      p_collection->diag_failed = true;
+    }
+  }
+  if (!read && p_collection->source != TCP_SOURCE_NETLINK) {
+    process_file(p_collection, "/proc/net/tcp");
+    process_file(p_collection, "/proc/net/tcp6");
+  }
 
   /* age the connections in all port monitors. */
   for_each_tcp_port_monitor_in_collection(p_collection, &age_tcp_port_monitor,
@@ -490,10 +926,19 @@ int insert_new_tcp_port_monitor_into_collection(
   p_collection->hash.insert(monitor_hash_t::value_type(
       port_range_t(port_range_begin, port_range_end),
       tcp_port_monitor_t(p_creation_args->max_port_monitor_connections)));
+  p_collection->rebuild_index();
 
   return 0;
 }
 
+/* Chooses where connections are read from */
+void set_tcp_port_monitor_source(tcp_port_monitor_collection_t *p_collection,
+                                 enum tcp_port_monitor_source source) {
+  if (!p_collection) { return; }
+
+  p_collection->source = source;
+}
+
 /* Clients need a way to find monitors */
 tcp_port_monitor_t *find_tcp_port_monitor(
     tcp_port_monitor_collection_t *p_collection, in_port_t port_range_begin,
@@ -506,3 +951,16 @@ tcp_port_monitor_t *find_tcp_port_monitor(
 
   return i == p_collection->hash.end() ? nullptr : &i->second;
 }
+
+/* ---------------------
+ * Host name lookups
+ * --------------------- */
+
+void set_tcp_host_resolver(std::shared_ptr<tcp_host_resolver> resolver) {
+  get_host_cache().set_resolver(std::move(resolver));
+}
+
+void print_tcp_host(char *p_buffer, size_t buffer_size,
+                    const struct in6_addr *addr) {
+  print_host(p_buffer, buffer_size, addr, 1);
+}
@@ -79,6 +79,16 @@ typedef struct _tcp_port_monitor_collection_t tcp_port_monitor_collection_t;
  * Clients should call only those functions below this line.
  * ---------------------------------------------------------------------- */
 
+/* where a collection reads connections from */
+enum tcp_port_monitor_source {
+  /* sock_diag netlink, or /proc/net/tcp{,6} where that is unavailable */
+  TCP_SOURCE_AUTO = 0,
+  /* sock_diag netlink only */
+  TCP_SOURCE_NETLINK,
+  /* /proc/net/tcp{,6} only */
+  TCP_SOURCE_PROC
+};
+
 /* struct to hold monitor creation arguments */
 typedef struct _tcp_port_monitor_args_t {
   /* monitor supports tracking at most this many connections */
@@ -126,9 +136,41 @@ int insert_new_tcp_port_monitor_into_collection(
     tcp_port_monitor_collection_t *p_collection, in_port_t port_range_begin,
     in_port_t port_range_end, tcp_port_monitor_args_t *p_creation_args);
 
+/* Chooses where connections are read from, TCP_SOURCE_AUTO by default */
+void set_tcp_port_monitor_source(tcp_port_monitor_collection_t *p_collection,
+                                 enum tcp_port_monitor_source source);
+
 /* Clients need a way to find monitors */
 tcp_port_monitor_t *find_tcp_port_monitor(
     tcp_port_monitor_collection_t *p_collection, in_port_t port_range_begin,
     in_port_t port_range_end);
 
+/* ------------------------
+ * Host name lookups (C++)
+ * ------------------------ */
+#ifdef __cplusplus
+#include <memory>
+#include <string>
+
+/* Looks up the host names printed for REMOTEHOST and LOCALHOST.  Lookups
+ * run on a background thread and may block. */
+class tcp_host_resolver {
+ public:
+  virtual ~tcp_host_resolver() = default;
+
+  /* Returns the host name of the address, or an empty string if it has
+   * none. */
+  virtual std::string resolve(const struct sockaddr *sa, socklen_t len) = 0;
+};
+
+/* Replaces the resolver and empties the host name cache.  Passing nullptr
+ * goes back to getnameinfo(). */
+void set_tcp_host_resolver(std::shared_ptr<tcp_host_resolver> resolver);
+
+/* Copies the host name of the address into p_buffer if it's known, or the
+ * numeric address while it is still being looked up (or has no name). */
+void print_tcp_host(char *p_buffer, size_t buffer_size,
+                    const struct in6_addr *addr);
+#endif /* __cplusplus */
+
 #endif
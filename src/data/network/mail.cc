@@ -52,10 +52,15 @@
 #include <dirent.h>
 #include <termios.h>
 
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif /* HAVE_SYS_INOTIFY_H */
+
 #include <cmath>
 #include <memory>
 #include <mutex>
 #include <sstream>
+#include <string>
 
 #include "../../update-cb.hh"
 
@@ -76,7 +81,29 @@ struct local_mail_s {
   float interval;
   time_t last_mtime;
   time_t last_ctime; /* needed for mutt at least */
-  double last_update;
+
+  /* maildir: the counters are adjusted for each file inotify reports as
+   * added to or removed from new/ and cur/, a full scan is only done at the
+   * start and when the watches were lost */
+  int watch_fd{-1};
+  int new_wd{-1};
+  int cur_wd{-1};
+  bool rescan{true};
+  /* without inotify: mtimes of new/ and cur/ at the last scan */
+  time_t new_mtime{0};
+  time_t cur_mtime{0};
+
+  /* mbox: the file is scanned from where the last scan stopped, and from the
+   * start again when it was replaced, truncated or rewritten in place */
+  dev_t dev{0};
+  ino_t ino{0};
+  off_t offset{0};
+  off_t last_size{0};
+  std::string tail; /* last bytes before offset, to detect rewrites */
+  int reading_status{0};
+  int scanned_new{0};
+
+  ~local_mail_s();
 };
 
 class mail_fail : public std::runtime_error {
@@ -202,205 +229,322 @@ class pop3_cb : public mail_cb {
 struct mail_param_ex *global_mail;
 }  // namespace
 
-static void update_mail_count(struct local_mail_s *mail) {
-  struct stat st{};
+local_mail_s::~local_mail_s() {
+#ifdef HAVE_SYS_INOTIFY_H
+  if (watch_fd != -1) { close(watch_fd); }
+#endif /* HAVE_SYS_INOTIFY_H */
+  free(mbox);
+}
 
-  if (mail == nullptr) { return; }
+#if HAVE_DIRENT_H
+/* adds (sign 1) or removes (sign -1) a maildir message to the counters */
+static void maildir_count(struct local_mail_s *mail, const char *name,
+                          bool in_new, int sign) {
+  /* . and .. and dot files are skipped */
+  if (name[0] == '.') { return; }
+
+  mail->mail_count += sign;
+  if (in_new) {
+    mail->new_mail_count += sign;
+    mail->unseen_mail_count += sign; /* new messages cannot have been seen */
+    return;
+  }
 
-  /* TODO: use that fine file modification notify on Linux 2.4 */
+  /* the flags follow the last ',' of the info part, ":2,FRS" */
+  const char *flags = strrchr(name, ',');
+  if (flags == nullptr) { flags = ""; }
 
-  /* don't check mail so often (9.5s is minimum interval) */
-  if (current_update_time - mail->last_update < 9.5) { return; }
-  mail->last_update = current_update_time;
+  if (strchr(flags, 'T') != nullptr) { /* The message is in the trash */
+    mail->trashed_mail_count += sign;
+    return;
+  }
+  /* The message has been seen */
+  if (strchr(flags, 'S') != nullptr) {
+    mail->seen_mail_count += sign;
+  } else {
+    mail->unseen_mail_count += sign;
+  }
+  /* The message was flagged */
+  if (strchr(flags, 'F') != nullptr) {
+    mail->flagged_mail_count += sign;
+  } else {
+    mail->unflagged_mail_count += sign;
+  }
+  /* The message was forwarded */
+  if (strchr(flags, 'P') != nullptr) {
+    mail->forwarded_mail_count += sign;
+  } else {
+    mail->unforwarded_mail_count += sign;
+  }
+  /* The message was replied */
+  if (strchr(flags, 'R') != nullptr) {
+    mail->replied_mail_count += sign;
+  } else {
+    mail->unreplied_mail_count += sign;
+  }
+  /* The message is a draft */
+  if (strchr(flags, 'D') != nullptr) { mail->draft_mail_count += sign; }
+}
 
-  if (stat(mail->mbox, &st) != 0) {
-    static int rep = 0;
+static bool maildir_scan_dir(struct local_mail_s *mail, const std::string &path,
+                             bool in_new) {
+  DIR *dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    LOG_ERROR("cannot open directory '{}'", path);
+    return false;
+  }
+  while (struct dirent *dirent = readdir(dir)) {
+    maildir_count(mail, dirent->d_name, in_new, 1);
+  }
+  closedir(dir);
+  return true;
+}
 
-    if (rep == 0) {
-      LOG_ERROR("can't stat '{}': {}", mail->mbox, strerror(errno));
-      rep = 1;
-    }
-    return;
+static void maildir_scan(struct local_mail_s *mail) {
+  mail->mail_count = mail->new_mail_count = 0;
+  mail->seen_mail_count = mail->unseen_mail_count = 0;
+  mail->flagged_mail_count = mail->unflagged_mail_count = 0;
+  mail->forwarded_mail_count = mail->unforwarded_mail_count = 0;
+  mail->replied_mail_count = mail->unreplied_mail_count = 0;
+  mail->draft_mail_count = mail->trashed_mail_count = 0;
+
+  std::string dirname(mail->mbox);
+  if (maildir_scan_dir(mail, dirname + "/cur", false)) {
+    maildir_scan_dir(mail, dirname + "/new", true);
   }
-#if HAVE_DIRENT_H
-  /* maildir format */
-  if (S_ISDIR(st.st_mode)) {
-    DIR *dir;
-    std::string dirname(mail->mbox);
-    struct dirent *dirent;
-    char *mailflags;
-
-    mail->mail_count = mail->new_mail_count = 0;
-    mail->seen_mail_count = mail->unseen_mail_count = 0;
-    mail->flagged_mail_count = mail->unflagged_mail_count = 0;
-    mail->forwarded_mail_count = mail->unforwarded_mail_count = 0;
-    mail->replied_mail_count = mail->unreplied_mail_count = 0;
-    mail->draft_mail_count = mail->trashed_mail_count = 0;
-    /* checking the cur subdirectory */
-    dirname = dirname + "/cur";
-
-    dir = opendir(dirname.c_str());
-    if (dir == nullptr) {
-      LOG_ERROR("cannot open directory");
-      return;
-    }
-    dirent = readdir(dir);
-    while (dirent != nullptr) {
-      /* . and .. are skipped */
-      if (dirent->d_name[0] != '.') {
-        mail->mail_count++;
-        mailflags = strdup(dirent->d_name);
-        if (mailflags == nullptr) {
-          LOG_ERROR("malloc failed");
-          return;
-        }
-        strncpy(mailflags, strrchr(dirent->d_name, ','),
-                strlen(strrchr(dirent->d_name, ',')));
-        if (strchr(mailflags, 'T') ==
-            nullptr) { /* The message is not in the trash */
-          if (strchr(mailflags, 'S') !=
-              nullptr) { /*The message has been seen */
-            mail->seen_mail_count++;
-          } else {
-            mail->unseen_mail_count++;
-          }
-          if (strchr(mailflags, 'F') != nullptr) { /*The message was flagged */
-            mail->flagged_mail_count++;
-          } else {
-            mail->unflagged_mail_count++;
-          }
-          if (strchr(mailflags, 'P') !=
-              nullptr) { /*The message was forwarded */
-            mail->forwarded_mail_count++;
-          } else {
-            mail->unforwarded_mail_count++;
-          }
-          if (strchr(mailflags, 'R') != nullptr) { /*The message was replied */
-            mail->replied_mail_count++;
-          } else {
-            mail->unreplied_mail_count++;
-          }
-          if (strchr(mailflags, 'D') != nullptr) { /*The message is a draft */
-            mail->draft_mail_count++;
-          }
-        } else {
-          mail->trashed_mail_count++;
-        }
-        free(mailflags);
-      }
-      dirent = readdir(dir);
-    }
-    closedir(dir);
+}
 
-    dirname.resize(dirname.size() - 3);
-    dirname = dirname + "new";
+#ifdef HAVE_SYS_INOTIFY_H
+static void maildir_watch(struct local_mail_s *mail) {
+  if (mail->watch_fd != -1) { close(mail->watch_fd); }
+  mail->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (mail->watch_fd == -1) { return; }
+
+  const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                        IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+  std::string dirname(mail->mbox);
+  mail->new_wd = inotify_add_watch(mail->watch_fd, (dirname + "/new").c_str(),
+                                   mask);
+  mail->cur_wd = inotify_add_watch(mail->watch_fd, (dirname + "/cur").c_str(),
+                                   mask);
+  if (mail->new_wd == -1 || mail->cur_wd == -1) {
+    close(mail->watch_fd);
+    mail->watch_fd = -1;
+  }
+}
 
-    dir = opendir(dirname.c_str());
-    if (dir == nullptr) {
-      LOG_ERROR("cannot open directory");
-      return;
-    }
-    dirent = readdir(dir);
-    while (dirent != nullptr) {
-      /* . and .. are skipped */
-      if (dirent->d_name[0] != '.') {
-        mail->new_mail_count++;
-        mail->mail_count++;
-        mail->unseen_mail_count++; /* new messages cannot have been seen */
+/* applies the queued events, returns false if a full scan is needed */
+static bool maildir_drain(struct local_mail_s *mail) {
+  alignas(struct inotify_event) char buf[4096];
+  ssize_t len;
+  bool ok = true;
+
+  while ((len = read(mail->watch_fd, buf, sizeof(buf))) > 0) {
+    for (ssize_t i = 0; i < len;) {
+      auto *ev = reinterpret_cast<struct inotify_event *>(buf + i);
+      i += sizeof(struct inotify_event) + ev->len;
+
+      if ((ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF |
+                       IN_MOVE_SELF)) != 0) {
+        ok = false;
+        continue;
       }
-      dirent = readdir(dir);
+      if (ev->len == 0 || (ev->mask & IN_ISDIR) != 0) { continue; }
+
+      int sign = (ev->mask & (IN_CREATE | IN_MOVED_TO)) != 0 ? 1 : -1;
+      maildir_count(mail, ev->name, ev->wd == mail->new_wd, sign);
     }
-    closedir(dir);
+  }
+  return ok;
+}
+#endif /* HAVE_SYS_INOTIFY_H */
 
+static void update_maildir_count(struct local_mail_s *mail) {
+#ifdef HAVE_SYS_INOTIFY_H
+  if (mail->watch_fd != -1 && !mail->rescan) {
+    if (maildir_drain(mail)) { return; }
+    mail->rescan = true;
+  }
+  if (mail->rescan) {
+    /* watch first, so nothing that happens during the scan is missed */
+    maildir_watch(mail);
+    maildir_scan(mail);
+    mail->rescan = false;
+    if (mail->watch_fd != -1) { return; }
+  }
+#endif /* HAVE_SYS_INOTIFY_H */
+
+  /* new/ and cur/ change their mtime whenever a message is added, removed
+   * or renamed */
+  struct stat new_st{}, cur_st{};
+  std::string dirname(mail->mbox);
+  if (stat((dirname + "/new").c_str(), &new_st) != 0 ||
+      stat((dirname + "/cur").c_str(), &cur_st) != 0) {
+    LOG_ERROR("cannot open directory");
     return;
   }
-#endif
-  /* mbox format */
-  if (st.st_mtime != mail->last_mtime || st.st_ctime != mail->last_ctime) {
-    /* yippee, modification time has changed, let's read mail count! */
-    static int rep;
-    FILE *fp;
-    int reading_status = 0;
-
-    /* could lock here but I don't think it's really worth it because
-     * this isn't going to write mail spool */
-
-    mail->new_mail_count = mail->mail_count = 0;
-
-    /* these flags are not supported for mbox */
-    mail->seen_mail_count = mail->unseen_mail_count = -1;
-    mail->flagged_mail_count = mail->unflagged_mail_count = -1;
-    mail->forwarded_mail_count = mail->unforwarded_mail_count = -1;
-    mail->replied_mail_count = mail->unreplied_mail_count = -1;
-    mail->draft_mail_count = mail->trashed_mail_count = -1;
-
-    fp = open_file(mail->mbox, &rep);
-    if (fp == nullptr) { return; }
+  if (new_st.st_mtime == mail->new_mtime &&
+      cur_st.st_mtime == mail->cur_mtime) {
+    return;
+  }
+  mail->new_mtime = new_st.st_mtime;
+  mail->cur_mtime = cur_st.st_mtime;
+  maildir_scan(mail);
+}
+#endif /* HAVE_DIRENT_H */
+
+/* compares the bytes before mail->offset with those seen by the last scan */
+static bool mbox_tail_matches(struct local_mail_s *mail, int fd) {
+  std::string current(mail->tail.size(), '\0');
+  return pread(fd, &current[0], current.size(),
+               mail->offset - current.size()) ==
+             static_cast<ssize_t>(current.size()) &&
+         current == mail->tail;
+}
 
-    /* NOTE: adds mail as new if there isn't Status-field at all */
+static void update_mbox_count(struct local_mail_s *mail,
+                              const struct stat &st) {
+  enum { TAIL_SIZE = 64 };
 
-    while (feof(fp) == 0) {
-      char buf[128];
+  /* mtimes only have a resolution of seconds, appends within the same
+   * second still change the size */
+  if (st.st_mtime == mail->last_mtime && st.st_ctime == mail->last_ctime &&
+      st.st_size == mail->last_size && st.st_ino == mail->ino &&
+      st.st_dev == mail->dev) {
+    return;
+  }
 
-      if (fgets(buf, 128, fp) == nullptr) { break; }
+  /* could lock here but I don't think it's really worth it because
+   * this isn't going to write mail spool */
+  static int rep;
+  FILE *fp = open_file(mail->mbox, &rep);
+  if (fp == nullptr) { return; }
+
+  /* yippee, the file changed; if it only grew, read what was appended */
+  bool restart = st.st_ino != mail->ino || st.st_dev != mail->dev ||
+                 st.st_size <= mail->offset ||
+                 !mbox_tail_matches(mail, fileno(fp));
+  if (restart) {
+    mail->offset = 0;
+    mail->tail.clear();
+    mail->reading_status = 0;
+    mail->mail_count = mail->scanned_new = 0;
+    mail->trashed_mail_count = 0;
+  }
+  mail->dev = st.st_dev;
+  mail->ino = st.st_ino;
+  mail->last_mtime = st.st_mtime;
+  mail->last_ctime = st.st_ctime;
+  mail->last_size = st.st_size;
+
+  /* these flags are not supported for mbox */
+  mail->seen_mail_count = mail->unseen_mail_count = -1;
+  mail->flagged_mail_count = mail->unflagged_mail_count = -1;
+  mail->forwarded_mail_count = mail->unforwarded_mail_count = -1;
+  mail->replied_mail_count = mail->unreplied_mail_count = -1;
+  mail->draft_mail_count = -1;
+
+  fseeko(fp, mail->offset, SEEK_SET);
+
+  /* NOTE: adds mail as new if there isn't Status-field at all */
+  char *buf = nullptr;
+  size_t buf_size = 0;
+  ssize_t len;
+  int &reading_status = mail->reading_status;
+  while ((len = getline(&buf, &buf_size, fp)) > 0) {
+    /* a line that is still being written is read again next time */
+    if (buf[len - 1] != '\n') { break; }
+    mail->offset += len;
+    if (len >= TAIL_SIZE) {
+      mail->tail.assign(buf + len - TAIL_SIZE, TAIL_SIZE);
+    } else {
+      mail->tail.append(buf, len);
+      if (mail->tail.size() > TAIL_SIZE) {
+        mail->tail.erase(0, mail->tail.size() - TAIL_SIZE);
+      }
+    }
 
-      if (strncmp(buf, "From ", 5) == 0) {
-        /* ignore MAILER-DAEMON */
-        if (strncmp(buf + 5, "MAILER-DAEMON ", 14) != 0) {
-          mail->mail_count++;
+    if (strncmp(buf, "From ", 5) == 0) {
+      /* ignore MAILER-DAEMON */
+      if (strncmp(buf + 5, "MAILER-DAEMON ", 14) != 0) {
+        mail->mail_count++;
 
-          if (reading_status == 1) {
-            mail->new_mail_count++;
-          } else {
-            reading_status = 1;
-          }
+        if (reading_status == 1) {
+          mail->scanned_new++;
+        } else {
+          reading_status = 1;
         }
-      } else {
-        if (reading_status == 1 && strncmp(buf, "X-Mozilla-Status:", 17) == 0) {
-          int xms = strtol(buf + 17, nullptr, 16);
-          /* check that mail isn't marked for deletion */
-          if ((xms & 0x0008) != 0) {
-            mail->trashed_mail_count++;
-            reading_status = 0;
-            /* Don't check whether the trashed email is unread */
-            continue;
-          }
-          /* check that mail isn't already read */
-          if ((xms & 0x0001) == 0) { mail->new_mail_count++; }
-
-          /* check for an additional X-Status header */
-          reading_status = 2;
+      }
+    } else {
+      if (reading_status == 1 && strncmp(buf, "X-Mozilla-Status:", 17) == 0) {
+        int xms = strtol(buf + 17, nullptr, 16);
+        /* check that mail isn't marked for deletion */
+        if ((xms & 0x0008) != 0) {
+          mail->trashed_mail_count++;
+          reading_status = 0;
+          /* Don't check whether the trashed email is unread */
           continue;
         }
-        if (reading_status == 1 && strncmp(buf, "Status:", 7) == 0) {
-          /* check that mail isn't already read */
-          if (strchr(buf + 7, 'R') == nullptr) { mail->new_mail_count++; }
+        /* check that mail isn't already read */
+        if ((xms & 0x0001) == 0) { mail->scanned_new++; }
 
-          reading_status = 2;
-          continue;
-        }
-        if (reading_status >= 1 && strncmp(buf, "X-Status:", 9) == 0) {
-          /* check that mail isn't marked for deletion */
-          if (strchr(buf + 9, 'D') != nullptr) { mail->trashed_mail_count++; }
+        /* check for an additional X-Status header */
+        reading_status = 2;
+        continue;
+      }
+      if (reading_status == 1 && strncmp(buf, "Status:", 7) == 0) {
+        /* check that mail isn't already read */
+        if (strchr(buf + 7, 'R') == nullptr) { mail->scanned_new++; }
 
-          reading_status = 0;
-          continue;
-        }
+        reading_status = 2;
+        continue;
       }
+      if (reading_status >= 1 && strncmp(buf, "X-Status:", 9) == 0) {
+        /* check that mail isn't marked for deletion */
+        if (strchr(buf + 9, 'D') != nullptr) { mail->trashed_mail_count++; }
 
-      /* skip until \n */
-      while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-        if (fgets(buf, 128, fp) == nullptr) { break; }
+        reading_status = 0;
+        continue;
       }
     }
+  }
+  free(buf);
+  fclose(fp);
+
+  mail->new_mail_count = mail->scanned_new + (reading_status != 0 ? 1 : 0);
+}
+
+static void update_mail_count(struct local_mail_s *mail) {
+  struct stat st{};
+
+  if (mail == nullptr) { return; }
 
-    fclose(fp);
+#if HAVE_DIRENT_H && defined(HAVE_SYS_INOTIFY_H)
+  /* a watched maildir doesn't even need a stat() */
+  if (mail->watch_fd != -1 && !mail->rescan) {
+    update_maildir_count(mail);
+    return;
+  }
+#endif
 
-    if (reading_status != 0) { mail->new_mail_count++; }
+  if (stat(mail->mbox, &st) != 0) {
+    static int rep = 0;
 
-    mail->last_mtime = st.st_mtime;
-    mail->last_ctime = st.st_ctime;
+    if (rep == 0) {
+      LOG_ERROR("can't stat '{}': {}", mail->mbox, strerror(errno));
+      rep = 1;
+    }
+    return;
   }
+#if HAVE_DIRENT_H
+  /* maildir format */
+  if (S_ISDIR(st.st_mode)) {
+    update_maildir_count(mail);
+    return;
+  }
+#endif
+  /* mbox format */
+  update_mbox_count(mail, st);
 }
 
 void parse_local_mail_args(struct text_object *obj, const char *arg) {
@@ -420,9 +564,7 @@ void parse_local_mail_args(struct text_object *obj, const char *arg) {
 
   std::string dst = variable_substitute(mbox);
 
-  locmail =
-      static_cast<struct local_mail_s *>(malloc(sizeof(struct local_mail_s)));
-  memset(locmail, 0, sizeof(struct local_mail_s));
+  locmail = new local_mail_s{};
   locmail->mbox = strndup(dst.c_str(), text_buffer_size.get(*state));
   locmail->interval = n1;
   obj->data.opaque = locmail;
@@ -455,8 +597,8 @@ void free_local_mails(struct text_object *obj) {
 
   if (locmail == nullptr) { return; }
 
-  free_and_zero(locmail->mbox);
-  free_and_zero(obj->data.opaque);
+  delete locmail;
+  obj->data.opaque = nullptr;
 }
 
 #define MAXDATASIZE 1000
@@ -29,8 +29,12 @@
 
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include <cerrno>
+#include <cstdio>
+#include <deque>
 #include <memory>
+#include <string>
 #include "../../conky.h"
 #include "../../content/text_object.h"
 #include "../../logging.h"
@@ -41,17 +45,29 @@
 #define PRINT_MAILS 5
 #define TIME_DELAY 5
 
-struct ring_list {
-  char *from;
-  char *subject;
-  struct ring_list *previous;
-  struct ring_list *next;
+/* an unread message, the newest is at the back */
+struct mbox_message {
+  std::string from;
+  std::string subject;
 };
 
 static time_t last_ctime; /* needed for mutt at least */
 static time_t last_mtime; /* not sure what to test: testing both now */
 static double last_update;
 
+/* The mbox is scanned from where the previous scan stopped, with the parser
+ * state it had there. It's scanned from the start again when it was replaced,
+ * truncated or rewritten in place. */
+static struct {
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  off_t offset;
+  std::string tail; /* last bytes before offset, to detect rewrites */
+  bool in_body = true;
+  std::deque<mbox_message> messages;
+} scan_state;
+
 static int args_ok = 0;
 static int from_width;
 static int subject_width;
@@ -60,13 +76,107 @@ static int time_delay;
 
 static char mbox_mail_spool[DEFAULT_TEXT_BUFFER_SIZE];
 
+/* copies a From: or Subject: value, at most width characters; From: stops
+ * before an address in <> and drops quotes */
+static std::string header_value(const char *value, int width, bool from) {
+  std::string result;
+  for (const char *c = value; *c != '\0' && *c != '\n'; c++) {
+    if (from && *c == '"') { continue; /* no quotes around names */ }
+    /* some are: From: <foo@bar.com> */
+    if (from && *c == '<' && result.size() > 1) { break; }
+    if (result.size() >= static_cast<size_t>(width)) { break; }
+    result.push_back(*c);
+  }
+  return result;
+}
+
+/* scans the lines appended since the previous scan */
+static void mbox_scan_appended(FILE *fp, const struct stat &st, bool restart) {
+  enum { TAIL_SIZE = 64 };
+  auto &ss = scan_state;
+
+  if (!restart) {
+    restart = st.st_dev != ss.dev || st.st_ino != ss.ino ||
+              st.st_size <= ss.offset;
+  }
+  if (!restart && !ss.tail.empty()) {
+    std::string current(ss.tail.size(), '\0');
+    restart = pread(fileno(fp), &current[0], current.size(),
+                    ss.offset - current.size()) !=
+                  static_cast<ssize_t>(current.size()) ||
+              current != ss.tail;
+  }
+  if (restart) {
+    ss.offset = 0;
+    ss.tail.clear();
+    ss.in_body = true;
+    ss.messages.clear();
+  }
+  ss.dev = st.st_dev;
+  ss.ino = st.st_ino;
+  ss.size = st.st_size;
+
+  fseeko(fp, ss.offset, SEEK_SET);
+
+  char *line = nullptr;
+  size_t line_size = 0;
+  ssize_t len;
+  while ((len = getline(&line, &line_size, fp)) > 0) {
+    /* a line that is still being written is read again next time */
+    if (line[len - 1] != '\n') { break; }
+    ss.offset += len;
+    ss.tail.append(line, len);
+    if (ss.tail.size() > TAIL_SIZE) {
+      ss.tail.erase(0, ss.tail.size() - TAIL_SIZE);
+    }
+
+    if (strncmp(line, "From ", 5) == 0) {
+      ss.messages.emplace_back();
+      if (ss.messages.size() > static_cast<size_t>(print_num_mails)) {
+        ss.messages.pop_front();
+      }
+      ss.in_body = false; /* in the headers now */
+      continue;
+    }
+
+    /* in the body, so skip */
+    if (ss.in_body) { continue; }
+
+    if (line[0] == '\n') {
+      /* beyond the headers now (empty line), search for new mail ("From ") */
+      ss.in_body = true;
+      continue;
+    }
+
+    if ((strncmp(line, "X-Status: ", 10) == 0) ||
+        (strncmp(line, "Status: R", 9) == 0)) {
+      /* Mail was read or something, so skip that message */
+      ss.in_body = true; /* search for next From */
+      if (!ss.messages.empty()) { ss.messages.pop_back(); }
+      continue;
+    }
+
+    if (ss.messages.empty()) { continue; }
+
+    /* that covers ^From: and ^from: ^From:<tab> */
+    if (len > 6 && strncmp(line + 1, "rom:", 4) == 0) {
+      ss.messages.back().from = header_value(line + 6, from_width, true);
+    }
+
+    /* that covers ^Subject: and ^subject: and ^Subjec:<tab> */
+    if (len > 9 && strncmp(line + 1, "ubject:", 7) == 0) {
+      ss.messages.back().subject = header_value(line + 9, subject_width, false);
+    }
+  }
+  free(line);
+}
+
 static void mbox_scan(char *args, char *output, size_t max_len) {
-  int i, u, flag;
+  int i;
   int force_rescan = 0;
   std::unique_ptr<char[]> buf_(new char[text_buffer_size.get(*state)]);
   char *buf = buf_.get();
   struct stat statbuf{};
-  struct ring_list *curr = nullptr, *prev = nullptr, *startlist = nullptr;
   FILE *fp;
 
   /* output was set to 1 after malloc'ing in conky.c */
@@ -171,192 +281,37 @@ static void mbox_scan(char *args, char *output, size_t max_len) {
 
   /* modification time has not changed, so skip scanning the box */
   if (statbuf.st_ctime == last_ctime && statbuf.st_mtime == last_mtime &&
-      (force_rescan == 0)) {
+      statbuf.st_size == scan_state.size && (force_rescan == 0)) {
     return;
   }
 
   last_ctime = statbuf.st_ctime;
   last_mtime = statbuf.st_mtime;
 
-  /* build up double-linked ring-list to hold data, while scanning down the
-   * mbox */
-  for (i = 0; i < print_num_mails; i++) {
-    curr = static_cast<struct ring_list *>(malloc(sizeof(struct ring_list)));
-    curr->from = static_cast<char *>(malloc(from_width + 1));
-    curr->subject = static_cast<char *>(malloc(subject_width + 1));
-    curr->from[0] = '\0';
-    curr->subject[0] = '\0';
-
-    if (i == 0) { startlist = curr; }
-    if (i > 0) {
-      curr->previous = prev;
-      prev->next = curr;
-    }
-    prev = curr;
-  }
-
-  if (startlist == nullptr) { return; }
-  /* connect end to start for an endless loop-ring */
-  startlist->previous = curr;
-  curr->next = startlist;
-
   /* mbox */
   fp = fopen(mbox_mail_spool, "re");
   if (fp == nullptr) { return; }
 
-  /* first find a "From " to set it to 0 for header-sarchings */
-  flag = 1;
-  while (feof(fp) == 0) {
-    if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) { break; }
-
-    if (strncmp(buf, "From ", 5) == 0) {
-      curr = curr->next;
-
-      /* skip until \n */
-      while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-        if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) { break; }
-      }
-
-      flag = 0; /* in the headers now */
-      continue;
-    }
-
-    if (flag == 1) { /* in the body, so skip */
-      continue;
-    }
-
-    if (buf[0] == '\n') {
-      /* beyond the headers now (empty line), skip until \n */
-      /* then search for new mail ("From ") */
-
-      while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-        if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) { break; }
-      }
-      flag = 1; /* in the body now */
-      continue;
-    }
-
-    if ((strncmp(buf, "X-Status: ", 10) == 0) ||
-        (strncmp(buf, "Status: R", 9) == 0)) {
-      /* Mail was read or something, so skip that message */
-      flag = 1; /* search for next From */
-      curr->subject[0] = '\0';
-      curr->from[0] = '\0';
-      /* (will get current again on new 'From ' finding) */
-      curr = curr->previous;
-      /* Skip until \n */
-      while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-        if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) { break; }
-      }
-      continue;
-    }
-
-    /* that covers ^From: and ^from: ^From:<tab> */
-    if (strncmp(buf + 1, "rom:", 4) == 0) {
-      i = 0;
-      u = 6; /* no "From: " string needed, so skip */
-      while (1) {
-        if (buf[u] == '"') { /* no quotes around names */
-          u++;
-          continue;
-        }
-
-        /* some are: From: <foo@bar.com> */
-        if (buf[u] == '<' && i > 1) {
-          curr->from[i] = '\0';
-          /* skip until \n */
-          while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-            if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) {
-              break;
-            }
-          }
-          break;
-        }
-
-        if (buf[u] == '\n') {
-          curr->from[i] = '\0';
-          break;
-        }
-
-        if (buf[u] == '\0') {
-          curr->from[i] = '\0';
-          break;
-        }
-
-        if (i >= from_width) {
-          curr->from[i] = '\0';
-          /* skip until \n */
-          while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-            if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) {
-              break;
-            }
-          }
-          break;
-        }
-
-        /* nothing special so just set it */
-        curr->from[i++] = buf[u++];
-      }
-    }
-
-    /* that covers ^Subject: and ^subject: and ^Subjec:<tab> */
-    if (strncmp(buf + 1, "ubject:", 7) == 0) {
-      i = 0;
-      u = 9; /* no "Subject: " string needed, so skip */
-      while (1) {
-        if (buf[u] == '\n') {
-          curr->subject[i] = '\0';
-          break;
-        }
-        if (buf[u] == '\0') {
-          curr->subject[i] = '\0';
-          break;
-        }
-        if (i >= subject_width) {
-          curr->subject[i] = '\0';
-
-          /* skip until \n */
-          while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-            if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) {
-              break;
-            }
-          }
-          break;
-        }
-
-        /* nothing special so just set it */
-        curr->subject[i++] = buf[u++];
-      }
-    }
-  }
-
+  mbox_scan_appended(fp, statbuf, force_rescan != 0);
   fclose(fp);
 
   output[0] = '\0';
 
-  i = print_num_mails;
-  while (i != 0) {
-    struct ring_list *tmp;
-    if (curr->from[0] != '\0') {
-      if (i != print_num_mails) {
-        snprintf(buf, text_buffer_size.get(*state), "\nF: %-*s S: %-*s",
-                 from_width, curr->from, subject_width, curr->subject);
-      } else { /* first time - no \n in front */
-        snprintf(buf, text_buffer_size.get(*state), "F: %-*s S: %-*s",
-                 from_width, curr->from, subject_width, curr->subject);
-      }
+  size_t count = scan_state.messages.size();
+  for (i = 0; i < print_num_mails; i++) {
+    const mbox_message *msg =
+        static_cast<size_t>(i) < count
+            ? &scan_state.messages[count - 1 - static_cast<size_t>(i)]
+            : nullptr;
+    if (msg != nullptr && !msg->from.empty()) {
+      /* first one without \n in front */
+      snprintf(buf, text_buffer_size.get(*state), "%sF: %-*s S: %-*s",
+               i != 0 ? "\n" : "", from_width, msg->from.c_str(),
+               subject_width, msg->subject.c_str());
     } else {
       snprintf(buf, text_buffer_size.get(*state), "%s", "\n");
     }
     strncat(output, buf, max_len - strlen(output));
-
-    tmp = curr->previous;
-    free(curr->from);
-    free(curr->subject);
-    free(curr);
-    curr = tmp;
-
-    i--;
   }
 }
 
@@ -28,18 +28,180 @@
  */
 
 #include <systemd/sd-journal.h>
+#include <algorithm>
 #include <chrono>
 #include <cstring>
 #include <ctime>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 #include "../../buffer.hh"
 #include "../../conky.h"
 #include "../../content/text_object.h"
 #include "../../logging.h"
+#include "../../update-cb.hh"
+
+static bool print_field(sd_journal *handle, const char *field, char spacer,
+                        conky::buffer_writer &out) {
+  const void *data;
+  size_t length;
+  size_t fieldlen = strlen(field) + 1;
+
+  int ret = sd_journal_get_data(handle, field, &data, &length);
+  if (ret >= 0) {
+    if (length - fieldlen > out.remaining()) return false;
+    out.append(static_cast<const char *>(data) + fieldlen, length - fieldlen);
+  } else if (ret != -ENOENT) {
+    return false;
+  }
+
+  return !spacer || out.append(spacer);
+}
+
+bool read_log(sd_journal *handle, conky::buffer_writer &out) {
+  uint64_t usec;
+  if (sd_journal_get_realtime_usec(handle, &usec) < 0) return false;
+
+  auto tp =
+      std::chrono::system_clock::time_point{std::chrono::microseconds{usec}};
+  std::time_t epoch = std::chrono::system_clock::to_time_t(tp);
+  std::tm local_tm{};
+  localtime_r(&epoch, &local_tm);
+
+  size_t length =
+      strftime(out.cursor(), out.remaining(), "%b %d %H:%M:%S", &local_tm);
+  if (length == 0) return false;
+  out.advance(length);
+
+  if (!out.append(' ')) return false;
+  if (!print_field(handle, "_HOSTNAME", ' ', out)) return false;
+  if (!print_field(handle, "SYSLOG_IDENTIFIER", '[', out)) return false;
+  if (!print_field(handle, "_PID", ']', out)) return false;
+  if (!out.append(':')) return false;
+  if (!out.append(' ')) return false;
+  if (!print_field(handle, "MESSAGE", '\n', out)) return false;
+  return true;
+}
+
+/*
+ * Follows the journal for one set of open flags. The handle stays open for
+ * as long as some journal object uses it; every update only reads the entries
+ * added since the previous one and keeps the last `capacity` of them,
+ * already formatted. With from_head, it keeps the entries from the start of
+ * the journal instead, until they fill the text buffer.
+ */
+class journal_cb : public conky::callback<std::deque<std::string>, int, bool> {
+  typedef conky::callback<std::deque<std::string>, int, bool> Base;
+
+  sd_journal *handle = nullptr;
+  size_t capacity;
+  size_t stored_bytes = 0;
+  bool refill = true;
+  std::vector<char> line_buffer;
+
+  enum { FLAGS, FROM_HEAD };
+
+  void append_current() {
+    if (line_buffer.size() < text_buffer_size.get(*state)) {
+      line_buffer.resize(text_buffer_size.get(*state));
+    }
+    conky::buffer_writer out(line_buffer.size(), line_buffer.data());
+    read_log(handle, out);
+    if (out.size() == 0) return;
+
+    result.emplace_back(out.view());
+    stored_bytes += out.size();
+    if (!get<FROM_HEAD>()) {
+      while (result.size() > capacity) {
+        stored_bytes -= result.front().size();
+        result.pop_front();
+      }
+    }
+  }
+
+  bool seek() {
+    result.clear();
+    stored_bytes = 0;
+    if (get<FROM_HEAD>()) {
+      if (sd_journal_seek_head(handle) < 0) {
+        LOG_ERROR("unable to seek to start of journal");
+        return false;
+      }
+      return true;
+    }
+
+    if (sd_journal_seek_tail(handle) < 0) {
+      LOG_ERROR("unable to seek to end of journal");
+      return false;
+    }
+    int skipped = sd_journal_previous_skip(handle, capacity);
+    if (skipped < 0) {
+      LOG_ERROR("unable to seek back {} lines", capacity);
+      return false;
+    }
+    // previous_skip leaves us on the oldest wanted entry, which next() in
+    // work() would step over
+    if (skipped > 0) append_current();
+    return true;
+  }
+
+ protected:
+  void work() override {
+    std::lock_guard<std::mutex> lock(result_mutex);
+
+    if (handle == nullptr) {
+      if (sd_journal_open(&handle, get<FLAGS>()) != 0) {
+        LOG_ERROR("unable to open journal");
+        handle = nullptr;
+        return;
+      }
+      refill = true;
+    } else if (sd_journal_process(handle) == SD_JOURNAL_INVALIDATE &&
+               get<FROM_HEAD>()) {
+      // files were added or removed, the head may have been vacuumed
+      refill = true;
+    }
+
+    if (refill) {
+      if (!seek()) return;
+      refill = false;
+    }
+
+    while (!(get<FROM_HEAD>() &&
+             stored_bytes >= text_buffer_size.get(*state)) &&
+           sd_journal_next(handle) > 0) {
+      append_current();
+    }
+  }
+
+  void merge(callback_base &&other) override {
+    auto &&o = dynamic_cast<journal_cb &&>(other);
+    {
+      std::lock_guard<std::mutex> lock(result_mutex);
+      if (o.capacity > capacity) {
+        capacity = o.capacity;
+        refill = true;
+      }
+    }
+
+    Base::merge(std::move(other));
+  }
+
+ public:
+  journal_cb(uint32_t period, int flags, bool from_head, size_t capacity_)
+      : Base(period, true, Tuple(flags, from_head)), capacity(capacity_) {}
+
+  ~journal_cb() override {
+    if (handle != nullptr) { sd_journal_close(handle); }
+  }
+};
 
 struct journal {
   int wanted_lines;
   int flags;
+  std::unique_ptr<conky::callback_handle<journal_cb>> cb;
 
   journal() : wanted_lines(1), flags(SD_JOURNAL_LOCAL_ONLY) {}
 };
@@ -81,82 +243,35 @@ void init_journal(const char *type, const char *arg, struct text_object *obj) {
     }
   }
 
+  // line count 0 means "from the start of the journal"
+  options->cb = std::make_unique<conky::callback_handle<journal_cb>>(
+      conky::register_cb<journal_cb>(1, options->flags,
+                                     options->wanted_lines == 0,
+                                     options->wanted_lines));
+
   obj->data.opaque = options.release();
   obj->callbacks.free = &free_journal;
 }
 
-static bool print_field(sd_journal *handle, const char *field, char spacer,
-                        conky::buffer_writer &out) {
-  const void *data;
-  size_t length;
-  size_t fieldlen = strlen(field) + 1;
-
-  int ret = sd_journal_get_data(handle, field, &data, &length);
-  if (ret >= 0) {
-    if (length - fieldlen > out.remaining()) return false;
-    out.append(static_cast<const char *>(data) + fieldlen, length - fieldlen);
-  } else if (ret != -ENOENT) {
-    return false;
-  }
-
-  return !spacer || out.append(spacer);
-}
-
-bool read_log(sd_journal *handle, conky::buffer_writer &out) {
-  uint64_t usec;
-  if (sd_journal_get_realtime_usec(handle, &usec) < 0) return false;
-
-  auto tp =
-      std::chrono::system_clock::time_point{std::chrono::microseconds{usec}};
-  std::time_t epoch = std::chrono::system_clock::to_time_t(tp);
-  std::tm local_tm{};
-  localtime_r(&epoch, &local_tm);
-
-  size_t length =
-      strftime(out.cursor(), out.remaining(), "%b %d %H:%M:%S", &local_tm);
-  if (length == 0) return false;
-  out.advance(length);
-
-  if (!out.append(' ')) return false;
-  if (!print_field(handle, "_HOSTNAME", ' ', out)) return false;
-  if (!print_field(handle, "SYSLOG_IDENTIFIER", '[', out)) return false;
-  if (!print_field(handle, "_PID", ']', out)) return false;
-  if (!out.append(':')) return false;
-  if (!out.append(' ')) return false;
-  if (!print_field(handle, "MESSAGE", '\n', out)) return false;
-  return true;
-}
-
 void print_journal(struct text_object *obj, char *p, unsigned int p_max_size) {
   journal *conf = static_cast<journal *>(obj->data.opaque);
   conky::buffer_writer out(p_max_size, p);
   out.terminate();
+  if (conf == nullptr || !conf->cb) return;
 
-  sd_journal *raw = nullptr;
-  if (sd_journal_open(&raw, conf->flags) != 0) {
-    LOG_ERROR("unable to open journal");
-    return;
+  const auto &lines = (*conf->cb)->get_result();
+  size_t first = 0;
+  if (conf->wanted_lines > 0 &&
+      lines.size() > static_cast<size_t>(conf->wanted_lines)) {
+    first = lines.size() - conf->wanted_lines;
   }
-  auto handle = std::unique_ptr<sd_journal, decltype(&sd_journal_close)>(
-      raw, sd_journal_close);
 
-  if (conf->wanted_lines == 0) {
-    if (sd_journal_seek_head(handle.get()) < 0) {
-      LOG_ERROR("unable to seek to start of journal");
-      return;
-    }
-    if (sd_journal_next(handle.get()) <= 0) { return; }
-  } else {
-    if (sd_journal_seek_tail(handle.get()) < 0) {
-      LOG_ERROR("unable to seek to end of journal");
-      return;
-    }
-    if (sd_journal_previous_skip(handle.get(), conf->wanted_lines) < 0) {
-      LOG_ERROR("unable to seek back {} lines", conf->wanted_lines);
-      return;
+  for (size_t i = first; i < lines.size(); i++) {
+    if (!out.append(lines[i])) {
+      // keep whatever fits, like a partially printed entry
+      out.append(lines[i].data(), std::min(lines[i].size(), out.remaining()));
+      break;
     }
   }
-
-  while (read_log(handle.get(), out) && sd_journal_next(handle.get()));
   out.terminate();
 }
@@ -354,7 +354,8 @@ void update_gateway_info_failure(const char *reason) {
 
 FILE *check_procroute() {
   FILE *fp;
-  if ((fp = fopen("/proc/net/route", "r")) == nullptr) {
+  std::string path;
+  if ((fp = fopen(system_path("/proc/net/route", path), "r")) == nullptr) {
     update_gateway_info_failure("fopen()");
     return nullptr;
   }
@@ -719,7 +720,11 @@ void update_ipv6_net_stats() {
     }
   }
 
-  if ((file = fopen(PROCDIR "/net/if_inet6", "r")) == nullptr) { return; }
+  std::string path;
+  if ((file = fopen(system_path(PROCDIR "/net/if_inet6", path), "r")) ==
+      nullptr) {
+    return;
+  }
 
   while (fscanf(file, "%32s %*02x %02x %02x %*02x %20s\n", v6addr, &netmask,
                 &scope, devname) != EOF) {
@@ -832,8 +837,10 @@ int update_total_processes(void) {
   int ignore1;
   char ignore2;
 
+  std::string path;
+
   info.procs = 0;
-  dir = opendir("/proc");
+  dir = opendir(system_path("/proc", path));
   if (dir) {
     while ((entry = readdir(dir))) {
       if (sscanf(entry->d_name, "%d%c", &ignore1, &ignore2) == 1) {
@@ -2773,7 +2780,9 @@ int is_disk(char *dev) {
   while ((slash = strchr(dev, '/'))) *slash = '!';
   syspath += dev;
 
-  return dev_list[orig] = !(access(syspath.c_str(), F_OK));
+  std::string rooted;
+  return dev_list[orig] =
+             !(access(system_path(syspath.c_str(), rooted), F_OK));
 }
 
 int update_diskio(void) {
@@ -2928,7 +2937,8 @@ static unsigned long long calc_cpu_total(void) {
   const char *template_ =
       KFLAG_ISSET(KFLAG_IS_LONGSTAT) ? TMPL_LONGPROC : TMPL_SHORTPROC;
 
-  ps = open("/proc/stat", O_RDONLY);
+  std::string path;
+  ps = open(system_path("/proc/stat", path), O_RDONLY);
   rc = read(ps, line, BUFFER_LEN - 1);
   close(ps);
   if (rc < 0) { return 0; }
@@ -2972,8 +2982,22 @@ static void calc_io_each(void) {
  * Extract information from /proc		  *
  ******************************************/
 
-#define PROCFS_TEMPLATE "/proc/%d/stat"
-#define PROCFS_CMDLINE_TEMPLATE "/proc/%d/cmdline"
+/* the first %s is system_root */
+#define PROCFS_TEMPLATE "%s/proc/%d/stat"
+#define PROCFS_CMDLINE_TEMPLATE "%s/proc/%d/cmdline"
+
+/* Some processes have null-separated arguments (see proc(5)); let's fix it */
+static void join_cmdline_args(char *cmdline, size_t len) {
+  size_t i = len;
+  while (i && cmdline[i - 1] == 0) {
+    /* Skip past any trailing null characters */
+    --i;
+  }
+  while (i--) {
+    /* Replace null character between arguments with a space */
+    if (cmdline[i] == 0) { cmdline[i] = ' '; }
+  }
+}
 
 /* These are the guts that extract information out of /proc.
  * Anyone hoping to port wmtop should look here first. */
@@ -2993,9 +3017,10 @@ static void process_parse_stat(struct process *process) {
   char *lparen, *rparen;
   struct stat process_stat;
 
-  snprintf(filename, sizeof(filename), PROCFS_TEMPLATE, process->pid);
-  snprintf(cmdline_filename, sizeof(cmdline_filename), PROCFS_CMDLINE_TEMPLATE,
+  snprintf(filename, sizeof(filename), PROCFS_TEMPLATE, system_root.c_str(),
            process->pid);
+  snprintf(cmdline_filename, sizeof(cmdline_filename), PROCFS_CMDLINE_TEMPLATE,
+           system_root.c_str(), process->pid);
 
   ps = open(filename, O_RDONLY);
   if (ps == -1) {
@@ -3024,20 +3049,25 @@ static void process_parse_stat(struct process *process) {
   }
 
   endl = read(cmdline_ps, cmdline, BUFFER_LEN - 1);
-  close(cmdline_ps);
-  if (endl < 0) { return; }
-
-  /* Some processes have null-separated arguments (see proc(5)); let's fix it */
-  int i = endl;
-  while (i && cmdline[i - 1] == 0) {
-    /* Skip past any trailing null characters */
-    --i;
+  if (endl < 0) {
+    close(cmdline_ps);
+    return;
   }
-  while (i--) {
-    /* Replace null character between arguments with a space */
-    if (cmdline[i] == 0) { cmdline[i] = ' '; }
+  /* cmdline_to_pid matches against the whole command line, so one that
+   * doesn't fit in the buffer is read on in full */
+  std::string full_cmdline;
+  if (endl == BUFFER_LEN - 1) {
+    full_cmdline.assign(cmdline, endl);
+    char chunk[BUFFER_LEN];
+    ssize_t n;
+    while ((n = read(cmdline_ps, chunk, sizeof(chunk))) > 0) {
+      full_cmdline.append(chunk, n);
+    }
+    join_cmdline_args(full_cmdline.data(), full_cmdline.size());
   }
+  close(cmdline_ps);
 
+  join_cmdline_args(cmdline, endl);
   cmdline[endl] = 0;
 
   /* We want to transform for example "/usr/bin/python program.py" to "python
@@ -3094,6 +3124,11 @@ static void process_parse_stat(struct process *process) {
   free_and_zero(process->basename);
   process->name = strndup(procname, text_buffer_size.get(*::state));
   process->basename = strndup(basename, text_buffer_size.get(*::state));
+  const char *whole = full_cmdline.empty() ? cmdline : full_cmdline.c_str();
+  if (process->cmdline == nullptr || strcmp(process->cmdline, whole) != 0) {
+    free_and_zero(process->cmdline);
+    process->cmdline = strdup(whole);
+  }
   process->rss *= getpagesize();
 
   process->total_cpu_time = process->user_time + process->kernel_time;
@@ -3125,7 +3160,7 @@ static void process_parse_stat(struct process *process) {
 }
 
 #ifdef BUILD_IOSTATS
-#define PROCFS_TEMPLATE_IO "/proc/%d/io"
+#define PROCFS_TEMPLATE_IO "%s/proc/%d/io"
 static void process_parse_io(struct process *process) {
   static const char *read_bytes_str = "read_bytes:";
   static const char *write_bytes_str = "write_bytes:";
@@ -3136,7 +3171,8 @@ static void process_parse_io(struct process *process) {
   char *pos, *endpos;
   unsigned long long read_bytes, write_bytes;
 
-  snprintf(filename, sizeof(filename), PROCFS_TEMPLATE_IO, process->pid);
+  snprintf(filename, sizeof(filename), PROCFS_TEMPLATE_IO, system_root.c_str(),
+           process->pid);
 
   ps = open(filename, O_RDONLY);
   if (ps < 0) {
@@ -3215,8 +3251,9 @@ static void calculate_stats(struct process *process) {
 static void update_process_table(void) {
   DIR *dir;
   struct dirent *entry;
+  std::string path;
 
-  if (!(dir = opendir("/proc"))) { return; }
+  if (!(dir = opendir(system_path("/proc", path)))) { return; }
 
   info.run_procs = 0;
 
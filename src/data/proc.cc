@@ -29,16 +29,20 @@
 
 #include "proc.h"
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <cctype>
+#include <cerrno>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include "../conky.h"
 #include "../core.h"
 #include "../logging.h"
+#include "top.h"
 
 static const char *skip_proc_stat_comm(const char *stat) {
   if (stat == nullptr) { return nullptr; }
@@ -116,6 +120,236 @@ static bool parse_proc_stat_prio_nice(const char *after, long int *priority,
   return parsed == 17;
 }
 
+/* The pid_* objects of one update share what they learn about a process:
+ * its status, stat, io and cmdline files are each read and parsed at most
+ * once per update, on first use, into buffers that are reused from one
+ * update to the next.  A process that is gone just has nothing to show. */
+namespace {
+enum pid_vm_entry {
+  vm_peak,
+  vm_size,
+  vm_lck,
+  vm_hwm,
+  vm_rss,
+  vm_data,
+  vm_stk,
+  vm_exe,
+  vm_lib,
+  vm_pte,
+  vm_entries
+};
+
+const char *const pid_vm_keys[vm_entries] = {
+    "VmPeak", "VmSize", "VmLck", "VmHWM", "VmRSS",
+    "VmData", "VmStk",  "VmExe", "VmLib", "VmPTE"};
+
+/* the four ids of a Uid: or Gid: line */
+enum pid_id_field { id_real, id_effective, id_saved, id_fs, id_fields };
+
+struct pid_snapshot {
+  /* current_update_time of the update the fields belong to */
+  double update_time = -1;
+  /* which files were read during that update, and if that worked */
+  bool status_read = false, stat_read = false;
+  bool io_read = false, cmdline_read = false;
+  bool status_ok = false, stat_ok = false, io_ok = false, cmdline_ok = false;
+
+  /* status values, as text the way they are printed; empty if missing */
+  std::string state, ppid, threads;
+  std::string uid[id_fields], gid[id_fields];
+  std::string vm[vm_entries];
+
+  /* stat */
+  bool times_ok = false, prio_nice_ok = false;
+  unsigned long int utime = 0, stime = 0;
+  long int priority = 0, nice = 0;
+
+  /* io, whole "read_bytes: N" and "write_bytes: N" lines */
+  std::string read_bytes, write_bytes;
+
+  /* cmdline, arguments separated by spaces */
+  std::string cmdline;
+};
+
+std::unordered_map<std::string, pid_snapshot> pid_snapshots;
+double pid_snapshots_time = -1;
+
+/* scratch space for reading files, kept between reads */
+std::string proc_path, proc_file;
+
+/* reads PROCDIR/<pid>/<file> into proc_file */
+bool read_pid_file(const std::string &pid, const char *file,
+                   bool showerror) {
+  proc_path.assign(PROCDIR "/");
+  proc_path.append(pid).append("/").append(file);
+
+  int fd = open(proc_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (showerror) { LOG_ERROR("can't read '{}'", proc_path); }
+    return false;
+  }
+
+  size_t length = 0;
+  proc_file.clear();
+  for (;;) {
+    if (proc_file.size() < length + READSIZE * 8) {
+      proc_file.resize(length + READSIZE * 8);
+    }
+    ssize_t bytes_read = read(fd, &proc_file[length], READSIZE * 8);
+    if (bytes_read < 0 && errno == EINTR) { continue; }
+    if (bytes_read <= 0) { break; }
+    length += bytes_read;
+  }
+  close(fd);
+  proc_file.resize(length);
+  return true;
+}
+
+/* copies the text from begin up to the first of stop, or the line end */
+std::string &copy_field(std::string &to, const char *begin, char stop) {
+  const char *end = begin;
+  while (*end != '\0' && *end != '\n' && *end != stop) { ++end; }
+  return to.assign(begin, end);
+}
+
+void parse_pid_status(pid_snapshot &snapshot) {
+  snapshot.state.clear();
+  snapshot.ppid.clear();
+  snapshot.threads.clear();
+  for (auto &id : snapshot.uid) { id.clear(); }
+  for (auto &id : snapshot.gid) { id.clear(); }
+  for (auto &vm : snapshot.vm) { vm.clear(); }
+
+  const char *line = proc_file.c_str();
+  while (*line != '\0') {
+    const char *colon = strchr(line, ':');
+    const char *next = strchr(line, '\n');
+    if (colon == nullptr) { break; }
+    if (next != nullptr && next < colon) {
+      line = next + 1;
+      continue;
+    }
+
+    std::string key(line, colon);
+    const char *value = colon + 1;
+    while (*value == '\t' || *value == ' ') { ++value; }
+
+    if (key == "State") {
+      copy_field(snapshot.state, value, '\n');
+    } else if (key == "PPid") {
+      copy_field(snapshot.ppid, value, '\n');
+    } else if (key == "Threads") {
+      copy_field(snapshot.threads, value, '\n');
+    } else if (key == "Uid" || key == "Gid") {
+      std::string *ids = key == "Uid" ? snapshot.uid : snapshot.gid;
+      for (int i = 0; i < id_fields; ++i) {
+        copy_field(ids[i], value, '\t');
+        value += ids[i].size();
+        if (*value != '\t') { break; }
+        ++value;
+      }
+    } else if (key.compare(0, 2, "Vm") == 0) {
+      for (int i = 0; i < vm_entries; ++i) {
+        if (key == pid_vm_keys[i]) { copy_field(snapshot.vm[i], value, '\n'); }
+      }
+    }
+
+    if (next == nullptr) { break; }
+    line = next + 1;
+  }
+}
+
+void parse_pid_stat(pid_snapshot &snapshot) {
+  const char *buf = proc_file.c_str();
+  snapshot.times_ok = parse_proc_stat_times(buf, &snapshot.utime,
+                                            &snapshot.stime);
+  snapshot.prio_nice_ok = parse_proc_stat_prio_nice(
+      skip_proc_stat_comm(buf), &snapshot.priority, &snapshot.nice);
+}
+
+void parse_pid_io(pid_snapshot &snapshot) {
+  const char *buf = proc_file.c_str();
+  const char *begin;
+
+  snapshot.read_bytes.clear();
+  snapshot.write_bytes.clear();
+  if ((begin = strstr(buf, "read_bytes: ")) != nullptr) {
+    copy_field(snapshot.read_bytes, begin, '\n');
+  }
+  if ((begin = strstr(buf, "write_bytes: ")) != nullptr) {
+    copy_field(snapshot.write_bytes, begin, '\n');
+  }
+}
+
+void parse_pid_cmdline(pid_snapshot &snapshot) {
+  snapshot.cmdline.assign(proc_file);
+  /* the trailing NUL ends the string */
+  for (size_t i = 0; i + 1 < snapshot.cmdline.size(); i++) {
+    if (snapshot.cmdline[i] == 0) { snapshot.cmdline[i] = ' '; }
+  }
+  snapshot.cmdline.resize(strlen(snapshot.cmdline.c_str()));
+}
+
+/* the snapshot of the process named by the object's argument */
+pid_snapshot &get_pid_snapshot(const std::string &pid) {
+  if (pid_snapshots_time != current_update_time) {
+    /* forget processes nobody asked about during the previous update */
+    for (auto i = pid_snapshots.begin(); i != pid_snapshots.end();) {
+      if (i->second.update_time != pid_snapshots_time) {
+        i = pid_snapshots.erase(i);
+      } else {
+        ++i;
+      }
+    }
+    pid_snapshots_time = current_update_time;
+  }
+
+  pid_snapshot &snapshot = pid_snapshots[pid];
+  if (snapshot.update_time != current_update_time) {
+    snapshot.update_time = current_update_time;
+    snapshot.status_read = snapshot.stat_read = false;
+    snapshot.io_read = snapshot.cmdline_read = false;
+  }
+  return snapshot;
+}
+
+/* Returns the snapshot of the process with the file read in, or nullptr if
+ * it can't be read. */
+const pid_snapshot *pid_snapshot_with(const char *pid, bool pid_snapshot::*read,
+                                      bool pid_snapshot::*ok, const char *file,
+                                      void (*parse)(pid_snapshot &)) {
+  pid_snapshot &snapshot = get_pid_snapshot(pid);
+  if (!(snapshot.*read)) {
+    snapshot.*read = true;
+    snapshot.*ok = read_pid_file(pid, file, true);
+    if (snapshot.*ok) { parse(snapshot); }
+  }
+  return snapshot.*ok ? &snapshot : nullptr;
+}
+
+const pid_snapshot *pid_status(const char *pid) {
+  return pid_snapshot_with(pid, &pid_snapshot::status_read,
+                           &pid_snapshot::status_ok, "status",
+                           parse_pid_status);
+}
+
+const pid_snapshot *pid_stat(const char *pid) {
+  return pid_snapshot_with(pid, &pid_snapshot::stat_read,
+                           &pid_snapshot::stat_ok, "stat", parse_pid_stat);
+}
+
+const pid_snapshot *pid_io(const char *pid) {
+  return pid_snapshot_with(pid, &pid_snapshot::io_read, &pid_snapshot::io_ok,
+                           "io", parse_pid_io);
+}
+
+const pid_snapshot *pid_cmdline(const char *pid) {
+  return pid_snapshot_with(pid, &pid_snapshot::cmdline_read,
+                           &pid_snapshot::cmdline_ok, "cmdline",
+                           parse_pid_cmdline);
+}
+}  // namespace
+
 void pid_readlink(const char *file, char *p, unsigned int p_max_size) {
   std::unique_ptr<char[]> buf(new char[p_max_size]);
 
@@ -170,22 +404,14 @@ void print_pid_chroot(struct text_object *obj, char *p,
 
 void print_pid_cmdline(struct text_object *obj, char *p,
                        unsigned int p_max_size) {
-  char *buf;
-  int i, bytes_read;
-  std::ostringstream pathstream;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
 
   if (*(objbuf.get()) != 0) {
-    pathstream << PROCDIR "/" << objbuf.get() << "/cmdline";
-    buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-    if (buf != nullptr) {
-      for (i = 0; i < bytes_read - 1; i++) {
-        if (buf[i] == 0) { buf[i] = ' '; }
-      }
-      snprintf(p, p_max_size, "%s", buf);
-      free(buf);
+    const pid_snapshot *snapshot = pid_cmdline(objbuf.get());
+    if (snapshot != nullptr) {
+      snprintf(p, p_max_size, "%s", snapshot->cmdline.c_str());
     }
   } else {
     LOG_ERROR("$pid_cmdline did not receive an argument");
@@ -292,25 +518,14 @@ void print_pid_exe(struct text_object *obj, char *p, unsigned int p_max_size) {
 }
 
 void print_pid_nice(struct text_object *obj, char *p, unsigned int p_max_size) {
-  char *buf = nullptr;
-  int bytes_read;
-  long int nice_value;
-  const char *after = nullptr;
-  std::ostringstream pathstream;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
 
   if (!obj->data.s) {
-    pathstream << PROCDIR "/" << objbuf.get() << "/stat";
-    buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-    if (buf != nullptr) {
-      after = skip_proc_stat_comm(buf);
-      long int priority_value = 0;
-      if (parse_proc_stat_prio_nice(after, &priority_value, &nice_value)) {
-        snprintf(p, p_max_size, "%ld", nice_value);
-      }
-      free(buf);
+    const pid_snapshot *snapshot = pid_stat(objbuf.get());
+    if (snapshot != nullptr && snapshot->prio_nice_ok) {
+      snprintf(p, p_max_size, "%ld", snapshot->nice);
     }
   } else {
     LOG_ERROR("$pid_nice did not receive an argument");
@@ -367,52 +582,31 @@ void print_pid_openfiles(struct text_object *obj, char *p,
 
 void print_pid_parent(struct text_object *obj, char *p,
                       unsigned int p_max_size) {
-#define PARENT_ENTRY "PPid:\t"
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/status";
 
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, PARENT_ENTRY);
-    if (begin != nullptr) {
-      begin += strlen(PARENT_ENTRY);
-      end = strchr(begin, '\n');
-      if (end != nullptr) { *(end) = 0; }
-      snprintf(p, p_max_size, "%s", begin);
+  const pid_snapshot *snapshot = pid_status(objbuf.get());
+  if (snapshot != nullptr) {
+    if (!snapshot->ppid.empty()) {
+      snprintf(p, p_max_size, "%s", snapshot->ppid.c_str());
     } else {
-      LOG_ERROR("can't find the process parent in '{}'",
-                pathstream.str().c_str());
+      LOG_ERROR("can't find the process parent in '" PROCDIR "/{}/status'",
+                objbuf.get());
     }
-    free(buf);
   }
 }
 
 void print_pid_priority(struct text_object *obj, char *p,
                         unsigned int p_max_size) {
-  char *buf = nullptr;
-  int bytes_read;
-  long int priority;
-  const char *after = nullptr;
-  std::ostringstream pathstream;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
 
   if (*(objbuf.get()) != 0) {
-    pathstream << PROCDIR "/" << objbuf.get() << "/stat";
-    buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-    if (buf != nullptr) {
-      after = skip_proc_stat_comm(buf);
-      long int nice_value = 0;
-      if (parse_proc_stat_prio_nice(after, &priority, &nice_value)) {
-        snprintf(p, p_max_size, "%ld", priority);
-      }
-      free(buf);
+    const pid_snapshot *snapshot = pid_stat(objbuf.get());
+    if (snapshot != nullptr && snapshot->prio_nice_ok) {
+      snprintf(p, p_max_size, "%ld", snapshot->priority);
     }
   } else {
     LOG_ERROR("$pid_priority did not receive an argument");
@@ -421,57 +615,40 @@ void print_pid_priority(struct text_object *obj, char *p,
 
 void print_pid_state(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-#define STATE_ENTRY "State:\t"
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/status";
 
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, STATE_ENTRY);
-    if (begin != nullptr) {
-      begin += strlen(STATE_ENTRY) +
-               3;  // +3 will strip the char representing the short state and
-                   // the space and '(' that follow
-      end = strchr(begin, '\n');
-      if (end != nullptr) {
-        *(end - 1) = 0;  // -1 strips the ')'
-      }
-      snprintf(p, p_max_size, "%s", begin);
+  const pid_snapshot *snapshot = pid_status(objbuf.get());
+  if (snapshot != nullptr) {
+    /* "S (sleeping)", the long state is what's in the parentheses */
+    const std::string &state_text = snapshot->state;
+    if (state_text.size() > 3) {
+      size_t length = state_text.size() - 3;
+      if (state_text.back() == ')') { --length; }
+      snprintf(p, p_max_size, "%.*s", static_cast<int>(length),
+               state_text.c_str() + 3);
     } else {
-      LOG_ERROR("can't find the process state in '{}'",
-                pathstream.str().c_str());
+      LOG_ERROR("can't find the process state in '" PROCDIR "/{}/status'",
+                objbuf.get());
     }
-    free(buf);
   }
 }
 
 void print_pid_state_short(struct text_object *obj, char *p,
                            unsigned int p_max_size) {
-  char *begin, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
 
-  pathstream << PROCDIR "/" << objbuf.get() << "/status";
-
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, STATE_ENTRY);
-    if (begin != nullptr) {
-      begin += strlen(STATE_ENTRY);
-      if (*begin != 0) { snprintf(p, p_max_size, "%c", *begin); }
+  const pid_snapshot *snapshot = pid_status(objbuf.get());
+  if (snapshot != nullptr) {
+    if (!snapshot->state.empty()) {
+      snprintf(p, p_max_size, "%c", snapshot->state[0]);
     } else {
-      LOG_ERROR("can't find the process state in '{}'",
-                pathstream.str().c_str());
+      LOG_ERROR("can't find the process state in '" PROCDIR "/{}/status'",
+                objbuf.get());
     }
-    free(buf);
   }
 }
 
@@ -511,10 +688,6 @@ void print_pid_stdout(struct text_object *obj, char *p,
 void scan_cmdline_to_pid_arg(struct text_object *obj, const char *arg,
                              void *free_at_crash) {
   unsigned int i;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
-
-  /* FIXME */
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
 
   if (strlen(arg) > 0) {
     obj->data.s = strdup(arg);
@@ -534,72 +707,26 @@ void scan_cmdline_to_pid_arg(struct text_object *obj, const char *arg,
 
 void print_cmdline_to_pid(struct text_object *obj, char *p,
                           unsigned int p_max_size) {
-  DIR *dir;
-  struct dirent *entry;
-  char *buf;
-  int bytes_read, i;
-  std::ostringstream pathstream;
-
-  dir = opendir(PROCDIR);
-  if (dir != nullptr) {
-    while ((entry = readdir(dir)) != nullptr) {
-      bool numeric = true;
-      for (const char *ch = entry->d_name; *ch != '\0'; ++ch) {
-        if (!std::isdigit(static_cast<unsigned char>(*ch))) {
-          numeric = false;
-          break;
-        }
-      }
-      if (!numeric) { continue; }
-
-      pathstream.str("");
-      pathstream.clear();
-      pathstream << PROCDIR "/" << entry->d_name << "/cmdline";
-
-      buf = readfile(pathstream.str().c_str(), &bytes_read, 0);
-      if (buf != nullptr) {
-        for (i = 0; i < bytes_read - 1; i++) {
-          if (buf[i] == 0) { buf[i] = ' '; }
-        }
-        if (strstr(buf, obj->data.s) != nullptr) {
-          snprintf(p, p_max_size, "%s", entry->d_name);
-          free(buf);
-          closedir(dir);
-          return;
-        }
-        free(buf);
-      }
-    }
-    closedir(dir);
-  } else {
-    LOG_ERROR("can't read '{}'", PROCDIR);
-  }
+  pid_t pid = get_pid_by_cmdline(obj->data.s);
+  if (pid != -1) { snprintf(p, p_max_size, "%d", pid); }
 }
 
 void print_pid_threads(struct text_object *obj, char *p,
                        unsigned int p_max_size) {
-#define THREADS_ENTRY "Threads:\t"
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/status";
 
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, THREADS_ENTRY);
-    if (begin != nullptr) {
-      begin += strlen(THREADS_ENTRY);
-      end = strchr(begin, '\n');
-      if (end != nullptr) { *(end) = 0; }
-      snprintf(p, p_max_size, "%s", begin);
+  const pid_snapshot *snapshot = pid_status(objbuf.get());
+  if (snapshot != nullptr) {
+    if (!snapshot->threads.empty()) {
+      snprintf(p, p_max_size, "%s", snapshot->threads.c_str());
     } else {
-      LOG_ERROR("can't find the number of the threads of the process in '{}'",
-                pathstream.str().c_str());
+      LOG_ERROR(
+          "can't find the number of the threads of the process in "
+          "'" PROCDIR "/{}/status'",
+          objbuf.get());
     }
-    free(buf);
   }
 }
 
@@ -641,23 +768,15 @@ void print_pid_thread_list(struct text_object *obj, char *p,
 
 void print_pid_time_kernelmode(struct text_object *obj, char *p,
                                unsigned int p_max_size) {
-  char *buf = nullptr;
-  int bytes_read;
-  unsigned long int utime = 0;
-  unsigned long int stime = 0;
-  std::ostringstream pathstream;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
 
   if (*(objbuf.get()) != 0) {
-    pathstream << PROCDIR "/" << objbuf.get() << "/stat";
-    buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-    if (buf != nullptr) {
-      if (parse_proc_stat_times(buf, &utime, &stime)) {
-        snprintf(p, p_max_size, "%.2f", static_cast<float>(stime) / 100);
-      }
-      free(buf);
+    const pid_snapshot *snapshot = pid_stat(objbuf.get());
+    if (snapshot != nullptr && snapshot->times_ok) {
+      snprintf(p, p_max_size, "%.2f",
+               static_cast<float>(snapshot->stime) / 100);
     }
   } else {
     LOG_ERROR("$pid_time_kernelmode did not receive an argument");
@@ -666,23 +785,15 @@ void print_pid_time_kernelmode(struct text_object *obj, char *p,
 
 void print_pid_time_usermode(struct text_object *obj, char *p,
                              unsigned int p_max_size) {
-  char *buf = nullptr;
-  int bytes_read;
-  unsigned long int utime = 0;
-  unsigned long int stime = 0;
-  std::ostringstream pathstream;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
 
   if (*(objbuf.get()) != 0) {
-    pathstream << PROCDIR "/" << objbuf.get() << "/stat";
-    buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-    if (buf != nullptr) {
-      if (parse_proc_stat_times(buf, &utime, &stime)) {
-        snprintf(p, p_max_size, "%.2f", static_cast<float>(utime) / 100);
-      }
-      free(buf);
+    const pid_snapshot *snapshot = pid_stat(objbuf.get());
+    if (snapshot != nullptr && snapshot->times_ok) {
+      snprintf(p, p_max_size, "%.2f",
+               static_cast<float>(snapshot->utime) / 100);
     }
   } else {
     LOG_ERROR("$pid_time_usermode did not receive an argument");
@@ -690,24 +801,15 @@ void print_pid_time_usermode(struct text_object *obj, char *p,
 }
 
 void print_pid_time(struct text_object *obj, char *p, unsigned int p_max_size) {
-  char *buf = nullptr;
-  int bytes_read;
-  unsigned long int utime = 0;
-  unsigned long int stime = 0;
-  std::ostringstream pathstream;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
 
   if (*(objbuf.get()) != 0) {
-    pathstream << PROCDIR "/" << objbuf.get() << "/stat";
-    buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-    if (buf != nullptr) {
-      if (parse_proc_stat_times(buf, &utime, &stime)) {
-        snprintf(p, p_max_size, "%.2f",
-                 static_cast<float>(utime + stime) / 100);
-      }
-      free(buf);
+    const pid_snapshot *snapshot = pid_stat(objbuf.get());
+    if (snapshot != nullptr && snapshot->times_ok) {
+      snprintf(p, p_max_size, "%.2f",
+               static_cast<float>(snapshot->utime + snapshot->stime) / 100);
     }
   } else {
     LOG_ERROR("$pid_time did not receive an argument");
@@ -718,90 +820,44 @@ enum xid_type { egid, euid, fsgid, fsuid, gid, sgid, suid, uid };
 
 void print_pid_Xid(struct text_object *obj, char *p, int p_max_size,
                    xid_type type) {
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
   std::string errorstring;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/status";
 
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
+  const pid_snapshot *snapshot = pid_status(objbuf.get());
+  if (snapshot != nullptr) {
+    const std::string *id = nullptr;
     switch (type) {
       case egid:
-        begin = strstr(buf, "Gid:\t");
+        id = &snapshot->gid[id_effective];
         break;
       case euid:
-        begin = strstr(buf, "Uid:\t");
+        id = &snapshot->uid[id_effective];
         break;
       case fsgid:
-        begin = strstr(buf, "Gid:\t");
+        id = &snapshot->gid[id_fs];
         break;
       case fsuid:
-        begin = strstr(buf, "Uid:\t");
+        id = &snapshot->uid[id_fs];
         break;
       case gid:
-        begin = strstr(buf, "Gid:\t");
+        id = &snapshot->gid[id_real];
         break;
       case sgid:
-        begin = strstr(buf, "Gid:\t");
+        id = &snapshot->gid[id_saved];
         break;
       case suid:
-        begin = strstr(buf, "Uid:\t");
+        id = &snapshot->uid[id_saved];
         break;
       case uid:
-        begin = strstr(buf, "Uid:\t");
+        id = &snapshot->uid[id_real];
         break;
       default:
         break;
     }
-    if (begin != nullptr) {
-      switch (type) {
-        case gid:
-          begin += strlen("Gid:\t");
-          break;
-        case uid:
-          begin += strlen("Uid:\t");
-          break;
-        case egid:
-        case euid:
-          begin = strchr(begin, '\t');
-          begin++;
-          begin = strchr(begin, '\t');
-          begin++;
-          break;
-        case sgid:
-        case suid:
-          begin = strchr(begin, '\t');
-          begin++;
-          begin = strchr(begin, '\t');
-          begin++;
-          begin = strchr(begin, '\t');
-          begin++;
-          break;
-        case fsgid:
-        case fsuid:
-          begin = strchr(begin, '\t');
-          begin++;
-          begin = strchr(begin, '\t');
-          begin++;
-          begin = strchr(begin, '\t');
-          begin++;
-          begin = strchr(begin, '\t');
-          begin++;
-          break;
-        default:
-          break;
-      }
-      if (type == fsgid || type == fsuid) {
-        end = strchr(begin, '\n');
-      } else {
-        end = strchr(begin, '\t');
-      }
-      if (end != nullptr) { *(end) = 0; }
-      snprintf(p, p_max_size, "%s", begin);
+    if (id != nullptr && !id->empty()) {
+      snprintf(p, p_max_size, "%s", id->c_str());
     } else {
       errorstring = "Can't find the process ";
       switch (type) {
@@ -832,10 +888,9 @@ void print_pid_Xid(struct text_object *obj, char *p, int p_max_size,
         default:
           break;
       }
-      errorstring.append(" in '{}'");
-      LOG_ERROR(errorstring.c_str(), pathstream.str().c_str());
+      errorstring.append(" in '" PROCDIR "/{}/status'");
+      LOG_ERROR(errorstring.c_str(), objbuf.get());
     }
-    free(buf);
   }
 }
 
@@ -874,142 +929,115 @@ void print_pid_uid(struct text_object *obj, char *p, unsigned int p_max_size) {
 }
 
 void internal_print_pid_vm(struct text_object *obj, char *p, int p_max_size,
-                           const char *entry, const char *errorstring) {
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
+                           pid_vm_entry entry, const char *errorstring) {
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/status";
 
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, entry);
-    if (begin != nullptr) {
-      begin += strlen(entry);
-      while (*begin == '\t' || *begin == ' ') { begin++; }
-      end = strchr(begin, '\n');
-      if (end != nullptr) { *(end) = 0; }
-      snprintf(p, p_max_size, "%s", begin);
+  const pid_snapshot *snapshot = pid_status(objbuf.get());
+  if (snapshot != nullptr) {
+    if (!snapshot->vm[entry].empty()) {
+      snprintf(p, p_max_size, "%s", snapshot->vm[entry].c_str());
     } else {
-      LOG_ERROR(errorstring, pathstream.str().c_str());
+      LOG_ERROR(errorstring, PROCDIR "/" + std::string(objbuf.get()) +
+                                 "/status");
     }
-    free(buf);
   }
 }
 
 void print_pid_vmpeak(struct text_object *obj, char *p,
                       unsigned int p_max_size) {
   internal_print_pid_vm(
-      obj, p, p_max_size, "VmPeak:\t",
-      "Can't find the process peak virtual memory size in '%s'");
+      obj, p, p_max_size, vm_peak,
+      "Can't find the process peak virtual memory size in '{}'");
 }
 
 void print_pid_vmsize(struct text_object *obj, char *p,
                       unsigned int p_max_size) {
-  internal_print_pid_vm(obj, p, p_max_size, "VmSize:\t",
-                        "Can't find the process virtual memory size in '%s'");
+  internal_print_pid_vm(obj, p, p_max_size, vm_size,
+                        "Can't find the process virtual memory size in '{}'");
 }
 
 void print_pid_vmlck(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  internal_print_pid_vm(obj, p, p_max_size, "VmLck:\t",
-                        "Can't find the process locked memory size in '%s'");
+  internal_print_pid_vm(obj, p, p_max_size, vm_lck,
+                        "Can't find the process locked memory size in '{}'");
 }
 
 void print_pid_vmhwm(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
   internal_print_pid_vm(
-      obj, p, p_max_size, "VmHWM:\t",
-      "Can't find the process peak resident set size in '%s'");
+      obj, p, p_max_size, vm_hwm,
+      "Can't find the process peak resident set size in '{}'");
 }
 
 void print_pid_vmrss(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  internal_print_pid_vm(obj, p, p_max_size, "VmRSS:\t",
-                        "Can't find the process resident set size in '%s'");
+  internal_print_pid_vm(obj, p, p_max_size, vm_rss,
+                        "Can't find the process resident set size in '{}'");
 }
 
 void print_pid_vmdata(struct text_object *obj, char *p,
                       unsigned int p_max_size) {
-  internal_print_pid_vm(obj, p, p_max_size, "VmData:\t",
-                        "Can't find the process data segment size in '%s'");
+  internal_print_pid_vm(obj, p, p_max_size, vm_data,
+                        "Can't find the process data segment size in '{}'");
 }
 
 void print_pid_vmstk(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  internal_print_pid_vm(obj, p, p_max_size, "VmStk:\t",
-                        "Can't find the process stack segment size in '%s'");
+  internal_print_pid_vm(obj, p, p_max_size, vm_stk,
+                        "Can't find the process stack segment size in '{}'");
 }
 
 void print_pid_vmexe(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  internal_print_pid_vm(obj, p, p_max_size, "VmExe:\t",
-                        "Can't find the process text segment size in '%s'");
+  internal_print_pid_vm(obj, p, p_max_size, vm_exe,
+                        "Can't find the process text segment size in '{}'");
 }
 
 void print_pid_vmlib(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
   internal_print_pid_vm(
-      obj, p, p_max_size, "VmLib:\t",
-      "Can't find the process shared library code size in '%s'");
+      obj, p, p_max_size, vm_lib,
+      "Can't find the process shared library code size in '{}'");
 }
 
 void print_pid_vmpte(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
   internal_print_pid_vm(
-      obj, p, p_max_size, "VmPTE:\t",
-      "Can't find the process page table entries size in '%s'");
+      obj, p, p_max_size, vm_pte,
+      "Can't find the process page table entries size in '{}'");
 }
 
-#define READ_ENTRY "read_bytes: "
 void print_pid_read(struct text_object *obj, char *p, unsigned int p_max_size) {
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/io";
 
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, READ_ENTRY);
-    if (begin != nullptr) {
-      end = strchr(begin, '\n');
-      if (end != nullptr) { *(end) = 0; }
-      snprintf(p, p_max_size, "%s", begin);
+  const pid_snapshot *snapshot = pid_io(objbuf.get());
+  if (snapshot != nullptr) {
+    if (!snapshot->read_bytes.empty()) {
+      snprintf(p, p_max_size, "%s", snapshot->read_bytes.c_str());
     } else {
-      LOG_ERROR("can't find the amount of bytes read in '{}'",
-                pathstream.str().c_str());
+      LOG_ERROR("can't find the amount of bytes read in '" PROCDIR "/{}/io'",
+                objbuf.get());
     }
-    free(buf);
   }
 }
 
-#define WRITE_ENTRY "write_bytes: "
 void print_pid_write(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
   std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
 
   generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/io";
 
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, WRITE_ENTRY);
-    if (begin != nullptr) {
-      end = strchr(begin, '\n');
-      if (end != nullptr) { *(end) = 0; }
-      snprintf(p, p_max_size, "%s", begin);
+  const pid_snapshot *snapshot = pid_io(objbuf.get());
+  if (snapshot != nullptr) {
+    if (!snapshot->write_bytes.empty()) {
+      snprintf(p, p_max_size, "%s", snapshot->write_bytes.c_str());
     } else {
-      LOG_ERROR("can't find the amount of bytes written in '{}'",
-                pathstream.str().c_str());
+      LOG_ERROR("can't find the amount of bytes written in '" PROCDIR "/{}/io'",
+                objbuf.get());
     }
-    free(buf);
   }
 }
@@ -30,18 +30,233 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cctype>
+#include <cerrno>
 #include <cstring>
+#include <deque>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include "../common.h"
 #include "../conky.h"
 #include "../content/text_object.h"
 #include "../logging.h"
 #include "config.h"
 
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif /* HAVE_SYS_INOTIFY_H */
+
 #define MAX_HEADTAIL_LINES 30
 #define DEFAULT_MAX_HEADTAIL_USES 2
 
+namespace {
+/*
+ * A file shared by all the $head, $tail, $lines and $words objects that
+ * display it. It keeps the file open and remembers how much of it was
+ * already read, so an update only reads the bytes appended since the previous
+ * one. Truncation (size going down) and rotation (a different inode at the
+ * path) start over from scratch.
+ *
+ * Where inotify is available, a file is only stat()ed after inotify reported
+ * a change to it; otherwise it's stat()ed on every update.
+ */
+struct watched_file {
+  std::string path;
+  int fd{-1};
+  int wd{-1};
+  dev_t dev{0};
+  ino_t ino{0};
+  off_t size{0};  // bytes read so far
+  bool changed{true};
+  bool count_all{false};  // $lines/$words need the whole file read
+  int reported{0};
+
+  unsigned long generation{0};  // bumped whenever new bytes were read
+  unsigned long resets{0};      // bumped when the file is read from scratch
+
+  unsigned long newlines{0};
+  unsigned long words{0};
+  bool in_word{false};
+  char last_char{0};
+  // offsets where the last MAX_HEADTAIL_LINES + 1 lines start
+  std::deque<off_t> line_starts;
+
+  explicit watched_file(std::string path_) : path(std::move(path_)) {}
+  ~watched_file();
+};
+
+std::unordered_map<std::string, std::weak_ptr<watched_file>> watched_files;
+
+#ifdef HAVE_SYS_INOTIFY_H
+int watch_fd = -1;
+double last_drain_time = -1;
+
+void add_watch(watched_file &f) {
+  if (watch_fd == -1) {
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd == -1) { return; }
+  }
+  f.wd = inotify_add_watch(watch_fd, f.path.c_str(),
+                           IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF |
+                               IN_DELETE_SELF);
+}
+
+void remove_watch(watched_file &f) {
+  if (f.wd != -1) { inotify_rm_watch(watch_fd, f.wd); }
+  f.wd = -1;
+}
+
+/* marks the files inotify reported changes for; done once per update */
+void drain_events() {
+  if (watch_fd == -1 || last_drain_time == current_update_time) { return; }
+  last_drain_time = current_update_time;
+
+  alignas(struct inotify_event) char buf[4096];
+  ssize_t len;
+  while ((len = read(watch_fd, buf, sizeof(buf))) > 0) {
+    for (ssize_t i = 0; i < len;) {
+      auto *ev = reinterpret_cast<struct inotify_event *>(buf + i);
+      for (auto &entry : watched_files) {
+        auto f = entry.second.lock();
+        if (!f || f->wd != ev->wd) { continue; }
+        f->changed = true;
+        // the watch follows the inode; after a rename or delete we fall back
+        // to stat() until the path can be reopened
+        if ((ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) != 0) {
+          remove_watch(*f);
+        }
+      }
+      i += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+}
+#else
+void add_watch(watched_file &) {}
+void remove_watch(watched_file &) {}
+void drain_events() {}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+watched_file::~watched_file() {
+  remove_watch(*this);
+  if (fd != -1) { close(fd); }
+  auto it = watched_files.find(path);
+  if (it != watched_files.end() && it->second.expired()) {
+    watched_files.erase(it);
+  }
+}
+
+std::shared_ptr<watched_file> watch_file(const std::string &path,
+                                         bool count_all) {
+  auto &entry = watched_files[path];
+  auto f = entry.lock();
+  if (!f) {
+    f = std::make_shared<watched_file>(path);
+    entry = f;
+  }
+  if (count_all && !f->count_all) {
+    // so far only the end of the file was read
+    f->count_all = true;
+    f->changed = true;
+    if (f->fd != -1) {
+      close(f->fd);
+      f->fd = -1;
+    }
+  }
+  return f;
+}
+
+void scan(watched_file &f, off_t to) {
+  char buf[0x10000];
+
+  while (f.size < to) {
+    ssize_t len = pread(f.fd, buf,
+                        std::min<off_t>(sizeof(buf), to - f.size), f.size);
+    if (len <= 0) { break; }
+    for (ssize_t i = 0; i < len; i++) {
+      char c = buf[i];
+      if (c == '\n') {
+        f.newlines++;
+        f.line_starts.push_back(f.size + i + 1);
+        if (f.line_starts.size() > MAX_HEADTAIL_LINES + 1) {
+          f.line_starts.pop_front();
+        }
+      }
+      if (isspace(static_cast<unsigned char>(c)) == 0) {
+        if (!f.in_word) {
+          f.words++;
+          f.in_word = true;
+        }
+      } else {
+        f.in_word = false;
+      }
+    }
+    f.last_char = buf[len - 1];
+    f.size += len;
+    f.generation++;
+  }
+}
+
+/* (re)opens the file and starts reading it from scratch */
+bool reopen(watched_file &f) {
+  if (f.fd != -1) { close(f.fd); }
+  remove_watch(f);
+
+  f.fd = open(f.path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st{};
+  if (f.fd == -1 || fstat(f.fd, &st) != 0) {
+    if (f.reported == 0) {
+      LOG_ERROR("can't open file '{}': {}", f.path, strerror(errno));
+      f.reported = 1;
+    }
+    if (f.fd != -1) { close(f.fd); }
+    f.fd = -1;
+    return false;
+  }
+  add_watch(f);
+
+  f.dev = st.st_dev;
+  f.ino = st.st_ino;
+  f.newlines = 0;
+  f.words = 0;
+  f.in_word = false;
+  f.last_char = 0;
+  f.line_starts.clear();
+  // $head and $tail can't show more than a text buffer from either end, so
+  // without $lines/$words there's no need to read the middle of the file
+  off_t window = text_buffer_size.get(*state);
+  f.size = f.count_all ? 0 : std::max<off_t>(0, st.st_size - window);
+  f.line_starts.push_back(f.size);
+  f.resets++;
+  f.generation++;
+  return true;
+}
+
+/* brings the index up to date; returns false if the file can't be read */
+bool refresh(watched_file &f) {
+  drain_events();
+  if (f.fd != -1 && f.wd != -1 && !f.changed) { return true; }
+  f.changed = false;
+
+  struct stat st{};
+  if (stat(f.path.c_str(), &st) != 0) {
+    if (f.fd != -1) { close(f.fd); }
+    f.fd = -1;
+    remove_watch(f);
+    return false;
+  }
+  if (f.fd == -1 || st.st_dev != f.dev || st.st_ino != f.ino ||
+      st.st_size < f.size) {
+    if (!reopen(f)) { return false; }
+  } else if (f.wd == -1) {
+    add_watch(f);
+  }
+  scan(f, st.st_size);
+  return true;
+}
+}  // namespace
+
 struct headtail {
   int wantedlines{0};
   std::string logfile;
@@ -49,6 +264,10 @@ struct headtail {
   int current_use{0};
   int max_uses{0};
   int reported{0};
+  std::shared_ptr<watched_file> file;
+  unsigned long generation{0};
+  unsigned long resets{0};
+  bool head_complete{false};  // buffer holds all the wanted lines
 
   headtail() = default;
 
@@ -108,14 +327,10 @@ void init_tailhead(const char *type, const char *arg, struct text_object *obj) {
   obj->callbacks.free = &free_tailhead;
 }
 
-static void print_tailhead(const char *type, struct text_object *obj, char *p,
-                           unsigned int p_max_size) {
-  int fd, i, endofstring = 0, linescounted = 0;
-  FILE *fp;
-  struct stat st{};
-  auto *ht = static_cast<struct headtail *>(obj->data.opaque);
-
-  if (ht == nullptr) { return; }
+/* FIFOs can't be indexed, reading them consumes the data */
+static void print_fifo_tailhead(const char *type, struct headtail *ht, char *p,
+                                unsigned int p_max_size) {
+  int i, linescounted = 0;
 
   // empty the buffer and reset the counter if we used it the max number of
   // times
@@ -127,56 +342,116 @@ static void print_tailhead(const char *type, struct text_object *obj, char *p,
   if (ht->buffer != nullptr) {
     strncpy(p, ht->buffer, p_max_size);
     ht->current_use++;
-  } else {  // otherwise find the needed data
-    if (stat(ht->logfile.c_str(), &st) == 0) {
-      if (S_ISFIFO(st.st_mode)) {
-        fd = open_fifo(ht->logfile.c_str(), &ht->reported);
-        if (fd != -1) {
-          if (strcmp(type, "head") == 0) {
-            for (i = 0; linescounted < ht->wantedlines; i++) {
-              if (read(fd, p + i, 1) <= 0) { break; }
-              if (p[i] == '\n') { linescounted++; }
-            }
-            p[i] = 0;
-          } else if (strcmp(type, "tail") == 0) {
-            i = read(fd, p, p_max_size - 1);
-            tailstring(p, i, ht->wantedlines);
-          } else {
-            CRIT_ERR(
-                "If you are seeing this then there is a bug in the code, "
-                "report it !");
-          }
-        }
-        close(fd);
-      } else {
-        fp = open_file(ht->logfile.c_str(), &ht->reported);
-        if (fp != nullptr) {
-          if (strcmp(type, "head") == 0) {
-            for (i = 0; i < ht->wantedlines; i++) {
-              if (fgets(p + endofstring, p_max_size - endofstring, fp) ==
-                  nullptr) {
-                break;
-              }
-              endofstring = strlen(p);
-            }
-          } else if (strcmp(type, "tail") == 0) {
-            fseek(fp, -static_cast<long>(p_max_size), SEEK_END);
-            i = fread(p, 1, p_max_size - 1, fp);
-            tailstring(p, i, ht->wantedlines);
-          } else {
-            CRIT_ERR(
-                "If you are seeing this then there is a bug in the code, "
-                "report it !");
-          }
-          fclose(fp);
-        }
+    return;
+  }
+
+  int fd = open_fifo(ht->logfile.c_str(), &ht->reported);
+  if (fd != -1) {
+    if (strcmp(type, "head") == 0) {
+      for (i = 0; linescounted < ht->wantedlines; i++) {
+        if (read(fd, p + i, 1) <= 0) { break; }
+        if (p[i] == '\n') { linescounted++; }
       }
-      ht->buffer = strdup(p);
+      p[i] = 0;
+    } else if (strcmp(type, "tail") == 0) {
+      i = read(fd, p, p_max_size - 1);
+      tailstring(p, i, ht->wantedlines);
     } else {
+      CRIT_ERR(
+          "If you are seeing this then there is a bug in the code, "
+          "report it !");
+    }
+  }
+  close(fd);
+  ht->buffer = strdup(p);
+}
+
+static void read_head(watched_file &f, int wantedlines, char *p,
+                      unsigned int p_max_size) {
+  size_t len = std::min<off_t>(f.size, p_max_size - 1);
+  ssize_t got = pread(f.fd, p, len, 0);
+  if (got < 0) { got = 0; }
+  p[got] = 0;
+
+  int linescounted = 0;
+  for (ssize_t i = 0; i < got; i++) {
+    if (p[i] == '\n' && ++linescounted == wantedlines) {
+      p[i + 1] = 0;
+      break;
+    }
+  }
+}
+
+static void read_tail(watched_file &f, int wantedlines, char *p,
+                      unsigned int p_max_size) {
+  // work with or without \n at end of file
+  off_t end = f.size;
+  if (end > 0 && f.last_char == '\n') { end--; }
+
+  off_t start = f.line_starts.front();
+  int linescounted = 0;
+  for (auto it = f.line_starts.rbegin(); it != f.line_starts.rend(); ++it) {
+    if (*it > end) { continue; }
+    start = *it;
+    if (++linescounted == wantedlines) { break; }
+  }
+  start = std::max<off_t>(start, f.size - (p_max_size - 1));
+  start = std::min(start, end);
+
+  ssize_t got = pread(f.fd, p, end - start, start);
+  p[got > 0 ? got : 0] = 0;
+}
+
+static void print_tailhead(const char *type, struct text_object *obj, char *p,
+                           unsigned int p_max_size) {
+  struct stat st{};
+  auto *ht = static_cast<struct headtail *>(obj->data.opaque);
+
+  if (ht == nullptr) { return; }
+
+  if (!ht->file) {
+    if (stat(ht->logfile.c_str(), &st) != 0) {
+      SYSTEM_ERR("${} can't find information about '{}'", type,
+                 ht->logfile.c_str());
+    }
+    if (S_ISFIFO(st.st_mode)) {
+      print_fifo_tailhead(type, ht, p, p_max_size);
+      return;
+    }
+    ht->file = watch_file(ht->logfile, false);
+  }
+
+  watched_file &f = *ht->file;
+  if (!refresh(f)) {
+    if (stat(ht->logfile.c_str(), &st) != 0) {
       SYSTEM_ERR("${} can't find information about '{}'", type,
                  ht->logfile.c_str());
     }
+    p[0] = 0;
+    return;
+  }
+
+  bool is_head = strcmp(type, "head") == 0;
+  // the head of a file only changes when it's rewritten, or while it's
+  // still shorter than the wanted lines
+  bool unchanged = ht->generation == f.generation ||
+                   (is_head && ht->resets == f.resets && ht->head_complete);
+  if (ht->buffer != nullptr && unchanged) {
+    strncpy(p, ht->buffer, p_max_size);
+    return;
+  }
+
+  if (is_head) {
+    read_head(f, ht->wantedlines, p, p_max_size);
+    ht->head_complete =
+        std::count(p, p + strlen(p), '\n') >= ht->wantedlines;
+  } else {
+    read_tail(f, ht->wantedlines, p, p_max_size);
   }
+  free(ht->buffer);
+  ht->buffer = strdup(p);
+  ht->generation = f.generation;
+  ht->resets = f.resets;
 }
 
 void print_head(struct text_object *obj, char *p, unsigned int p_max_size) {
@@ -187,55 +462,37 @@ void print_tail(struct text_object *obj, char *p, unsigned int p_max_size) {
   print_tailhead("tail", obj, p, p_max_size);
 }
 
-/* FIXME: use something more general (see also tail.c, head.c */
-#define BUFSZ 0x1000
+struct filecount {
+  std::shared_ptr<watched_file> file;
+};
+
+static void free_filecount(struct text_object *obj) {
+  delete static_cast<struct filecount *>(obj->data.opaque);
+}
+
+void init_filecount(const char *arg, struct text_object *obj) {
+  auto *fc = new filecount;
+  fc->file = watch_file(to_real_path(arg), true);
+  obj->data.opaque = fc;
+  obj->callbacks.free = &free_filecount;
+}
 
 void print_lines(struct text_object *obj, char *p, unsigned int p_max_size) {
-  static int rep = 0;
-  FILE *fp = open_file(obj->data.s, &rep);
-  char buf[BUFSZ];
-  int j, lines;
+  auto *fc = static_cast<struct filecount *>(obj->data.opaque);
 
-  if (fp == nullptr) {
+  if (fc == nullptr || !refresh(*fc->file)) {
     snprintf(p, p_max_size, "%s", "File Unreadable");
     return;
   }
-
-  lines = 0;
-  while (fgets(buf, BUFSZ, fp) != nullptr) {
-    for (j = 0; buf[j] != 0; j++) {
-      if (buf[j] == '\n') { lines++; }
-    }
-  }
-  snprintf(p, p_max_size, "%d", lines);
-  fclose(fp);
+  snprintf(p, p_max_size, "%lu", fc->file->newlines);
 }
 
 void print_words(struct text_object *obj, char *p, unsigned int p_max_size) {
-  static int rep = 0;
-  FILE *fp = open_file(obj->data.s, &rep);
-  char buf[BUFSZ];
-  int j, words;
-  char inword = 0;
+  auto *fc = static_cast<struct filecount *>(obj->data.opaque);
 
-  if (fp == nullptr) {
+  if (fc == nullptr || !refresh(*fc->file)) {
     snprintf(p, p_max_size, "%s", "File Unreadable");
     return;
   }
-
-  words = 0;
-  while (fgets(buf, BUFSZ, fp) != nullptr) {
-    for (j = 0; buf[j] != 0; j++) {
-      if (isspace(static_cast<unsigned char>(buf[j])) == 0) {
-        if (inword == 0) {
-          words++;
-          inword = 1;
-        }
-      } else {
-        inword = 0;
-      }
-    }
-  }
-  snprintf(p, p_max_size, "%d", words);
-  fclose(fp);
+  snprintf(p, p_max_size, "%lu", fc->file->words);
 }
@@ -34,6 +34,7 @@ void init_tailhead(const char *, const char *, struct text_object *);
 void print_head(struct text_object *, char *, unsigned int);
 void print_tail(struct text_object *, char *, unsigned int);
 
+void init_filecount(const char *, struct text_object *);
 void print_lines(struct text_object *, char *, unsigned int);
 void print_words(struct text_object *, char *, unsigned int);
 
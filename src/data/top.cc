@@ -31,6 +31,7 @@
 #include "top.h"
 
 #include <cstring>
+#include <unordered_map>
 
 #include "../logging.h"
 #include "../prioqueue.h"
@@ -49,6 +50,14 @@ struct proc_hash_entry {
 };
 static struct proc_hash_entry proc_hash_table[HTABSIZE];
 
+/* name/basename and command line indexes over the process list, rebuilt by
+ * index_processes() whenever the list is refreshed. Keys point into the
+ * strings owned by the processes themselves. */
+static std::unordered_map<std::string_view, struct process *> name_index;
+static std::unordered_map<std::string_view, pid_t> cmdline_index;
+/* substring patterns already matched against the current process list */
+static std::unordered_map<std::string, pid_t> cmdline_matches;
+
 static void hash_process(struct process *p) {
   struct proc_hash_entry *phe;
   static char first_run = 1;
@@ -119,6 +128,7 @@ void free_all_processes() {
     next = pr->next;
     free_and_zero(pr->name);
     free_and_zero(pr->basename);
+    free_and_zero(pr->cmdline);
     free(pr);
     pr = next;
   }
@@ -126,25 +136,55 @@ void free_all_processes() {
 
   /* drop the whole hash table */
   unhash_all_processes();
+  name_index.clear();
+  cmdline_index.clear();
+  cmdline_matches.clear();
 }
 
-struct process *get_process_by_name(std::string_view name) {
-  struct process *p = first_process;
-
-  while (p != nullptr) {
-    // Try matching against the full command line first.
-    if (p->name != nullptr && name == p->name) { return p; }
-    // If matching against full command line fails, fall back to the basename.
-    if (p->basename != nullptr && name == p->basename) { return p; }
-    p = p->next;
+static void index_processes() {
+  name_index.clear();
+  cmdline_index.clear();
+  cmdline_matches.clear();
+
+  // Names are indexed before basenames so a full name match always wins over
+  // a basename match, as it did when the list was searched linearly.
+  for (struct process *p = first_process; p != nullptr; p = p->next) {
+    if (p->name != nullptr) { name_index.emplace(p->name, p); }
+    if (p->cmdline != nullptr) {
+      auto [it, inserted] = cmdline_index.emplace(p->cmdline, p->pid);
+      if (!inserted && p->pid < it->second) { it->second = p->pid; }
+    }
+  }
+  for (struct process *p = first_process; p != nullptr; p = p->next) {
+    if (p->basename != nullptr) { name_index.emplace(p->basename, p); }
   }
+}
 
-  return nullptr;
+struct process *get_process_by_name(std::string_view name) {
+  auto it = name_index.find(name);
+  return it != name_index.end() ? it->second : nullptr;
 }
 bool is_process_running(std::string_view name) {
   return get_process_by_name(name) != nullptr;
 }
 
+pid_t get_pid_by_cmdline(const std::string &pattern) {
+  auto exact = cmdline_index.find(pattern);
+  if (exact != cmdline_index.end()) { return exact->second; }
+
+  auto cached = cmdline_matches.find(pattern);
+  if (cached != cmdline_matches.end()) { return cached->second; }
+
+  pid_t found = -1;
+  for (struct process *p = first_process; p != nullptr; p = p->next) {
+    if (p->cmdline == nullptr || strstr(p->cmdline, pattern.c_str()) == nullptr)
+      continue;
+    if (found == -1 || p->pid < found) { found = p->pid; }
+  }
+  cmdline_matches.emplace(pattern, found);
+  return found;
+}
+
 static struct process *find_process(pid_t pid) {
   struct proc_hash_entry *phe;
 
@@ -168,6 +208,7 @@ static struct process *new_process(pid_t pid) {
   p->pid = pid;
   p->name = nullptr;
   p->basename = nullptr;
+  p->cmdline = nullptr;
   p->amount = 0;
   p->user_time = 0;
   p->total = 0;
@@ -233,6 +274,7 @@ static void delete_process(struct process *p) {
 
   free_and_zero(p->name);
   free_and_zero(p->basename);
+  free_and_zero(p->cmdline);
   /* remove the process from the hash table */
   unhash_process(p);
   free(p);
@@ -363,6 +405,7 @@ static void process_find_top(struct process **cpu, struct process **mem,
   get_top_info();
 
   process_cleanup(); /* cleanup list from exited processes */
+  index_processes(); /* names and command lines now match the list */
 
   cur_proc = first_process;
 
@@ -45,6 +45,7 @@
 
 #define CPU_THRESHHOLD 0 /* threshold for the cpu diff to appear */
 
+#include <string>
 #include <string_view>
 
 #include <assert.h>
@@ -90,6 +91,9 @@ struct process {
   pid_t pid;
   char *name;
   char *basename;
+  // Full command line with arguments joined by spaces, or nullptr where the
+  // OS backend doesn't collect it.
+  char *cmdline;
   uid_t uid;
   float amount;
   // User and kernel times are in hundredths of seconds
@@ -135,6 +139,17 @@ struct process *get_process_by_name(std::string_view name);
  *         running, `false` otherwise.
  */
 bool is_process_running(std::string_view name);
+/**
+ * @brief Finds the process whose command line contains `pattern`.
+ *
+ * Served from the process table built by `update_top()`: an exact command
+ * line match is a hash lookup, any other pattern is matched once per update
+ * and remembered until the table is refreshed.
+ *
+ * @param pattern command line, or a substring of it.
+ * @return lowest pid of a matching process, or -1 if there is none.
+ */
+pid_t get_pid_by_cmdline(const std::string &pattern);
 
 int parse_top_args(const char *s, const char *arg, struct text_object *obj);
 
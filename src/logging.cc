@@ -2,6 +2,16 @@
 
 #include <spdlog/pattern_formatter.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
 
 #ifdef BUILD_JOURNAL
 #include <spdlog/sinks/systemd_sink.h>
@@ -31,6 +41,185 @@ static thread_local auto tl_spans = make_reserved<conky::log::span>(8);
 // Thread-local per-message attributes (set before log call, cleared after)
 static thread_local auto tl_msg_attrs = make_reserved<conky::log::attribute>(4);
 
+std::atomic<bool> conky::log::priv::spans_active{false};
+
+namespace {
+// A finished span as written to the trace file.
+struct trace_record {
+  char name[48];
+  int64_t start_ns;
+  int64_t end_ns;
+};
+
+// One slot of a trace ring. write_trace_file() reads slots while their
+// thread may be overwriting them, so every field is atomic and `seq` tells
+// a complete event from a torn one: 2 * index + 1 while the event with that
+// index is being written, 2 * index + 2 once it is complete.
+struct trace_event {
+  static constexpr size_t name_words = sizeof(trace_record::name) / 8;
+
+  std::atomic<size_t> seq{0};
+  std::array<std::atomic<uint64_t>, name_words> name;
+  std::atomic<int64_t> start_ns;
+  std::atomic<int64_t> end_ns;
+
+  void write(size_t index, const std::string &span, int64_t start,
+             int64_t end) {
+    uint64_t words[name_words] = {};
+    memcpy(words, span.data(), std::min(span.size(), sizeof(words) - 1));
+
+    seq.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < name_words; i++) {
+      name[i].store(words[i], std::memory_order_relaxed);
+    }
+    start_ns.store(start, std::memory_order_relaxed);
+    end_ns.store(end, std::memory_order_relaxed);
+    seq.store(2 * index + 2, std::memory_order_release);
+  }
+
+  // false if the slot no longer (or not yet) holds event `index`
+  bool read(size_t index, trace_record &out) const {
+    const size_t expected = 2 * index + 2;
+    if (seq.load(std::memory_order_acquire) != expected) return false;
+    uint64_t words[name_words];
+    for (size_t i = 0; i < name_words; i++) {
+      words[i] = name[i].load(std::memory_order_relaxed);
+    }
+    out.start_ns = start_ns.load(std::memory_order_relaxed);
+    out.end_ns = end_ns.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seq.load(std::memory_order_relaxed) != expected) return false;
+    memcpy(out.name, words, sizeof(out.name));
+    out.name[sizeof(out.name) - 1] = '\0';
+    return true;
+  }
+};
+
+// Spans finished by one thread. Only the owning thread writes; the oldest
+// events are overwritten once the ring is full. A ring is only allocated
+// once its thread records a span. When its owner exits, the events are
+// copied to retired_threads and the ring goes to the next thread that needs
+// one, so there are never more rings than concurrent threads.
+struct trace_ring {
+  static constexpr size_t capacity = 1 << 14;
+
+  std::array<trace_event, capacity> events;
+  // index of the next event; never reset, so slot sequence numbers of a
+  // previous owner can't be mistaken for the current one's
+  std::atomic<size_t> head{0};
+  // index of the current owner's first event
+  size_t first = 0;
+  long tid = 0;
+  std::string thread_name;
+  bool in_use = false;
+
+  // calls fn with the events of the current owner that are still held
+  template <typename Fn>
+  void for_each(Fn fn) const {
+    size_t end = head.load(std::memory_order_acquire);
+    size_t begin = end > capacity ? std::max(first, end - capacity) : first;
+    trace_record record;
+    for (size_t i = begin; i < end; i++) {
+      if (events[i % capacity].read(i, record)) fn(record);
+    }
+  }
+};
+
+// Events of a thread that exited, kept for the trace file.
+struct retired_thread {
+  long tid;
+  std::string thread_name;
+  std::vector<trace_record> events;
+};
+
+std::mutex trace_mutex;
+std::vector<std::shared_ptr<trace_ring>> trace_rings;
+// at most trace_ring::capacity events in total, oldest threads dropped first
+std::deque<retired_thread> retired_threads;
+size_t retired_events = 0;
+std::string trace_path;
+std::atomic<bool> tracing{false};
+
+// Retires the ring of a thread when the thread exits.
+struct trace_ring_owner {
+  std::shared_ptr<trace_ring> ring;
+
+  ~trace_ring_owner() {
+    if (!ring) return;
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    retired_thread retired{ring->tid, ring->thread_name, {}};
+    ring->for_each([&](const trace_record &record) {
+      retired.events.push_back(record);
+    });
+    if (!retired.events.empty()) {
+      retired_events += retired.events.size();
+      retired_threads.push_back(std::move(retired));
+      while (retired_events > trace_ring::capacity) {
+        retired_events -= retired_threads.front().events.size();
+        retired_threads.pop_front();
+      }
+    }
+    ring->in_use = false;
+  }
+};
+
+thread_local trace_ring_owner tl_trace_ring;
+thread_local std::string tl_thread_name;
+
+int64_t trace_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+trace_ring &local_trace_ring() {
+  std::shared_ptr<trace_ring> &ring = tl_trace_ring.ring;
+  if (!ring) {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    for (const auto &r : trace_rings) {
+      if (!r->in_use) {
+        ring = r;
+        break;
+      }
+    }
+    if (!ring) {
+      ring = std::make_shared<trace_ring>();
+      trace_rings.push_back(ring);
+    }
+    ring->in_use = true;
+    ring->first = ring->head.load(std::memory_order_relaxed);
+    ring->tid = syscall(SYS_gettid);
+    ring->thread_name = tl_thread_name;
+  }
+  return *ring;
+}
+
+void update_spans_active() {
+  bool shown = stderr_sink != nullptr &&
+               stderr_sink->should_log(spdlog::level::debug);
+  conky::log::priv::spans_active.store(
+      shown || tracing.load(std::memory_order_relaxed),
+      std::memory_order_relaxed);
+}
+
+void append_json_string(std::string &out, const char *s) {
+  out += '"';
+  for (; *s != '\0'; s++) {
+    auto c = static_cast<unsigned char>(*s);
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += *s;
+    } else if (c < 0x20) {
+      out += fmt::format("\\u{:04x}", c);
+    } else {
+      out += *s;
+    }
+  }
+  out += '"';
+}
+}  // namespace
+
 static std::string format_attrs(
     std::initializer_list<conky::log::attribute> attrs) {
   std::string result = "{";
@@ -49,6 +238,11 @@ void conky::log::span_guard::open(spdlog::source_loc loc, std::string name,
                                   std::initializer_list<attribute> attrs) {
   tl_spans.emplace_back(std::move(name));
   m_active = true;
+  if (tracing.load(std::memory_order_relaxed)) m_start_ns = trace_now_ns();
+  if (stderr_sink == nullptr ||
+      !stderr_sink->should_log(spdlog::level::trace)) {
+    return;
+  }
   if (attrs.size() > 0) {
     spdlog::default_logger()->log(loc, spdlog::level::trace, ">> {}{}",
                                   tl_spans.back().name(), format_attrs(attrs));
@@ -64,8 +258,18 @@ void conky::log::span_guard::drop() {
   if (!m_active) return;
   if (tl_spans.empty()) return;
 
-  spdlog::default_logger()->log(spdlog::level::trace, "<< {}",
-                                tl_spans.back().name());
+  if (m_start_ns >= 0) {
+    trace_ring &ring = local_trace_ring();
+    size_t head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head % trace_ring::capacity].write(
+        head, tl_spans.back().name(), m_start_ns, trace_now_ns());
+    ring.head.store(head + 1, std::memory_order_release);
+    m_start_ns = -1;
+  }
+  if (stderr_sink != nullptr && stderr_sink->should_log(spdlog::level::trace)) {
+    spdlog::default_logger()->log(spdlog::level::trace, "<< {}",
+                                  tl_spans.back().name());
+  }
   tl_spans.pop_back();
   m_active = false;
 }
@@ -190,18 +394,95 @@ void conky::log::init_logger() {
   formatter->add_flag<msg_attr_formatter_flag>('&');
   formatter->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%-5l]%^%* %v%&");
   spdlog::set_formatter(std::move(formatter));
+  update_spans_active();
 }
 
 void conky::log::log_more() {
   auto lvl = static_cast<int>(stderr_sink->level());
   if (lvl < static_cast<int>(spdlog::level::trace)) return;
   stderr_sink->set_level(static_cast<spdlog::level::level_enum>(lvl - 1));
+  update_spans_active();
 }
 
 void conky::log::log_less() {
   auto lvl = static_cast<int>(stderr_sink->level());
   if (lvl >= static_cast<int>(spdlog::level::off)) return;
   stderr_sink->set_level(static_cast<spdlog::level::level_enum>(lvl + 1));
+  update_spans_active();
+}
+
+void conky::log::set_quiet() {
+  stderr_sink->set_level(spdlog::level::off);
+  update_spans_active();
 }
 
-void conky::log::set_quiet() { stderr_sink->set_level(spdlog::level::off); }
+void conky::log::enable_tracing(std::string path) {
+  {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    trace_path = std::move(path);
+  }
+  tracing.store(true, std::memory_order_relaxed);
+  update_spans_active();
+}
+
+void conky::log::set_thread_name(std::string name) {
+  tl_thread_name = std::move(name);
+  if (!tl_trace_ring.ring) return;
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  tl_trace_ring.ring->thread_name = tl_thread_name;
+}
+
+void conky::log::write_trace_file() {
+  if (!tracing.load(std::memory_order_relaxed)) return;
+
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  if (trace_path.empty()) return;
+
+  // Chrome trace-event format, timestamps in microseconds; loads in
+  // chrome://tracing and Perfetto.
+  const long pid = getpid();
+  std::string out = "{\"traceEvents\":[";
+  bool first = true;
+  auto separator = [&]() {
+    if (!first) out += ",\n";
+    first = false;
+  };
+  auto add_thread = [&](long tid, const std::string &thread_name) {
+    if (thread_name.empty()) return;
+    separator();
+    out += fmt::format(
+        "{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":{},\"tid\":{},"
+        "\"args\":{{\"name\":",
+        pid, tid);
+    append_json_string(out, thread_name.c_str());
+    out += "}}";
+  };
+  auto add_event = [&](long tid, const trace_record &ev) {
+    separator();
+    out += "{\"name\":";
+    append_json_string(out, ev.name);
+    out += fmt::format(
+        ",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":{},\"tid\":{}}}",
+        ev.start_ns / 1000.0, (ev.end_ns - ev.start_ns) / 1000.0, pid, tid);
+  };
+  for (const auto &thread : retired_threads) {
+    add_thread(thread.tid, thread.thread_name);
+    for (const auto &ev : thread.events) add_event(thread.tid, ev);
+  }
+  for (const auto &ring : trace_rings) {
+    if (!ring->in_use) continue;
+    add_thread(ring->tid, ring->thread_name);
+    ring->for_each(
+        [&](const trace_record &ev) { add_event(ring->tid, ev); });
+  }
+  out += "],\"displayTimeUnit\":\"ms\"}\n";
+
+  FILE *fp = fopen(trace_path.c_str(), "w");
+  if (fp == nullptr) {
+    LOG_ERROR("can't write trace file '{}': {}", trace_path, strerror(errno));
+    return;
+  }
+  fwrite(out.data(), 1, out.size(), fp);
+  fclose(fp);
+  LOG_INFO("wrote trace to '{}'", trace_path);
+}
@@ -30,6 +30,8 @@
 #ifndef _LOGGING_H
 #define _LOGGING_H
 
+#include <atomic>
+#include <cstdint>
 #include <stdexcept>
 #include "config.h"
 #include "i18n.h"
@@ -90,10 +92,12 @@ class span {
 
 class span_guard {
   bool m_active = false;
+  int64_t m_start_ns = -1; /* set when the span is recorded for tracing */
 
  public:
   span_guard() = default;
-  span_guard(span_guard &&other) noexcept : m_active(other.m_active) {
+  span_guard(span_guard &&other) noexcept
+      : m_active(other.m_active), m_start_ns(other.m_start_ns) {
     other.m_active = false;
   }
   span_guard(const span_guard &) = delete;
@@ -123,12 +127,33 @@ void push_msg_attrs(std::initializer_list<attribute> attrs);
 /// Clear all accumulated per-message attributes
 void clear_msg_attrs();
 
+/// Starts recording span timings; they're written to `path` as Chrome
+/// trace-event JSON by write_trace_file().
+void enable_tracing(std::string path);
+
+/// Writes the spans recorded by all threads to the trace file, if tracing is
+/// enabled.
+void write_trace_file();
+
+/// Names the current thread in the trace file.
+void set_thread_name(std::string name);
+
+namespace priv {
+/// True while spans are shown in log output (debug and more verbose) or
+/// recorded for the trace file.
+extern std::atomic<bool> spans_active;
+}  // namespace priv
+
+inline bool spans_enabled() {
+  return priv::spans_active.load(std::memory_order_relaxed);
+}
+
 }  // namespace conky::log
 
 #define LOG_SCOPE(name, ...)                                              \
   ([&]() -> conky::log::span_guard {                                      \
     conky::log::span_guard _guard;                                        \
-    if (spdlog::default_logger()->should_log(spdlog::level::debug))       \
+    if (conky::log::spans_enabled())                                      \
       _guard.open(spdlog::source_loc{__FILE__, __LINE__, __func__}, name, \
                   ##__VA_ARGS__);                                         \
     return _guard;                                                        \
@@ -23,8 +23,11 @@
 #include "config.h"
 
 #include <cstring>
+#include <deque>
 #include <filesystem>
 #include <sstream>
+#include <string>
+#include <vector>
 #if defined(BUILD_LUA_CAIRO) || defined(BUILD_WAYLAND)
 #include <cairo.h>
 #endif
@@ -68,6 +71,12 @@ static int llua_block_notify = 0;
 #include <sys/stat.h>
 
 static void llua_load(const char *script);
+static void llua_release_hooks();
+
+/* bumped whenever lua_L is replaced and whenever a script is loaded, cached
+ * function references made before that are resolved again */
+static unsigned long llua_state_serial = 0;
+static unsigned long llua_script_serial = 0;
 
 lua_State *lua_L = nullptr;
 
@@ -115,6 +124,7 @@ class lua_load_setting : public conky::simple_config_setting<std::string> {
 #ifdef HAVE_SYS_INOTIFY_H
     llua_rm_notifies();
 #endif /* HAVE_SYS_INOTIFY_H */
+    llua_release_hooks();
     lua_close(lua_L);
     lua_L = nullptr;
   }
@@ -147,8 +157,11 @@ conky::simple_config_setting<std::string> lua_mouse_hook("lua_mouse_hook",
 
 static int llua_conky_parse(lua_State *L) {
   int n = lua_gettop(L); /* number of arguments */
+  /* conky_parse can nest through $lua_parse, so each depth gets its own
+   * buffer; they are kept around instead of being allocated on every call */
+  static thread_local std::deque<std::vector<char>> buffers;
+  static thread_local size_t depth = 0;
   char *str;
-  auto *buf = static_cast<char *>(calloc(1, max_user_text.get(*state)));
   if (n != 1) {
     lua_pushstring(
         L, "incorrect arguments, conky_parse(string) takes exactly 1 argument");
@@ -159,10 +172,15 @@ static int llua_conky_parse(lua_State *L) {
     lua_error(L);
   }
   str = strdup(lua_tostring(L, 1));
-  evaluate(str, buf, max_user_text.get(*state));
-  lua_pushstring(L, buf);
+  if (buffers.size() <= depth) { buffers.resize(depth + 1); }
+  auto &buf = buffers[depth];
+  buf.resize(max_user_text.get(*state));
+  buf[0] = '\0';
+  ++depth;
+  evaluate(str, buf.data(), static_cast<int>(buf.size()));
+  --depth;
+  lua_pushstring(L, buf.data());
   free(str);
-  free(buf);
   return 1; /* number of results */
 }
 
@@ -204,6 +222,7 @@ void llua_init() {
   std::string old_path, new_path;
   if (lua_L != nullptr) { return; }
   lua_L = luaL_newstate();
+  ++llua_state_serial;
 
   /* add our library path to the lua package.cpath global var */
   luaL_openlibs(lua_L);
@@ -348,6 +367,7 @@ void llua_load(const char *script) {
     }
   }
 
+  ++llua_script_serial;
   error = luaL_dofile(lua_L, path.c_str());
   if (error != 0) {
     LOG_ERROR("lua load error in '{}': {}", path, lua_tostring(lua_L, -1));
@@ -395,46 +415,104 @@ static const char *tokenize(const char *str, size_t *len) {
 }
 
 /*
-   llua_do_call does a flexible call to any Lua function
-string: <function> [par1] [par2...]
-retc: the number of return values expected
+ * A compiled call site: the conky_ prefixed function name and its arguments,
+ * split once when the object is created. The function itself is kept as a
+ * registry reference and resolved again only after the state was recreated or
+ * a script was (re)loaded, since that may have redefined it.
  */
-static char *llua_do_call(const char *string, int retc) {
-  static char func[64];
-  int argc = 0;
+struct llua_call {
+  std::string source;
+  std::string func;
+  std::vector<std::string> args;
+  int ref = LUA_NOREF;
+  unsigned long state_serial = 0;
+  unsigned long script_serial = 0;
+};
 
-  size_t len = 0;
+static llua_call *llua_compile(const char *string) {
+  auto *call = new llua_call;
+  call->source = string;
 
+  size_t len = 0;
   const char *ptr = tokenize(string, &len);
 
   /* proceed only if the function name is present */
-  if (len == 0U) { return nullptr; }
+  if (len == 0U) { return call; }
 
   /* call only conky_ prefixed functions */
   if (strncmp(ptr, LUAPREFIX, strlen(LUAPREFIX)) != 0) {
-    snprintf(func, sizeof func, "%s", LUAPREFIX);
-  } else {
-    *func = 0;
+    call->func = LUAPREFIX;
   }
-  strncat(func, ptr, std::min(len, sizeof(func) - strlen(func) - 1));
-
-  /* push the function name to stack */
-  lua_getglobal(lua_L, func);
+  call->func.append(ptr, len);
 
-  /* parse all function parameters from args and push them to the stack */
   while (ptr = tokenize(ptr, &len), len != 0u) {
-    lua_pushlstring(lua_L, ptr, len);
-    argc++;
+    call->args.emplace_back(ptr, len);
+  }
+  return call;
+}
+
+static void llua_release(llua_call *call) {
+  if (call == nullptr) { return; }
+  if (call->ref != LUA_NOREF && lua_L != nullptr &&
+      call->state_serial == llua_state_serial) {
+    luaL_unref(lua_L, LUA_REGISTRYINDEX, call->ref);
+  }
+  delete call;
+}
+
+/* pushes the function of call onto the stack, resolving it if needed */
+static void llua_push_function(llua_call &call) {
+  if (call.ref != LUA_NOREF && call.state_serial == llua_state_serial) {
+    if (call.script_serial == llua_script_serial) {
+      lua_rawgeti(lua_L, LUA_REGISTRYINDEX, call.ref);
+      return;
+    }
+    luaL_unref(lua_L, LUA_REGISTRYINDEX, call.ref);
+  }
+  call.ref = LUA_NOREF;
+
+  lua_getglobal(lua_L, call.func.c_str());
+  /* a missing function is looked up again on the next call, it may still be
+   * defined later on by the script itself */
+  if (lua_isfunction(lua_L, -1)) {
+    lua_pushvalue(lua_L, -1);
+    call.ref = luaL_ref(lua_L, LUA_REGISTRYINDEX);
+    call.state_serial = llua_state_serial;
+    call.script_serial = llua_script_serial;
   }
+}
+
+/*
+   llua_do_call does a flexible call to any Lua function
+call: compiled <function> [par1] [par2...]
+retc: the number of return values expected
+ */
+static const char *llua_do_call(llua_call &call, int retc) {
+  if (call.func.empty()) { return nullptr; }
 
-  if (lua_pcall(lua_L, argc, retc, 0) != 0) {
-    LOG_ERROR("lua function '{}' execution failed: {}", func,
+  llua_push_function(call);
+  for (const auto &arg : call.args) {
+    lua_pushlstring(lua_L, arg.data(), arg.size());
+  }
+
+  if (lua_pcall(lua_L, static_cast<int>(call.args.size()), retc, 0) != 0) {
+    LOG_ERROR("lua function '{}' execution failed: {}", call.func,
               lua_tostring(lua_L, -1));
     lua_pop(lua_L, -1);
     return nullptr;
   }
 
-  return func;
+  return call.func.c_str();
+}
+
+/* runs a hook, recompiling its call only when the setting changed */
+static void llua_do_hook(llua_call *&call, const std::string &string) {
+  if (string.empty()) { return; }
+  if (call == nullptr || call->source != string) {
+    llua_release(call);
+    call = llua_compile(string.c_str());
+  }
+  llua_do_call(*call, 0);
 }
 
 #if 0
@@ -463,11 +541,11 @@ static char *llua_do_read_call(const char *function, const char *arg, int retc)
 #endif
 
 /* call a function with args, and return a string from it (must be free'd) */
-static char *llua_getstring(const char *args) {
-  char *func;
+static char *llua_getstring(llua_call &call) {
+  const char *func;
   char *ret = nullptr;
 
-  func = llua_do_call(args, 1);
+  func = llua_do_call(call, 1);
   if (func != nullptr) {
     if (lua_isstring(lua_L, -1) == 0) {
       LOG_WARNING("lua function '{}' did not return a string, result discarded",
@@ -505,10 +583,10 @@ static char *llua_getstring_read(const char *function, const char *arg)
 #endif
 
 /* call a function with args, and put the result in ret */
-static int llua_getnumber(const char *args, double *ret) {
-  char *func;
+static int llua_getnumber(llua_call &call, double *ret) {
+  const char *func;
 
-  func = llua_do_call(args, 1);
+  func = llua_do_call(call, 1);
   if (func != nullptr) {
     if (lua_isnumber(lua_L, -1) == 0) {
       LOG_WARNING("lua function '{}' did not return a number, result discarded",
@@ -600,25 +678,54 @@ void llua_set_number(const char *key, double value) {
   lua_setfield(lua_L, -2, key);
 }
 
+static llua_call *startup_call = nullptr;
+static llua_call *shutdown_call = nullptr;
+
 void llua_startup_hook() {
-  if (lua_startup_hook.get(*state).empty()) { return; }
-  llua_do_call(lua_startup_hook.get(*state).c_str(), 0);
+  llua_do_hook(startup_call, lua_startup_hook.get(*state));
 }
 
 void llua_shutdown_hook() {
-  if (lua_shutdown_hook.get(*state).empty()) { return; }
-  llua_do_call(lua_shutdown_hook.get(*state).c_str(), 0);
+  llua_do_hook(shutdown_call, lua_shutdown_hook.get(*state));
+}
+
+#ifdef BUILD_GUI
+static llua_call *draw_pre_call = nullptr;
+static llua_call *draw_post_call = nullptr;
+#endif /* BUILD_GUI */
+
+/* the hook calls hold references into lua_L, drop them before it is closed */
+static void llua_release_hooks() {
+  llua_release(startup_call);
+  llua_release(shutdown_call);
+  startup_call = shutdown_call = nullptr;
+#ifdef BUILD_GUI
+  llua_release(draw_pre_call);
+  llua_release(draw_post_call);
+  draw_pre_call = draw_post_call = nullptr;
+#endif /* BUILD_GUI */
+}
+
+size_t llua_cached_hooks() {
+  size_t count = (startup_call != nullptr) + (shutdown_call != nullptr);
+#ifdef BUILD_GUI
+  count += (draw_pre_call != nullptr) + (draw_post_call != nullptr);
+#endif /* BUILD_GUI */
+  return count;
 }
 
 #ifdef BUILD_GUI
 void llua_draw_pre_hook() {
-  if (lua_draw_hook_pre.get(*state).empty()) { return; }
-  llua_do_call(lua_draw_hook_pre.get(*state).c_str(), 0);
+  llua_do_hook(draw_pre_call, lua_draw_hook_pre.get(*state));
 }
 
 void llua_draw_post_hook() {
-  if (lua_draw_hook_post.get(*state).empty()) { return; }
-  llua_do_call(lua_draw_hook_post.get(*state).c_str(), 0);
+  llua_do_hook(draw_post_call, lua_draw_hook_post.get(*state));
+}
+
+bool llua_has_draw_hooks() {
+  return !lua_draw_hook_pre.get(*state).empty() ||
+         !lua_draw_hook_post.get(*state).empty();
 }
 
 #ifdef BUILD_MOUSE_EVENTS
@@ -783,8 +890,19 @@ void llua_update_info(struct information *i, double u_interval) {
   lua_setglobal(lua_L, "conky_info");
 }
 
+void llua_init_call(struct text_object *obj, const char *arg) {
+  obj->data.opaque = llua_compile(arg);
+}
+
+void llua_free_call(struct text_object *obj) {
+  llua_release(static_cast<llua_call *>(obj->data.opaque));
+  obj->data.opaque = nullptr;
+}
+
 void print_lua(struct text_object *obj, char *p, unsigned int p_max_size) {
-  char *str = llua_getstring(obj->data.s);
+  auto *call = static_cast<llua_call *>(obj->data.opaque);
+  if (call == nullptr) { return; }
+  char *str = llua_getstring(*call);
   if (str != nullptr) {
     snprintf(p, p_max_size, "%s", str);
     free(str);
@@ -793,7 +911,9 @@ void print_lua(struct text_object *obj, char *p, unsigned int p_max_size) {
 
 void print_lua_parse(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  char *str = llua_getstring(obj->data.s);
+  auto *call = static_cast<llua_call *>(obj->data.opaque);
+  if (call == nullptr) { return; }
+  char *str = llua_getstring(*call);
   if (str != nullptr) {
     evaluate(str, p, p_max_size);
     free(str);
@@ -801,7 +921,8 @@ void print_lua_parse(struct text_object *obj, char *p,
 }
 
 double lua_barval(struct text_object *obj) {
+  auto *call = static_cast<llua_call *>(obj->data.opaque);
   double per;
-  if (llua_getnumber(obj->data.s, &per) != 0) { return per; }
+  if (call != nullptr && llua_getnumber(*call, &per) != 0) { return per; }
   return 0;
 }
@@ -47,10 +47,14 @@ void llua_inotify_query(int wd, int mask);
 void llua_init();
 void llua_startup_hook(void);
 void llua_shutdown_hook(void);
+/* number of hook calls compiled and kept for the next run */
+size_t llua_cached_hooks(void);
 
 #ifdef BUILD_GUI
 void llua_draw_pre_hook(void);
 void llua_draw_post_hook(void);
+/* true if a Lua draw hook may paint anywhere in the window */
+bool llua_has_draw_hooks(void);
 
 #ifdef BUILD_MOUSE_EVENTS
 /**
@@ -70,6 +74,8 @@ void llua_update_window_table(conky::vec2i window_size,
 void llua_setup_info(struct information *i, double u_interval);
 void llua_update_info(struct information *i, double u_interval);
 
+void llua_init_call(struct text_object *, const char *);
+void llua_free_call(struct text_object *);
 void print_lua(struct text_object *, char *, unsigned int);
 void print_lua_parse(struct text_object *, char *, unsigned int);
 double lua_barval(struct text_object *);
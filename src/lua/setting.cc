@@ -173,6 +173,10 @@ size_t get_next_seq_no() {
 
 namespace priv {
 
+// starts at 1 so that settings which were never assigned (epoch 0) always miss
+std::atomic<uint64_t> settings_epoch{1};
+std::atomic<lua::state *> settings_state{nullptr};
+
 config_setting_base::config_setting_base(std::string name_)
     : name(std::move(name_)), seq_no(get_next_seq_no()) {
   bool inserted = settings->insert({name, this}).second;
@@ -219,6 +223,8 @@ void config_setting_base::process_setting(lua::state &l, bool init) {
   }
 
   ptr->lua_setter(l, init);
+  l.pushvalue(-1);
+  ptr->update_snapshot(l);
   l.pushvalue(-2);
   l.insert(-2);
   l.rawset(-4);
@@ -280,6 +286,10 @@ void set_config_settings(lua::state &l) {
   // Force creation of settings map. In the off chance we have no settings.
   get_next_seq_no();
 
+  // snapshots of the previous config are stale from here on
+  priv::settings_epoch.fetch_add(1, std::memory_order_acq_rel);
+  priv::settings_state.store(&l, std::memory_order_release);
+
   l.getglobal("conky");
   {
     if (l.type(-1) != lua::TTABLE) {
@@ -326,6 +336,9 @@ void cleanup_config_settings(lua::state &l) {
   lua::stack_sentry s(l);
   l.checkstack(2);
 
+  priv::settings_epoch.fetch_add(1, std::memory_order_acq_rel);
+  priv::settings_state.store(nullptr, std::memory_order_release);
+
   l.getglobal("conky");
   l.rawgetfield(-1, "config");
   l.replace(-2);
@@ -23,7 +23,10 @@
 #ifndef SETTING_HH
 #define SETTING_HH
 
+#include <atomic>
+#include <cstdint>
 #include <limits>
+#include <memory>
 #include <optional>
 #include <string>
 #include <type_traits>
@@ -139,6 +142,40 @@ struct lua_traits<T, false, false, true> {
 };
 
 namespace priv {
+/*
+ * Identifies the currently loaded config. Bumped by set_config_settings() and
+ * cleanup_config_settings(); a setting snapshot is only used if it was taken
+ * under the current epoch and for the same lua state.
+ */
+extern std::atomic<uint64_t> settings_epoch;
+extern std::atomic<lua::state *> settings_state;
+
+/*
+ * Holds the converted value of a setting, so it can be read without touching
+ * the lua state. Trivially copyable values are kept in an atomic, others
+ * (strings) behind an atomically swapped shared_ptr.
+ */
+template <typename T, bool trivial = std::is_trivially_copyable<T>::value>
+class setting_snapshot {
+  std::atomic<T> value{};
+
+ public:
+  T load() const { return value.load(std::memory_order_acquire); }
+  void store(T v) { value.store(v, std::memory_order_release); }
+};
+
+template <typename T>
+class setting_snapshot<T, false> {
+  std::shared_ptr<const T> value;
+
+ public:
+  T load() const { return *std::atomic_load(&value); }
+  void store(T v) {
+    std::shared_ptr<const T> next = std::make_shared<T>(std::move(v));
+    std::atomic_store(&value, std::move(next));
+  }
+};
+
 class config_setting_base {
  private:
   static void process_setting(lua::state &l, bool init);
@@ -165,6 +202,13 @@ class config_setting_base {
    */
   virtual void cleanup(lua::state &l) { l.pop(); }
 
+  /*
+   * Rebuilds the typed snapshot after the setting was assigned.
+   * stack on entry: | ... new_value |
+   * stack on exit:  | ... |
+   */
+  virtual void update_snapshot(lua::state &l) { l.pop(); }
+
  public:
   const std::string name;
   const size_t seq_no;
@@ -204,11 +248,19 @@ class config_setting_template : public priv::config_setting_base {
  public:
   explicit config_setting_template(const std::string &name_)
       : config_setting_base(name_) {}
-  config_setting_template(config_setting_template &&) = default;
+  config_setting_template(config_setting_template &&other) noexcept
+      : config_setting_base(std::move(other)) {}
 
   // get the value of the setting as a C++ type
   T get(lua::state &l);
 
+  // incremented every time the value of the setting is (re)assigned; callers
+  // caching something derived from the value can compare it to see whether
+  // they need to recompute
+  uint32_t generation() const {
+    return m_generation.load(std::memory_order_acquire);
+  }
+
  protected:
   /*
    * Convert the value into a C++ type.
@@ -216,10 +268,35 @@ class config_setting_template : public priv::config_setting_base {
    * stack on exit:  | ... |
    */
   virtual T getter(lua::state &l) = 0;
+
+  void update_snapshot(lua::state &l) override {
+    m_snapshot.store(getter(l));
+    m_generation.fetch_add(1, std::memory_order_acq_rel);
+    m_snapshot_epoch.store(priv::settings_epoch.load(std::memory_order_relaxed),
+                           std::memory_order_release);
+  }
+
+ private:
+  priv::setting_snapshot<T> m_snapshot;
+  std::atomic<uint32_t> m_generation{0};
+  std::atomic<uint64_t> m_snapshot_epoch{0};
+
+  // reads conky.config.<name> from the lua state
+  T lookup(lua::state &l);
 };
 
 template <typename T>
 T config_setting_template<T>::get(lua::state &l) {
+  if (m_snapshot_epoch.load(std::memory_order_acquire) ==
+          priv::settings_epoch.load(std::memory_order_acquire) &&
+      priv::settings_state.load(std::memory_order_relaxed) == &l) {
+    return m_snapshot.load();
+  }
+  return lookup(l);
+}
+
+template <typename T>
+T config_setting_template<T>::lookup(lua::state &l) {
   std::lock_guard<lua::state> guard(l);
   lua::stack_sentry s(l);
   l.checkstack(2);
@@ -279,6 +279,8 @@ static void print_help(const char *prog_name) {
 #endif /* BUILD_X11 */
          "   -t, --text=TEXT           text to render, remember single quotes, "
          "like -t '$uptime'\n"
+         "       --trace-file=FILE     write span timings to FILE as Chrome "
+         "trace JSON on exit\n"
          "   -u, --interval=SECS       update interval\n"
          "   -i COUNT                  number of times to update " PACKAGE_NAME
          " (and quit)\n"
@@ -307,6 +309,7 @@ void handle_terminate();  // defined in conky.cc
 
 int main(int argc, char **argv) {
   conky::log::init_logger();
+  conky::log::set_thread_name("main");
   std::set_terminate(&handle_terminate);
 
 #ifdef BUILD_I18N
@@ -329,7 +332,10 @@ int main(int argc, char **argv) {
         LOG_WARNING("failed to initialize curl, curl variables may not work");
       }
     }
-    ~curl_global_initializer() { curl_global_cleanup(); }
+    ~curl_global_initializer() {
+      ccurl_engine_shutdown();
+      curl_global_cleanup();
+    }
   };
   curl_global_initializer curl_global;
 #endif
@@ -362,6 +368,9 @@ int main(int argc, char **argv) {
       case 'c':
         current_config = optarg;
         break;
+      case 'T':
+        conky::log::enable_tracing(optarg);
+        break;
       case 'q':
         conky::log::set_quiet();
         if (freopen("/dev/null", "w", stderr) == nullptr) {
@@ -424,9 +433,12 @@ int main(int argc, char **argv) {
     main_loop();
   } catch (std::exception &e) {
     std::cerr << PACKAGE_NAME ": " << e.what() << std::endl;
+    conky::log::write_trace_file();
     return EXIT_FAILURE;
   }
 
+  conky::log::write_trace_file();
+
   conky::shutdown_display_outputs();
 
 #ifdef BSD_COMMON
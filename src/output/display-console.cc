@@ -30,10 +30,13 @@
 #include "display-console.hh"
 #include "nc.h"
 
+#include <cstdio>
 #include <iostream>
 #include <sstream>
 #include <unordered_map>
 
+#include <unistd.h>
+
 static conky::simple_config_setting<bool> extra_newline("extra_newline", false,
                                                         false);
 
@@ -68,16 +71,36 @@ bool display_output_console::initialize() { return true; }
 
 bool display_output_console::shutdown() { return true; }
 
+void display_output_console::begin_draw_stuff() {
+  stdout_frame.clear();
+  stderr_frame.clear();
+}
+
 void display_output_console::draw_string(const char *s, int) {
   if (out_to_stdout.get(*state)) {
-    printf("%s\n", s);
-    if (extra_newline.get(*state)) { fputc('\n', stdout); }
-    fflush(stdout); /* output immediately, don't buffer */
+    stdout_frame.append(s);
+    stdout_frame.push_back('\n');
+    if (extra_newline.get(*state)) { stdout_frame.push_back('\n'); }
   }
   if (out_to_stderr.get(*state)) {
-    fprintf(stderr, "%s\n", s);
-    fflush(stderr); /* output immediately, don't buffer */
+    stderr_frame.append(s);
+    stderr_frame.push_back('\n');
   }
 }
 
+/* output immediately, in a single write per stream */
+static void emit_frame(FILE *stream, std::string &frame, std::string &last) {
+  if (frame.empty()) { return; }
+  if (skip_unchanged_output.get(*state) && frame == last) { return; }
+  /* anything still buffered by stdio goes first */
+  fflush(stream);
+  write_all(fileno(stream), frame);
+  last.swap(frame);
+}
+
+void display_output_console::end_draw_stuff() {
+  emit_frame(stdout, stdout_frame, last_stdout_frame);
+  emit_frame(stderr, stderr_frame, last_stderr_frame);
+}
+
 }  // namespace conky
@@ -49,7 +49,14 @@ class display_output_console : public display_output_base {
 
   virtual void draw_string(const char *s, int w);
 
+  virtual void begin_draw_stuff();
+  virtual void end_draw_stuff();
+
   // console-specific
+ private:
+  // text of the frame being drawn and of the last one written
+  std::string stdout_frame, last_stdout_frame;
+  std::string stderr_frame, last_stderr_frame;
 };
 
 }  // namespace conky
@@ -35,14 +35,16 @@
 #include <sstream>
 #include <unordered_map>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 /* filenames for output */
 static conky::simple_config_setting<std::string> overwrite_file(
     "overwrite_file", std::string(), true);
-static FILE *overwrite_fpointer = nullptr;
 static conky::simple_config_setting<std::string> append_file("append_file",
                                                              std::string(),
                                                              true);
-static FILE *append_fpointer = nullptr;
 
 namespace conky {
 namespace {
@@ -69,39 +71,70 @@ bool display_output_file::detect() {
 
 bool display_output_file::initialize() { return true; }
 
-bool display_output_file::shutdown() { return true; }
+bool display_output_file::shutdown() {
+  close_append_file();
+  return true;
+}
+
+void display_output_file::close_append_file() {
+  if (append_fd != -1) {
+    close(append_fd);
+    append_fd = -1;
+  }
+  append_path.clear();
+}
 
 void display_output_file::draw_string(const char *s, int) {
-  if (overwrite_fpointer != nullptr) { fprintf(overwrite_fpointer, "%s\n", s); }
-  if (append_fpointer != nullptr) { fprintf(append_fpointer, "%s\n", s); }
+  frame.append(s);
+  frame.push_back('\n');
 }
 
-void display_output_file::begin_draw_stuff() {
-  if (static_cast<unsigned int>(!overwrite_file.get(*state).empty()) != 0u) {
-    overwrite_fpointer = fopen(overwrite_file.get(*state).c_str(), "we");
-    if (overwrite_fpointer == nullptr) {
-      LOG_ERROR("cannot overwrite '{}': {}", overwrite_file.get(*state),
-                strerror(errno));
+void display_output_file::begin_draw_stuff() { frame.clear(); }
+
+void display_output_file::end_draw_stuff() {
+  if (skip_unchanged_output.get(*state) && frame == last_frame) { return; }
+
+  const std::string &overwrite = overwrite_file.get(*state);
+  if (!overwrite.empty()) {
+    /* write to a temporary file next to the target and rename it over the
+     * target, so readers never see a partially written frame */
+    std::string tmp = overwrite + ".conky-tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd == -1) {
+      LOG_ERROR("cannot overwrite '{}': {}", overwrite, strerror(errno));
+    } else {
+      bool written = write_all(fd, frame);
+      if (close(fd) == -1) { written = false; }
+      if (!written || rename(tmp.c_str(), overwrite.c_str()) == -1) {
+        LOG_ERROR("cannot overwrite '{}': {}", overwrite, strerror(errno));
+        unlink(tmp.c_str());
+      }
     }
   }
-  if (static_cast<unsigned int>(!append_file.get(*state).empty()) != 0u) {
-    append_fpointer = fopen(append_file.get(*state).c_str(), "ae");
-    if (append_fpointer == nullptr) {
-      LOG_ERROR("cannot append to '{}': {}", append_file.get(*state),
-                strerror(errno));
+
+  const std::string &append = append_file.get(*state);
+  if (append != append_path) { close_append_file(); }
+  if (!append.empty()) {
+    /* reopen if the file was removed or rotated away since the last frame */
+    struct stat st;
+    if (append_fd != -1 && (fstat(append_fd, &st) == -1 || st.st_nlink == 0)) {
+      close_append_file();
+    }
+    if (append_fd == -1) {
+      append_fd =
+          open(append.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+      if (append_fd == -1) {
+        LOG_ERROR("cannot append to '{}': {}", append, strerror(errno));
+      } else {
+        append_path = append;
+      }
+    }
+    if (append_fd != -1 && !write_all(append_fd, frame)) {
+      LOG_ERROR("cannot append to '{}': {}", append, strerror(errno));
     }
   }
-}
 
-void display_output_file::end_draw_stuff() {
-  if (overwrite_fpointer != nullptr) {
-    fclose(overwrite_fpointer);
-    overwrite_fpointer = nullptr;
-  }
-  if (append_fpointer != nullptr) {
-    fclose(append_fpointer);
-    append_fpointer = nullptr;
-  }
+  last_frame.swap(frame);
 }
 
 }  // namespace conky
@@ -53,6 +53,14 @@ class display_output_file : public display_output_base {
   virtual void end_draw_stuff();
 
   // file-specific
+ private:
+  void close_append_file();
+
+  // text of the frame being drawn and of the last one written
+  std::string frame, last_frame;
+  // append_file is kept open between frames
+  int append_fd = -1;
+  std::string append_path;
 };
 
 }  // namespace conky
@@ -26,12 +26,23 @@
 
 #include <config.h>
 
+#include "../common.h"
 #include "../conky.h"
+#include "../content/profile.h"
+#include "../content/text_object.h"
+#include "../data/hardware/diskio.h"
+#include "../data/network/net_stat.h"
+#include "../data/top.h"
 #include "display-http.hh"
 
+#include <spdlog/fmt/fmt.h>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <mutex>
 #include <sstream>
 #include <unordered_map>
+#include <vector>
 
 #include <microhttpd.h>
 
@@ -58,15 +69,58 @@ static conky::simple_config_setting<bool> http_refresh("http_refresh", false,
 static conky::simple_config_setting<unsigned short> http_port("http_port",
                                                               HTTPPORT, true);
 
+/* opt-in: serving /metrics runs the collectors and a process scan on every
+ * update, whatever the text needs */
+static conky::simple_config_setting<bool> http_metrics("http_metrics", false,
+                                                       false);
+
+/* the /metrics page, rendered once per update and copied out by requests */
+std::string metrics_page;
+std::mutex metrics_mutex;
+
+/* the /profile page, rendered like metrics_page while profile_objects is on */
+std::string profile_page;
+std::mutex profile_mutex;
+
 MHD_Result sendanswer(void *cls, struct MHD_Connection *connection,
                       const char *url, const char *method, const char *version,
                       const char *upload_data, size_t *upload_data_size,
                       void **con_cls) {
-  struct MHD_Response *response = MHD_create_response_from_buffer(
-      webpage.length(), (void *)webpage.c_str(), MHD_RESPMEM_PERSISTENT);
-  MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+  struct MHD_Response *response;
+  unsigned int status = MHD_HTTP_OK;
+
+  if (url != nullptr && strcmp(url, "/metrics") == 0) {
+    if (http_metrics.get(*state)) {
+      std::lock_guard<std::mutex> lock(metrics_mutex);
+      response = MHD_create_response_from_buffer(
+          metrics_page.length(), (void *)metrics_page.data(),
+          MHD_RESPMEM_MUST_COPY);
+      MHD_add_response_header(response, "Content-Type",
+                              "text/plain; version=0.0.4; charset=utf-8");
+    } else {
+      status = MHD_HTTP_NOT_FOUND;
+      response = MHD_create_response_from_buffer(0, (void *)"",
+                                                 MHD_RESPMEM_PERSISTENT);
+    }
+  } else if (url != nullptr && strcmp(url, "/profile") == 0) {
+    if (profile_objects.get(*state)) {
+      std::lock_guard<std::mutex> lock(profile_mutex);
+      response = MHD_create_response_from_buffer(
+          profile_page.length(), (void *)profile_page.data(),
+          MHD_RESPMEM_MUST_COPY);
+      MHD_add_response_header(response, "Content-Type", "application/json");
+    } else {
+      status = MHD_HTTP_NOT_FOUND;
+      response = MHD_create_response_from_buffer(0, (void *)"",
+                                                 MHD_RESPMEM_PERSISTENT);
+    }
+  } else {
+    response = MHD_create_response_from_buffer(
+        webpage.length(), (void *)webpage.c_str(), MHD_RESPMEM_PERSISTENT);
+  }
+  MHD_Result ret = MHD_queue_response(connection, status, response);
   MHD_destroy_response(response);
-  if (cls || url || method || version || upload_data || upload_data_size ||
+  if (cls || method || version || upload_data || upload_data_size ||
       con_cls) {}  // make compiler happy
   return ret;
 }
@@ -155,6 +209,177 @@ std::string html_escape(const std::string &input) {
   return escaped;
 }
 
+namespace {
+/*
+ * Prometheus text exposition of the collected data. The families are fixed,
+ * their HELP and TYPE lines are written from this table and the samples are
+ * read straight from the collector structs, without going through the text.
+ */
+typedef std::back_insert_iterator<std::string> metrics_out;
+
+std::string label_escape(const char *value) {
+  std::string escaped;
+  for (const char *c = value; c != nullptr && *c != 0; c++) {
+    switch (*c) {
+      case '\\':
+        escaped.append("\\\\");
+        break;
+      case '"':
+        escaped.append("\\\"");
+        break;
+      case '\n':
+        escaped.append("\\n");
+        break;
+      default:
+        escaped.push_back(*c);
+        break;
+    }
+  }
+  return escaped;
+}
+
+void write_cpu_usage(metrics_out out, const char *name) {
+  if (::info.cpu_usage == nullptr) { return; }
+  fmt::format_to(out, "{}{{cpu=\"total\"}} {}\n", name, ::info.cpu_usage[0]);
+  for (unsigned int i = 1; i <= ::info.cpu_count; i++) {
+    fmt::format_to(out, "{}{{cpu=\"cpu{}\"}} {}\n", name, i,
+                   ::info.cpu_usage[i]);
+  }
+}
+
+void write_memory(metrics_out out, const char *name) {
+  const std::pair<const char *, unsigned long long> values[] = {
+      {"used", ::info.mem},         {"free", ::info.memfree},
+      {"max", ::info.memmax},       {"available", ::info.memavail},
+      {"buffers", ::info.buffers},  {"cached", ::info.cached},
+      {"swap_used", ::info.swap},   {"swap_free", ::info.swapfree},
+      {"swap_max", ::info.swapmax},
+  };
+  for (const auto &[type, kib] : values) {
+    fmt::format_to(out, "{}{{type=\"{}\"}} {}\n", name, type, kib * 1024);
+  }
+}
+
+void write_load(metrics_out out, const char *name) {
+  const char *periods[] = {"1m", "5m", "15m"};
+  for (int i = 0; i < 3; i++) {
+    fmt::format_to(out, "{}{{period=\"{}\"}} {}\n", name, periods[i],
+                   ::info.loadavg[i]);
+  }
+}
+
+void write_uptime(metrics_out out, const char *name) {
+  fmt::format_to(out, "{} {}\n", name, ::info.uptime);
+}
+
+void write_processes(metrics_out out, const char *name) {
+  fmt::format_to(out, "{}{{state=\"all\"}} {}\n", name, ::info.procs);
+  fmt::format_to(out, "{}{{state=\"running\"}} {}\n", name,
+                 ::info.run_procs);
+}
+
+template <long long net_stat::*counter>
+void write_net_counter(metrics_out out, const char *name) {
+  for (int i = 0; i < MAX_NET_INTERFACES; i++) {
+    if (netstats[i].dev == nullptr) { continue; }
+    fmt::format_to(out, "{}{{device=\"{}\"}} {}\n", name,
+                   label_escape(netstats[i].dev), netstats[i].*counter);
+  }
+}
+
+template <double net_stat::*speed>
+void write_net_speed(metrics_out out, const char *name) {
+  for (int i = 0; i < MAX_NET_INTERFACES; i++) {
+    if (netstats[i].dev == nullptr) { continue; }
+    fmt::format_to(out, "{}{{device=\"{}\"}} {}\n", name,
+                   label_escape(netstats[i].dev), netstats[i].*speed);
+  }
+}
+
+template <double diskio_stat::*current>
+void write_diskio(metrics_out out, const char *name) {
+  /* the head of the list is the sum over all devices */
+  double interval = active_update_interval();
+  for (diskio_stat *ds = &stats; ds != nullptr; ds = ds->next) {
+    fmt::format_to(out, "{}{{device=\"{}\"}} {}\n", name,
+                   ds->dev != nullptr ? label_escape(ds->dev) : "total",
+                   ds->*current / interval);
+  }
+}
+
+template <process *(information::*list)[10]>
+void write_top(metrics_out out, const char *name, bool memory) {
+  for (int i = 0; i < 10; i++) {
+    const process *p = (::info.*list)[i];
+    if (p == nullptr) { break; }
+    fmt::format_to(out, "{}{{rank=\"{}\",pid=\"{}\",name=\"{}\"}} {}\n",
+                   name, i + 1, p->pid, label_escape(p->name),
+                   memory ? static_cast<double>(p->rss) : p->amount);
+  }
+}
+
+void write_top_cpu(metrics_out out, const char *name) {
+  write_top<&information::cpu>(out, name, false);
+}
+
+void write_top_mem(metrics_out out, const char *name) {
+  write_top<&information::memu>(out, name, true);
+}
+
+struct metric_family {
+  const char *name;
+  const char *type;
+  const char *help;
+  void (*write)(metrics_out, const char *);
+};
+
+const metric_family metric_families[] = {
+    {"conky_cpu_usage_ratio", "gauge", "CPU usage between 0 and 1.",
+     write_cpu_usage},
+    {"conky_memory_bytes", "gauge", "Memory and swap usage.", write_memory},
+    {"conky_load_average", "gauge", "System load average.", write_load},
+    {"conky_uptime_seconds", "gauge", "System uptime.", write_uptime},
+    {"conky_processes", "gauge", "Number of processes.", write_processes},
+    {"conky_network_receive_bytes_total", "counter",
+     "Bytes received by the interface.", write_net_counter<&net_stat::recv>},
+    {"conky_network_transmit_bytes_total", "counter",
+     "Bytes sent by the interface.", write_net_counter<&net_stat::trans>},
+    {"conky_network_receive_bytes_per_second", "gauge",
+     "Averaged receive rate.", write_net_speed<&net_stat::recv_speed>},
+    {"conky_network_transmit_bytes_per_second", "gauge",
+     "Averaged transmit rate.", write_net_speed<&net_stat::trans_speed>},
+    {"conky_disk_read_bytes_per_second", "gauge", "Averaged disk read rate.",
+     write_diskio<&diskio_stat::current_read>},
+    {"conky_disk_write_bytes_per_second", "gauge", "Averaged disk write rate.",
+     write_diskio<&diskio_stat::current_write>},
+    {"conky_top_cpu_percent", "gauge", "Processes using the most CPU.",
+     write_top_cpu},
+    {"conky_top_memory_bytes", "gauge",
+     "Resident memory of the processes using the most memory.",
+     write_top_mem},
+};
+
+/* collectors the families above read from, kept running while metrics are
+ * served even if no text object needs them */
+std::vector<legacy_cb_handle> metric_collectors;
+
+/* rendered into outside of metrics_mutex, then swapped in */
+std::string metrics_scratch;
+}  // namespace
+
+void update_metrics() {
+  metrics_scratch.clear();
+  auto out = std::back_inserter(metrics_scratch);
+  for (const auto &family : metric_families) {
+    fmt::format_to(out, "# HELP {} {}\n# TYPE {} {}\n", family.name,
+                   family.help, family.name, family.type);
+    family.write(out, family.name);
+  }
+
+  std::lock_guard<std::mutex> lock(metrics_mutex);
+  metrics_page.swap(metrics_scratch);
+}
+
 //}  // namespace priv
 
 display_output_http::display_output_http() : display_output_base("http") {
@@ -171,13 +396,24 @@ bool display_output_http::detect() {
 
 bool display_output_http::initialize() {
   if (/*priv::*/ out_to_http.get(*state)) {
+    if (http_metrics.get(*state)) {
+      top_cpu = top_mem = top_running = 1;
+      for (int (*fn)() : {update_cpu_usage, update_meminfo, update_net_stats,
+                          update_diskio, update_load_average, update_uptime,
+                          update_total_processes, update_top}) {
+        metric_collectors.push_back(conky::register_cb<legacy_cb>(1, fn));
+      }
+    }
     is_active = true;
     return true;
   }
   return false;
 }
 
-bool display_output_http::shutdown() { return true; }
+bool display_output_http::shutdown() {
+  metric_collectors.clear();
+  return true;
+}
 
 void display_output_http::begin_draw_text() {
 #define WEBPAGE_START1                                             \
@@ -201,7 +437,15 @@ void display_output_http::begin_draw_text() {
   }
 }
 
-void display_output_http::end_draw_text() { webpage.append(WEBPAGE_END); }
+void display_output_http::end_draw_text() {
+  webpage.append(WEBPAGE_END);
+  if (http_metrics.get(*state)) { update_metrics(); }
+  if (profile_objects.get(*state)) {
+    std::string page = profile_json();
+    std::lock_guard<std::mutex> lock(profile_mutex);
+    profile_page.swap(page);
+  }
+}
 
 void display_output_http::draw_string(const char *s, int) {
   std::string::size_type origlen = webpage.length();
@@ -63,6 +63,9 @@ class display_output_http : public display_output_base {
 
 std::string html_escape(const std::string &input);
 
+// renders the data served on /metrics
+void update_metrics();
+
 }  // namespace conky
 
 #endif /* DISPLAY_HTTP_HH */
@@ -33,13 +33,21 @@
 #include "nc.h"
 
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <unordered_map>
 
 #include <ncurses.h>
+#include <sys/ioctl.h>
 
 extern WINDOW* ncurses_window;
 
+/* skip refreshing the terminal while more than this many bytes are still
+ * queued for it, e.g. on a slow ssh link (0 disables) */
+static conky::range_config_setting<unsigned int> ncurses_max_pending_output(
+    "ncurses_max_pending_output", 0, std::numeric_limits<unsigned int>::max(),
+    0, false);
+
 namespace conky {
 namespace {
 conky::display_output_ncurses ncurses_output;
@@ -53,8 +61,6 @@ void register_output<output_t::NCURSES>(display_outputs_t& outputs) {
 
 //}  // namespace priv
 
-#define COLORS_BUILTIN 8
-
 Colour ncurses_colors[COLORS_BUILTIN + COLORS_CUSTOM] = {
     {0x00, 0x00, 0x00, 0xff},  // BLACK
     {0xff, 0x00, 0x00, 0xff},  // RED
@@ -109,30 +115,41 @@ bool display_output_ncurses::initialize() {
     ncurses_colors[COLORS_BUILTIN + i] = c;
   }
 
+  pairs_initialized.reset();
+
   is_active = ncurses_window != nullptr;
   return is_active;
 }
 
 bool display_output_ncurses::shutdown() { return false; }
 
-void display_output_ncurses::set_foreground_color(Colour c) {
-  int nccolor = to_ncurses(c);
-  init_pair(nccolor + 1, nccolor, COLOR_BLACK);
+void display_output_ncurses::use_color_pair(int nccolor) {
+  // colour pair n + 1 always draws colour n on black, so it only has to be
+  // set up once
+  if (!pairs_initialized.test(nccolor)) {
+    init_pair(nccolor + 1, nccolor, COLOR_BLACK);
+    pairs_initialized.set(nccolor);
+  }
   attron(COLOR_PAIR(nccolor + 1));
 }
 
-void display_output_ncurses::begin_draw_text() {
-  init_pair(COLOR_WHITE, COLOR_WHITE, COLOR_BLACK);
-  attron(COLOR_PAIR(COLOR_WHITE));
+void display_output_ncurses::set_foreground_color(Colour c) {
+  use_color_pair(to_ncurses(c));
+}
+
+void display_output_ncurses::begin_draw_stuff() {
+  // blank the virtual screen without forcing a full repaint, refresh() will
+  // then only send the cells that changed since the last frame
+  erase();
 }
 
+void display_output_ncurses::begin_draw_text() { use_color_pair(COLOR_WHITE); }
+
 void display_output_ncurses::end_draw_text() {}
 
-void display_output_ncurses::draw_string(const char* s, int) {
-  printw("%s", s);
-}
+void display_output_ncurses::draw_string(const char* s, int) { addstr(s); }
 
-void display_output_ncurses::line_inner_done() { printw("\n"); }
+void display_output_ncurses::line_inner_done() { addch('\n'); }
 
 int display_output_ncurses::getx() {
   int x, y;
@@ -164,8 +181,23 @@ void display_output_ncurses::gotoy(int y) {
 
 void display_output_ncurses::gotoxy(int x, int y) { move(y, x); }
 
+bool display_output_ncurses::output_backlogged() {
+#ifdef TIOCOUTQ
+  unsigned int max_pending = ncurses_max_pending_output.get(*state);
+  int pending = 0;
+
+  if (max_pending == 0) { return false; }
+  if (ioctl(fileno(stdout), TIOCOUTQ, &pending) == -1) { return false; }
+  return static_cast<unsigned int>(pending) > max_pending;
+#else
+  return false;
+#endif /* TIOCOUTQ */
+}
+
 void display_output_ncurses::flush() {
+  // the frame stays in the virtual screen; if it's skipped here, the next
+  // refresh sends whatever differs by then
+  if (output_backlogged()) { return; }
   refresh();
-  clear();
 }
 }  // namespace conky
@@ -25,14 +25,18 @@
 
 #include "config.h"
 
+#include <bitset>
 #include <limits>
 #include <string>
 #include <type_traits>
 
 #include "../content/colours.hh"
+#include "../lua/colour-settings.hh"
 #include "../lua/luamm.hh"
 #include "display-console.hh"
 
+#define COLORS_BUILTIN 8
+
 namespace conky {
 
 /*
@@ -54,6 +58,7 @@ class display_output_ncurses : public display_output_console {
   // drawing primitives
   virtual void set_foreground_color(Colour c);
 
+  virtual void begin_draw_stuff();
   virtual void begin_draw_text();
   virtual void end_draw_text();
   virtual void draw_string(const char *s, int w);
@@ -68,6 +73,12 @@ class display_output_ncurses : public display_output_console {
   virtual void flush();
 
   // ncurses-specific
+ private:
+  void use_color_pair(int nccolor);
+  bool output_backlogged();
+
+  // colour pairs set up with init_pair(), indexed by ncurses colour
+  std::bitset<COLORS_BUILTIN + COLORS_CUSTOM> pairs_initialized;
 };
 
 }  // namespace conky
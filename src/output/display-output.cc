@@ -29,10 +29,13 @@
 #include "display-output.hh"
 
 #include <algorithm>
+#include <cerrno>
 #include <iostream>
 #include <sstream>
 #include <unordered_map>
 
+#include <unistd.h>
+
 namespace conky {
 
 inline void log_missing(const char *name, const char *flag) {
@@ -132,6 +135,22 @@ bool initialize_display_outputs() {
   return true;
 }
 
+bool write_all(int fd, const std::string &buf) {
+  const char *p = buf.data();
+  size_t left = buf.size();
+
+  while (left > 0) {
+    ssize_t written = write(fd, p, left);
+    if (written < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    p += written;
+    left -= written;
+  }
+  return true;
+}
+
 bool shutdown_display_outputs() {
   bool ret = true;
   for (auto output : active_display_outputs) {
@@ -163,6 +163,12 @@ enum class output_t : uint32_t {
 template <output_t Output>
 void register_output(display_outputs_t &outputs);
 
+/*
+ * Writes all of buf to fd with as few write() calls as possible, retrying
+ * after short writes and EINTR.
+ */
+bool write_all(int fd, const std::string &buf);
+
 /*
  * The selected and active display outputs.
  */
@@ -43,11 +43,14 @@
 #include <wlr-layer-shell-client-protocol.h>
 #include <xdg-shell-client-protocol.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <sstream>
+#include <vector>
 
 #include "../conky.h"
 #include "../geometry.h"
@@ -261,21 +264,35 @@ static struct epoll_event ep[1];
 static struct window *global_window;
 static wl_display *global_display;
 
+struct shm_pool;
+struct shm_buffer;
+
 struct window {
   struct rect<size_t> rectangle;
   struct wl_shm *shm;
   struct wl_surface *surface;
   struct zwlr_layer_surface_v1 *layer_surface;
   int scale, pending_scale;
+  /* everything is drawn here and copied into a shm buffer on commit */
   std::shared_ptr<cairo_surface_t> cairo_surface;
   std::shared_ptr<cairo_t> cr;
   PangoLayout *layout;
   PangoContext *pango_context;
+  /* backs the buffer ring, replaced when the window is resized */
+  struct shm_pool *pool;
+  std::vector<struct shm_buffer *> buffers;
+  /* last buffer that was committed, holds what is on screen */
+  struct shm_buffer *front;
+  /* set between a commit and the compositor asking for the next frame */
+  struct wl_callback *frame_callback;
+  /* cairo_surface holds a frame that wasn't committed yet */
+  bool dirty;
 };
 
 struct {
   struct wl_registry *registry;
   struct wl_compositor *compositor;
+  uint32_t compositor_version;
   struct wl_shm *shm;
   struct wl_surface *surface;
   struct wl_seat *seat;
@@ -356,8 +373,11 @@ void registry_handle_global(void *data, struct wl_registry *registry,
                             uint32_t name, const char *interface,
                             uint32_t version) {
   if (strcmp(interface, "wl_compositor") == 0) {
+    /* version 4 adds wl_surface.damage_buffer */
+    wl_globals.compositor_version = std::min<uint32_t>(version, 4);
     wl_globals.compositor = static_cast<wl_compositor *>(
-        wl_registry_bind(registry, name, &wl_compositor_interface, 3));
+        wl_registry_bind(registry, name, &wl_compositor_interface,
+                         wl_globals.compositor_version));
   } else if (strcmp(interface, "wl_shm") == 0) {
     wl_globals.shm = static_cast<wl_shm *>(
         wl_registry_bind(registry, name, &wl_shm_interface, 1));
@@ -659,7 +679,9 @@ bool display_output_wayland::main_loop_wait(double t) {
   /* timeout */
   if (ep_count == 0) { update_text(); }
 
-  if (need_to_update != 0) {
+  /* while the compositor hasn't asked for a new frame (e.g. because conky
+   * is hidden), drawing is put off until it does */
+  if (need_to_update != 0 && global_window->frame_callback == nullptr) {
     need_to_update = 0;
     selected_font = 0;
     update_text_area();
@@ -744,7 +766,6 @@ bool display_output_wayland::main_loop_wait(double t) {
     llua_update_window_table(conky::vec2i(width, height),
                              conky::rect<int>(text_start, text_size));
 
-    clear_text(1);
     draw_stuff();
   }
   wl_display_flush(global_display);
@@ -937,12 +958,15 @@ void display_output_wayland::move_win(int x, int y) {
 }
 float display_output_wayland::get_dpi_scale() { return 1.0; }
 
-void display_output_wayland::end_draw_stuff() {
-  window_commit_buffer(global_window);
-}
-
-void display_output_wayland::clear_text(int exposures) {
+/* Every frame is drawn from scratch onto the window's cairo surface, which
+ * is only copied into a buffer on commit. The surface is cleared when a
+ * frame is actually drawn: clearing it in clear_text() could wipe a frame
+ * that is still waiting for the compositor's frame callback, and skipping
+ * the clear while one is pending made draws in that window (SIGUSR2, ...)
+ * paint over the previous frame. */
+void display_output_wayland::begin_draw_stuff() {
   struct window *window = global_window;
+  if (window->cr == nullptr) { return; }
   auto cr = window->cr.get();
   cairo_save(cr);
 
@@ -959,6 +983,12 @@ void display_output_wayland::clear_text(int exposures) {
   cairo_restore(cr);
 }
 
+void display_output_wayland::end_draw_stuff() {
+  window_commit_buffer(global_window);
+}
+
+void display_output_wayland::clear_text(int exposures) {}
+
 int display_output_wayland::font_height(unsigned int f) {
   if (pango_fonts.size() == 0) { return 2; }
   assert(f < pango_fonts.size());
@@ -1045,31 +1075,25 @@ struct shm_pool {
   void *data;
 };
 
-struct shm_surface_data {
-  struct wl_buffer *buffer;
-  struct shm_pool *pool;
-};
+/* Frames are presented from a small ring of shm buffers carved out of one
+ * pool. A buffer belongs to the compositor from its commit until it's
+ * released, and only the part of it that is out of date gets copied from
+ * the window's cairo surface before it's committed again. */
+#define BUFFER_RING_SIZE 3
 
-static const cairo_user_data_key_t shm_surface_data_key = {0};
-
-struct wl_buffer *get_buffer_from_cairo_surface(cairo_surface_t *surface) {
-  struct shm_surface_data *data;
-
-  data = static_cast<struct shm_surface_data *>(
-      cairo_surface_get_user_data(surface, &shm_surface_data_key));
-
-  return data->buffer;
-}
+/* granularity in pixels at which changes between frames are found */
+#define DAMAGE_TILE_SIZE 32
 
-static void shm_pool_destroy(struct shm_pool *pool);
-
-static void shm_surface_data_destroy(void *p) {
-  struct shm_surface_data *data = static_cast<struct shm_surface_data *>(p);
-  wl_buffer_destroy(data->buffer);
-  if (data->pool) shm_pool_destroy(data->pool);
-
-  delete data;
-}
+struct shm_buffer {
+  struct wl_buffer *buffer;
+  unsigned char *data;
+  /* area that changed since this buffer was last filled */
+  cairo_region_t *stale;
+  /* held by the compositor */
+  bool busy;
+  /* belongs to a pool that is gone, destroyed once released */
+  bool retired;
+};
 
 static struct wl_shm_pool *make_shm_pool(struct wl_shm *shm, int size,
                                          void **data) {
@@ -1124,7 +1148,7 @@ static void *shm_pool_allocate(struct shm_pool *pool, size_t size,
   return (char *)pool->data + *offset;
 }
 
-/* destroy the pool. this does not unmap the memory though */
+/* destroy the pool. buffers created from it stay valid for the compositor */
 static void shm_pool_destroy(struct shm_pool *pool) {
   munmap(pool->data, pool->size);
   wl_shm_pool_destroy(pool->pool);
@@ -1143,70 +1167,154 @@ static int data_length_for_shm_surface(rect<size_t> *rect, int scale) {
   return stride * rect->height() * scale;
 }
 
-static std::shared_ptr<conky::draw_surface> create_shm_surface_from_pool(
-    void *none, rect<size_t> *rectangle, struct shm_pool *pool, int scale) {
-  struct shm_surface_data *data;
-  uint32_t format;
-  cairo_surface_t *surface;
-  cairo_format_t cairo_format;
-  int stride, length, offset;
-  void *map;
+static void shm_buffer_destroy(struct shm_buffer *buffer) {
+  wl_buffer_destroy(buffer->buffer);
+  cairo_region_destroy(buffer->stale);
+  delete buffer;
+}
 
-  data = new struct shm_surface_data;
-  if (data == NULL) return NULL;
+static void shm_buffer_release(void *data, struct wl_buffer *wl_buffer) {
+  struct shm_buffer *buffer = static_cast<struct shm_buffer *>(data);
+  if (buffer->retired) {
+    shm_buffer_destroy(buffer);
+    return;
+  }
+  buffer->busy = false;
 
-  cairo_format = CAIRO_FORMAT_ARGB32; /*or CAIRO_FORMAT_RGB16_565 who knows??*/
+  /* a frame that found every buffer busy can go out now */
+  struct window *window = global_window;
+  if (window != nullptr && window->dirty && window->frame_callback == nullptr) {
+    window_commit_buffer(window);
+  }
+}
 
-  stride = stride_for_shm_surface(rectangle, scale);
-  length = data_length_for_shm_surface(rectangle, scale);
-  data->pool = NULL;
-  map = shm_pool_allocate(pool, length, &offset);
+static const struct wl_buffer_listener shm_buffer_listener = {
+    /*.release =*/&shm_buffer_release,
+};
 
-  if (!map) {
-    delete data;
-    return NULL;
+/* returns a buffer the compositor doesn't hold, growing the ring if needed */
+static struct shm_buffer *window_next_buffer(struct window *window) {
+  for (auto *buffer : window->buffers) {
+    if (!buffer->busy) { return buffer; }
   }
+  if (window->pool == nullptr || window->buffers.size() >= BUFFER_RING_SIZE) {
+    return nullptr;
+  }
+
+  cairo_surface_t *cs = window->cairo_surface.get();
+  int width = cairo_image_surface_get_width(cs);
+  int height = cairo_image_surface_get_height(cs);
+  int stride = cairo_image_surface_get_stride(cs);
+  int offset;
+  void *map = shm_pool_allocate(window->pool, stride * height, &offset);
+  if (map == nullptr) { return nullptr; }
+
+  struct shm_buffer *buffer = new struct shm_buffer;
+  buffer->buffer =
+      wl_shm_pool_create_buffer(window->pool->pool, offset, width, height,
+                                stride, WL_SHM_FORMAT_ARGB8888);
+  wl_buffer_add_listener(buffer->buffer, &shm_buffer_listener, buffer);
+  buffer->data = static_cast<unsigned char *>(map);
+  cairo_rectangle_int_t all = {0, 0, width, height};
+  buffer->stale = cairo_region_create_rectangle(&all);
+  buffer->busy = false;
+  buffer->retired = false;
+  window->buffers.push_back(buffer);
+  return buffer;
+}
 
-  auto scaled = rectangle->size() * scale;
-  surface = cairo_image_surface_create_for_data(
-      static_cast<unsigned char *>(map), cairo_format, scaled.x(), scaled.y(),
-      stride);
+/* adds the tiles in which the cairo surface differs from the front buffer */
+static void window_add_damage(struct window *window, cairo_region_t *damage) {
+  cairo_surface_t *cs = window->cairo_surface.get();
+  int width = cairo_image_surface_get_width(cs);
+  int height = cairo_image_surface_get_height(cs);
+  int stride = cairo_image_surface_get_stride(cs);
 
-  cairo_surface_set_user_data(surface, &shm_surface_data_key, data,
-                              shm_surface_data_destroy);
+  if (window->front == nullptr) {
+    cairo_rectangle_int_t all = {0, 0, width, height};
+    cairo_region_union_rectangle(damage, &all);
+    return;
+  }
 
-  format = WL_SHM_FORMAT_ARGB8888; /*or WL_SHM_FORMAT_RGB565*/
+  const unsigned char *back = cairo_image_surface_get_data(cs);
+  const unsigned char *front = window->front->data;
+  for (int y0 = 0; y0 < height; y0 += DAMAGE_TILE_SIZE) {
+    int rows = std::min(DAMAGE_TILE_SIZE, height - y0);
+    int run = -1; /* first changed tile of the current run */
+    for (int x0 = 0; x0 < width; x0 += DAMAGE_TILE_SIZE) {
+      size_t bytes = std::min(DAMAGE_TILE_SIZE, width - x0) * 4;
+      bool changed = false;
+      for (int y = y0; y < y0 + rows && !changed; y++) {
+        size_t at = static_cast<size_t>(y) * stride + x0 * 4;
+        changed = memcmp(back + at, front + at, bytes) != 0;
+      }
+      if (changed && run < 0) { run = x0; }
+      if (!changed && run >= 0) {
+        cairo_rectangle_int_t r = {run, y0, x0 - run, rows};
+        cairo_region_union_rectangle(damage, &r);
+        run = -1;
+      }
+    }
+    if (run >= 0) {
+      cairo_rectangle_int_t r = {run, y0, width - run, rows};
+      cairo_region_union_rectangle(damage, &r);
+    }
+  }
+}
 
-  data->buffer = wl_shm_pool_create_buffer(pool->pool, offset, scaled.x(),
-                                           scaled.y(), stride, format);
+/* brings the stale part of buffer up to date with the cairo surface */
+static void window_fill_buffer(struct window *window,
+                               struct shm_buffer *buffer) {
+  cairo_surface_t *cs = window->cairo_surface.get();
+  const unsigned char *back = cairo_image_surface_get_data(cs);
+  int stride = cairo_image_surface_get_stride(cs);
+
+  int count = cairo_region_num_rectangles(buffer->stale);
+  for (int i = 0; i < count; i++) {
+    cairo_rectangle_int_t r;
+    cairo_region_get_rectangle(buffer->stale, i, &r);
+    for (int y = r.y; y < r.y + r.height; y++) {
+      size_t at = static_cast<size_t>(y) * stride + r.x * 4;
+      memcpy(buffer->data + at, back + at, r.width * 4);
+    }
+  }
+  cairo_region_destroy(buffer->stale);
+  buffer->stale = cairo_region_create();
+}
 
-  return std::shared_ptr<conky::draw_surface>(surface, [](auto it) {
-    if (it) cairo_surface_destroy(it);
-  });
+static void frame_done(void *data, struct wl_callback *callback,
+                       uint32_t time) {
+  struct window *window = static_cast<struct window *>(data);
+  wl_callback_destroy(callback);
+  window->frame_callback = nullptr;
+  if (window->dirty) { window_commit_buffer(window); }
 }
 
+static const struct wl_callback_listener frame_listener = {
+    /*.done =*/&frame_done,
+};
+
 void window_allocate_buffer(struct window *window) {
   assert(window->shm != nullptr);
 
   int scale = window->pending_scale;
-  struct shm_pool *pool;
-  pool = shm_pool_create(
-      window->shm, data_length_for_shm_surface(&window->rectangle, scale));
-  if (!pool) {
+  window->pool = shm_pool_create(
+      window->shm, BUFFER_RING_SIZE *
+                       data_length_for_shm_surface(&window->rectangle, scale));
+  if (!window->pool) {
     LOG_ERROR("could not allocate shm pool for {}x{} window",
               window->rectangle.width(), window->rectangle.height());
     return;
   }
 
-  window->cairo_surface = create_shm_surface_from_pool(
-      window->shm, &window->rectangle, pool, scale);
-  auto cs = window->cairo_surface.get();
+  auto scaled = window->rectangle.size() * scale;
+  cairo_surface_t *cs = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                                   scaled.x(), scaled.y());
   cairo_surface_set_device_scale(cs, scale, scale);
-
-  if (!window->cairo_surface) {
-    shm_pool_destroy(pool);
-    return;
-  }
+  window->cairo_surface =
+      std::shared_ptr<conky::draw_surface>(cs, [](auto it) {
+        if (it) cairo_surface_destroy(it);
+      });
 
   window->cr = std::shared_ptr<cairo_t>(cairo_create(cs), [](auto it) {
     if (it) cairo_destroy(it);
@@ -1214,12 +1322,6 @@ void window_allocate_buffer(struct window *window) {
   auto cr = window->cr.get();
   window->layout = pango_cairo_create_layout(cr);
   window->pango_context = pango_cairo_create_context(cr);
-
-  /* make sure we destroy the pool when the surface is destroyed */
-  struct shm_surface_data *data;
-  data = static_cast<struct shm_surface_data *>(
-      cairo_surface_get_user_data(cs, &shm_surface_data_key));
-  data->pool = pool;
 }
 
 struct window *window_create(struct wl_surface *surface, struct wl_shm *shm,
@@ -1240,6 +1342,11 @@ struct window *window_create(struct wl_surface *surface, struct wl_shm *shm,
   window->layout = nullptr;
   window->pango_context = nullptr;
 
+  window->pool = nullptr;
+  window->front = nullptr;
+  window->frame_callback = nullptr;
+  window->dirty = false;
+
   return window;
 }
 
@@ -1250,10 +1357,30 @@ void window_free_buffer(struct window *window) {
   g_object_unref(window->pango_context);
   window->layout = nullptr;
   window->pango_context = nullptr;
+
+  /* buffers the compositor still holds go when it releases them */
+  for (auto *buffer : window->buffers) {
+    if (buffer->busy) {
+      buffer->retired = true;
+    } else {
+      shm_buffer_destroy(buffer);
+    }
+  }
+  window->buffers.clear();
+  window->front = nullptr;
+  window->dirty = false;
+  if (window->pool != nullptr) {
+    shm_pool_destroy(window->pool);
+    window->pool = nullptr;
+  }
 }
 
 void window_destroy(struct window *window) {
   window_free_buffer(window);
+  if (window->frame_callback != nullptr) {
+    wl_callback_destroy(window->frame_callback);
+    window->frame_callback = nullptr;
+  }
   zwlr_layer_surface_v1_destroy(window->layer_surface);
   wl_surface_attach(window->surface, nullptr, 0, 0);
   wl_surface_commit(window->surface);
@@ -1271,18 +1398,57 @@ void window_resize(struct window *window, int width, int height) {
 }
 
 void window_commit_buffer(struct window *window) {
-  assert(window->cairo_surface != nullptr);
-  wl_surface_set_buffer_scale(global_window->surface,
-                              global_window->pending_scale);
-  wl_surface_attach(window->surface,
-                    get_buffer_from_cairo_surface(window->cairo_surface.get()),
-                    0, 0);
-  /* repaint all the pixels in the surface, change size to only repaint changed
-   * area*/
-  wl_surface_damage(window->surface, window->rectangle.x(),
-                    window->rectangle.y(), window->rectangle.width(),
-                    window->rectangle.height());
+  if (window->cairo_surface == nullptr) { return; }
+  window->dirty = true;
+
+  /* the previous frame isn't shown yet, this one follows when it is */
+  if (window->frame_callback != nullptr) { return; }
+
+  /* every buffer is in use, retried when one is released */
+  struct shm_buffer *buffer = window_next_buffer(window);
+  if (buffer == nullptr) { return; }
+
+  cairo_surface_t *cs = window->cairo_surface.get();
+  cairo_surface_flush(cs);
+
+  cairo_region_t *damage = cairo_region_create();
+  window_add_damage(window, damage);
+  window->dirty = false;
+  if (cairo_region_is_empty(damage)) {
+    /* same as what is on screen */
+    cairo_region_destroy(damage);
+    return;
+  }
+
+  for (auto *b : window->buffers) { cairo_region_union(b->stale, damage); }
+  window_fill_buffer(window, buffer);
+
+  wl_surface_set_buffer_scale(window->surface, window->pending_scale);
+  wl_surface_attach(window->surface, buffer->buffer, 0, 0);
+  int scale = std::max(window->pending_scale, 1);
+  int count = cairo_region_num_rectangles(damage);
+  for (int i = 0; i < count; i++) {
+    cairo_rectangle_int_t r;
+    cairo_region_get_rectangle(damage, i, &r);
+#ifdef WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION
+    if (wl_globals.compositor_version >=
+        WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+      wl_surface_damage_buffer(window->surface, r.x, r.y, r.width, r.height);
+      continue;
+    }
+#endif
+    /* surface coordinates, rounded outwards */
+    wl_surface_damage(window->surface, r.x / scale, r.y / scale,
+                      (r.x + r.width + scale - 1) / scale - r.x / scale,
+                      (r.y + r.height + scale - 1) / scale - r.y / scale);
+  }
+  cairo_region_destroy(damage);
+
+  window->frame_callback = wl_surface_frame(window->surface);
+  wl_callback_add_listener(window->frame_callback, &frame_listener, window);
   wl_surface_commit(window->surface);
+  buffer->busy = true;
+  window->front = buffer;
 }
 
 void window_get_width_height(struct window *window, int *w, int *h) {
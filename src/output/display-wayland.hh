@@ -74,6 +74,7 @@ class display_output_wayland : public display_output_base {
   virtual void move_win(int, int);
   virtual float get_dpi_scale();
 
+  virtual void begin_draw_stuff();
   virtual void end_draw_stuff();
   virtual void clear_text(int);
 
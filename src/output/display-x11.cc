@@ -150,6 +150,67 @@ struct _x11_stuff_s {
 #endif
 } x11_stuff;
 
+/* true when every frame redraws the whole window into a back buffer */
+static bool redraws_whole_frame() {
+#if defined(BUILD_XDBE)
+  return use_xdbe.get(*state);
+#else
+  return use_xpmdb.get(*state);
+#endif
+}
+
+#ifdef BUILD_XDBE
+/* Pixel the window background is filled with, if it is a plain colour.
+ * XdbeBackground clears the back buffer to it; see
+ * set_transparent_background() for how it is chosen. */
+static bool xdbe_background_pixel(unsigned long &pixel) {
+#ifdef OWN_WINDOW
+  if (!own_window.get(*state)) { return false; }
+  if (window.opacity == 0xff) {
+    pixel = 0;
+    return true;
+  }
+  if (window.color_depth == argb8888_color_depth) {
+    Colour c = get_background_colour_preference(*state);
+    pixel = c.to_x11_color(display, screen, true, true);
+    return true;
+  }
+#endif /* OWN_WINDOW */
+  (void)pixel;
+  return false;
+}
+#endif /* BUILD_XDBE */
+
+/* true when a frame may repaint only the lines of text that changed */
+static bool partial_repaint_allowed() {
+#if defined(BUILD_XDBE)
+  unsigned long pixel;
+  /* the back buffer is cleared by hand, which needs a plain background */
+  return !use_xdbe.get(*state) || xdbe_background_pixel(pixel);
+#else
+  return true;
+#endif
+}
+
+/* damaged bands of the current update, see get_text_damage() */
+static std::vector<conky::rect<int>> text_damage;
+
+/* adds the part of the text area to redraw into a back buffer to the
+ * region of this frame */
+static void add_text_damage(conky::vec2i border_total) {
+  if (partial_repaint_allowed() && get_text_damage(text_damage)) {
+    for (const auto &band : text_damage) {
+      XRectangle rect = band.to_xrectangle();
+      XUnionRectWithRegion(&rect, x11_stuff.region, x11_stuff.region);
+    }
+    return;
+  }
+  XRectangle rect =
+      conky::rect<int>(text_start - border_total, text_size + border_total * 2)
+          .to_xrectangle();
+  XUnionRectWithRegion(&rect, x11_stuff.region, x11_stuff.region);
+}
+
 void update_dpi() {
   // Add XRandR support if used
   // See dunst PR: https://github.com/dunst-project/dunst/pull/608
@@ -362,16 +423,7 @@ bool display_output_x11::main_loop_wait(double t) {
 
     clear_text(1);
 
-#if defined(BUILD_XDBE)
-    if (use_xdbe.get(*state)) {
-#else
-    if (use_xpmdb.get(*state)) {
-#endif
-      XRectangle rect = conky::rect<int>(text_start - border_total,
-                                         text_size + border_total * 2)
-                            .to_xrectangle();
-      XUnionRectWithRegion(&rect, x11_stuff.region, x11_stuff.region);
-    }
+    if (redraws_whole_frame()) { add_text_damage(border_total); }
   }
 
   process_surface_events(this, display);
@@ -386,16 +438,14 @@ bool display_output_x11::main_loop_wait(double t) {
   /* XDBE doesn't seem to provide a way to clear the back buffer
    * without interfering with the front buffer, other than passing
    * XdbeBackground to XdbeSwapBuffers. That means that if we're
-   * using XDBE, we need to redraw the text even if it wasn't part of
+   * swapping, we need to redraw the text even if it wasn't part of
    * the exposed area. OTOH, if we're not going to call draw_stuff at
-   * all, then no swap happens and we can safely do nothing. */
+   * all, then no swap happens and we can safely do nothing. When only
+   * the changed lines are repainted, the back buffer is copied and
+   * cleared through the clip instead, see end_draw_stuff(). */
 
   if (XEmptyRegion(x11_stuff.region) == 0) {
-#if defined(BUILD_XDBE)
-    if (use_xdbe.get(*state)) {
-#else
-    if (use_xpmdb.get(*state)) {
-#endif
+    if (redraws_whole_frame() && !partial_repaint_allowed()) {
       XRectangle rect = conky::rect<int>(text_start - border_total,
                                          text_size + border_total * 2)
                             .to_xrectangle();
@@ -408,6 +458,10 @@ bool display_output_x11::main_loop_wait(double t) {
     }
 #endif
     draw_stuff();
+    XSetClipMask(display, window.gc, None);
+#ifdef BUILD_XFT
+    if (use_xft.get(*state)) { XftDrawSetClip(window.xftdraw, nullptr); }
+#endif
     XDestroyRegion(x11_stuff.region);
     x11_stuff.region = XCreateRegion();
   }
@@ -682,6 +736,7 @@ bool handle_event<x_event_handler::CONFIGURE>(
 
       /* clear old stuff before screwing up
        * size and pos */
+      reset_text_damage();
       surface->clear_text(1);
 
       {
@@ -978,6 +1033,19 @@ float display_output_x11::get_dpi_scale() {
 
 void display_output_x11::end_draw_stuff() {
 #if defined(BUILD_XDBE)
+  unsigned long bg;
+  if (use_xdbe.get(*state) && xdbe_background_pixel(bg)) {
+    /* Copy what was drawn through the clip and clear it again in the back
+     * buffer, the way XdbeBackground would; lines that did not change are
+     * left alone on the window. */
+    XCopyArea(display, window.back_buffer, window.window, window.gc, 0, 0,
+              window.geometry.width(), window.geometry.height(), 0, 0);
+    XSetForeground(display, window.gc, bg);
+    XFillRectangle(display, window.back_buffer, window.gc, 0, 0,
+                   window.geometry.width(), window.geometry.height());
+    XFlush(display);
+    return;
+  }
   xdbe_swap_buffers();
 #else
   xpmdb_swap_buffers();
@@ -997,6 +1065,15 @@ void display_output_x11::clear_text(int exposures) {
 #endif
   if ((display != nullptr) &&
       (window.window != 0u)) {  // make sure these are !null
+    /* only the lines that changed; their exposures are what gets redrawn */
+    if (partial_repaint_allowed() && get_text_damage(text_damage)) {
+      for (const auto &band : text_damage) {
+        XClearArea(display, window.window, band.x(), band.y(), band.width(),
+                   band.height(), exposures != 0 ? True : 0);
+      }
+      return;
+    }
+
     /* there is some extra space for borders and outlines */
     int border_total = get_border_total();
 
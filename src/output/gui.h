@@ -26,6 +26,8 @@
 
 #include "config.h"
 
+#include <vector>
+
 #include "../geometry.h"
 #include "../lua/setting.hh"
 
@@ -170,6 +172,22 @@ void create_gc(void);
 
 bool out_to_gui(lua::state &l);
 
+/// @brief Collects the parts of the text area that changed since the last
+/// frame drawn.
+///
+/// Lines whose text, specials or inherited colours changed yield one band
+/// each; from the first line that moved (font, offset or special height
+/// changes) one band covers the rest of the text area.
+///
+/// @param bands receives the damaged bands, in window coordinates without
+/// `text_offset` applied.
+/// @return false if the whole text area has to be repainted.
+bool get_text_damage(std::vector<conky::rect<int>> &bands);
+
+/// @brief Forgets the last frame drawn, so the next call to
+/// get_text_damage() asks for a full repaint.
+void reset_text_damage();
+
 void print_monitor(struct text_object *, char *, unsigned int);
 void print_monitor_number(struct text_object *, char *, unsigned int);
 void print_desktop(struct text_object *, char *, unsigned int);
@@ -0,0 +1,149 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2024 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "text-damage.h"
+
+#include <algorithm>
+
+namespace {
+const uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+
+inline void hash_bytes(uint64_t &h, const void *data, size_t len) {
+  /* FNV-1a */
+  const auto *p = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+}
+
+template <typename T>
+inline void hash_value(uint64_t &h, const T &value) {
+  hash_bytes(h, &value, sizeof(value));
+}
+
+void hash_special(uint64_t &h, const special_node &s) {
+  hash_value(h, s.type);
+  hash_value(h, s.height);
+  hash_value(h, s.width);
+  hash_value(h, s.arg);
+  hash_bytes(h, s.graph_data.data(), s.graph_data.size() * sizeof(double));
+  hash_value(h, s.scale);
+  hash_value(h, s.show_scale);
+  hash_value(h, s.graph_width);
+  hash_value(h, s.scaled);
+  hash_value(h, s.scale_log);
+  hash_value(h, s.colours_set);
+  hash_value(h, s.first_colour.to_argb32());
+  hash_value(h, s.last_colour.to_argb32());
+  hash_value(h, s.font_added);
+  hash_value(h, s.tempgrad);
+  hash_value(h, s.speedgraph);
+  hash_value(h, s.invertx);
+  hash_value(h, s.inverty);
+  hash_value(h, s.minheight);
+}
+}  // namespace
+
+line_signer::line_signer()
+    : shape(FNV_OFFSET), inherited(FNV_OFFSET), content(FNV_OFFSET) {}
+
+void line_signer::add_text(const char *text, size_t len) {
+  hash_bytes(content, text, len);
+}
+
+void line_signer::add_special(const special_node &special) {
+  hash_special(content, special);
+  switch (special.type) {
+    case text_node_t::FONT:
+      hash_value(shape, special.font_added);
+      hash_value(inherited, special.font_added);
+      break;
+    case text_node_t::VOFFSET:
+      hash_value(shape, special.arg);
+      break;
+    case text_node_t::BAR:
+    case text_node_t::GAUGE:
+    case text_node_t::GRAPH:
+      hash_value(shape, special.height);
+      break;
+    case text_node_t::FG:
+    case text_node_t::BG:
+    case text_node_t::OUTLINE:
+      hash_value(inherited, special.type);
+      hash_value(inherited, special.arg);
+      break;
+    default:
+      break;
+  }
+}
+
+line_signature line_signer::end_line(size_t segment_count) {
+  /* an empty line still moves everything below it */
+  hash_value(shape, segment_count);
+  hash_value(content, shape);
+  line_signature signature{shape, content, 0, 0};
+  content = inherited;
+  return signature;
+}
+
+bool diff_text_lines(const std::vector<line_signature> &drawn,
+                     const std::vector<line_signature> &lines,
+                     conky::rect<int> area,
+                     std::vector<conky::rect<int>> &bands) {
+  bands.clear();
+  if (drawn.empty()) { return false; }
+
+  size_t common = std::min(lines.size(), drawn.size());
+  /* first line whose band may have moved */
+  size_t moved = common;
+  for (size_t i = 0; i < common; i++) {
+    if (lines[i].shape != drawn[i].shape) {
+      moved = i;
+      break;
+    }
+  }
+
+  /* shades and outlines are drawn a pixel off the text */
+  const int pad = 2;
+  auto add_band = [&](int top, int bottom) {
+    bands.emplace_back(
+        conky::vec2i(area.x() - pad, top - pad),
+        conky::vec2i(area.width() + 2 * pad, bottom - top + 2 * pad));
+  };
+  for (size_t i = 0; i < moved; i++) {
+    if (lines[i].content != drawn[i].content) {
+      add_band(drawn[i].top, drawn[i].bottom);
+    }
+  }
+  if (moved < lines.size() || moved < drawn.size()) {
+    int top = moved < drawn.size() ? drawn[moved].top : drawn.back().bottom;
+    add_band(top, area.y() + area.height());
+  }
+  return true;
+}
@@ -0,0 +1,77 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2024 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _TEXT_DAMAGE_H
+#define _TEXT_DAMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../content/specials.h"
+#include "../geometry.h"
+
+/* Condensed form of what was drawn on a line, used to find the parts of the
+ * text area that have to be repainted after an update. */
+struct line_signature {
+  /* fonts, vertical offsets and special heights of this and all earlier
+   * lines; equal shapes mean the line sits in the same band */
+  uint64_t shape;
+  /* shape, inherited colours, text and specials of the line */
+  uint64_t content;
+  int top, bottom; /* band the line was drawn in */
+};
+
+/* Computes the signatures of the lines of one layout, first to last. Fonts
+ * and colours set on a line carry over to the lines after it. */
+class line_signer {
+  uint64_t shape;
+  uint64_t inherited;
+  uint64_t content;
+
+ public:
+  line_signer();
+
+  /* the whole text of the current line */
+  void add_text(const char *text, size_t len);
+  void add_special(const special_node &special);
+  /* finishes the current line, which was split into segment_count text runs
+   * and specials */
+  line_signature end_line(size_t segment_count);
+};
+
+/* Compares the lines of a new layout with the ones last drawn in `area`.
+ * Lines whose content changed yield their old band; from the first line
+ * that moved, or was added or removed, one band covers the rest of the area.
+ * Returns false if nothing was drawn yet, i.e. everything must be
+ * repainted. */
+bool diff_text_lines(const std::vector<line_signature> &drawn,
+                     const std::vector<line_signature> &lines,
+                     conky::rect<int> area,
+                     std::vector<conky::rect<int>> &bands);
+
+#endif /* _TEXT_DAMAGE_H */
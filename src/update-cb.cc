@@ -25,13 +25,25 @@
 
 #include "update-cb.hh"
 
+#include <cxxabi.h>
 #include <unistd.h>
+#include <chrono>
+#include <cstdlib>
 #include <typeinfo>
 
 namespace conky {
 namespace {
 semaphore sem_wait;
 enum { UNUSED_MAX = 5 };
+
+std::string demangled_name(const std::type_info &type) {
+  int status = 0;
+  char *name = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+  if (name == nullptr) { return type.name(); }
+  std::string result(name);
+  free(name);
+  return result;
+}
 }  // namespace
 
 namespace priv {
@@ -102,6 +114,11 @@ callback_base::handle callback_base::do_register_cb(const handle &h) {
 }
 
 void callback_base::run() {
+  if (!needs_thread()) {
+    timed_work();
+    if (wait) { sem_wait.post(); }
+    return;
+  }
   if (thread == nullptr) {
     thread = new std::thread(&callback_base::start_routine, this);
   }
@@ -110,6 +127,9 @@ void callback_base::run() {
 }
 
 void callback_base::start_routine() {
+  const std::string name = demangled_name(typeid(*this));
+  conky::log::set_thread_name(name);
+
   for (;;) {
     sem_start.wait();
     if (done) { return; }
@@ -120,16 +140,29 @@ void callback_base::start_routine() {
       // do nothing
     }
 
-    work();
+    {
+      auto _scope = LOG_SCOPE(name);
+      timed_work();
+    }
     if (wait) { sem_wait.post(); }
   }
 }
 
+void callback_base::timed_work() {
+  auto start = std::chrono::steady_clock::now();
+  work();
+  last_work_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  ++work_runs;
+}
+
 callback_base::Callbacks callback_base::callbacks(1, get_hash, is_equal);
 }  // namespace priv
 
 void run_all_callbacks() {
   using priv::callback_base;
+  auto _scope = LOG_SCOPE("run_all_callbacks");
 
   size_t wait = 0;
   for (auto i = callback_base::callbacks.begin();
@@ -23,6 +23,7 @@
 #ifndef UPDATE_CB_HH
 #define UPDATE_CB_HH
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <thread>
@@ -70,9 +71,11 @@ class callback_base {
 
   void run();
   void start_routine();
+  void timed_work();
   void stop();
 
   static void deleter(callback_base *ptr) {
+    ptr->cancel();
     ptr->stop();
     delete ptr;
   }
@@ -113,6 +116,15 @@ class callback_base {
   // to be implemented by descendant classes
   virtual void work() = 0;
 
+  // Callbacks whose work() only hands a job to another thread (e.g. curl
+  // transfers) return false to have it called from run_all_callbacks()
+  // instead of from a thread of their own.
+  virtual bool needs_thread() const { return true; }
+
+  // called before the callback is stopped and destroyed, while descendant
+  // classes are still intact
+  virtual void cancel() {}
+
   // called when two registered objects evaluate as equal, the latter is removed
   // afterwards
   virtual void merge(callback_base &&);
@@ -120,6 +132,11 @@ class callback_base {
  public:
   std::mutex result_mutex;
 
+  /* duration of the last work() and the number of runs so far, read by the
+   * object profiler from the main thread */
+  std::atomic<uint64_t> last_work_ns{0};
+  std::atomic<uint64_t> work_runs{0};
+
   virtual ~callback_base();
 };
 
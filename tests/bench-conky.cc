@@ -0,0 +1,165 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2024 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Microbenchmarks for the Linux collectors and the text generator. The
+ * collectors read the recorded /proc and /sys snapshots in tests/bench/root
+ * (or the ones under $CONKY_BENCH_ROOT, see tests/bench/record-root.sh)
+ * through the `system_root` setting, so results are comparable between
+ * machines and runs. Use Catch2's reporters
+ * for machine-readable output, e.g.
+ *
+ *   bench-conky --reporter JSON::out=bench.json
+ */
+
+#include "catch2/catch.hpp"
+
+#include <common.h>
+#include <conky.h>
+#include <content/text_object.h>
+#include <core.h>
+#include <data/hardware/diskio.h>
+#include <data/os/linux.h>
+#include <data/top.h>
+#include <lua/llua.h>
+#include <lua/lua-config.hh>
+#include <lua/setting.hh>
+
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace {
+/* The recorded tree holds numbered snapshots taken one update interval
+ * apart: root/0, root/1, ... */
+const std::vector<std::string> &snapshots() {
+  static std::vector<std::string> dirs;
+  if (!dirs.empty()) { return dirs; }
+
+  const char *env = getenv("CONKY_BENCH_ROOT");
+  std::string root = env != nullptr ? env : BENCH_DATA_DIR "/root";
+  for (int i = 0;; i++) {
+    std::string dir = root + "/" + std::to_string(i);
+    if (!std::filesystem::is_directory(dir)) { break; }
+    dirs.push_back(dir);
+  }
+  if (dirs.empty()) { FAIL("no snapshots under " << root); }
+  return dirs;
+}
+
+/* Loads a bundled config the way initialisation() does, pointed at the
+ * recorded tree. */
+void load_bench_config(const char *name, struct text_object *root) {
+  if (state) { conky::cleanup_config_settings(*state); }
+  state = std::make_unique<lua::state>();
+  conky::export_symbols(*state);
+  llua_init();
+
+  current_config = std::string(BENCH_DATA_DIR "/") + name;
+  load_config_file();
+
+  lua::state &l = *state;
+  l.getglobal("conky");
+  l.rawgetfield(-1, "config");
+  l.pushstring(snapshots()[0].c_str());
+  l.rawsetfield(-2, "system_root");
+  l.pop(2);
+  conky::set_config_settings(l);
+
+  extract_variable_text_internal(root, get_global_text());
+}
+
+/* Collectors skip samples taken at the same timestamp and divide by the time
+ * between updates, so every iteration is one update interval later and reads
+ * the next snapshot, wrapping around at the end. */
+void tick() {
+  static size_t next = 0;
+  const std::vector<std::string> &dirs = snapshots();
+
+  last_update_time = current_update_time;
+  current_update_time += 1.0;
+  system_root = dirs[next++ % dirs.size()];
+}
+
+void update_all() {
+  tick();
+  update_stat();
+  update_meminfo();
+  update_net_stats();
+  update_diskio();
+  update_top();
+}
+}  // namespace
+
+TEST_CASE("Collectors", "[collectors]") {
+  struct text_object root {};
+  load_bench_config("top.conf", &root);
+  update_all();
+
+  BENCHMARK("update_stat") {
+    tick();
+    return update_stat();
+  };
+  BENCHMARK("update_meminfo") {
+    tick();
+    return update_meminfo();
+  };
+  BENCHMARK("update_net_stats") {
+    tick();
+    return update_net_stats();
+  };
+  BENCHMARK("update_diskio") {
+    tick();
+    return update_diskio();
+  };
+  BENCHMARK("update_top") {
+    tick();
+    return update_top();
+  };
+
+  free_text_objects(&root);
+}
+
+TEST_CASE("Text generation", "[text]") {
+  std::vector<char> out(16384);
+
+  for (const char *name : {"system.conf", "top.conf"}) {
+    struct text_object root {};
+    load_bench_config(name, &root);
+    update_all();
+    update_all();
+
+    BENCHMARK(std::string("generate_text_internal ") + name) {
+      generate_text_internal(out.data(), out.size(), root);
+      return out[0];
+    };
+
+    free_text_objects(&root);
+  }
+}
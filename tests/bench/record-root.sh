@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# record-root.sh - record /proc and /sys snapshots for bench-conky
+#
+# Usage: record-root.sh <dir> [snapshots] [interval]
+#
+# Copies the files the Linux collectors read into <dir>/0, <dir>/1, ...
+# taken <interval> seconds apart (defaults: 2 snapshots, 1 second). Point
+# bench-conky at the result with CONKY_BENCH_ROOT=<dir>.
+#
+# Process command lines are recorded as-is; check them before sharing a
+# recording.
+
+set -e
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <dir> [snapshots] [interval]" >&2
+    exit 1
+fi
+
+out=$1
+count=${2:-2}
+interval=${3:-1}
+
+copy() {
+    mkdir -p "$(dirname "$2$1")"
+    cat "$1" >"$2$1" 2>/dev/null || rm -f "$2$1"
+}
+
+i=0
+while [ "$i" -lt "$count" ]; do
+    [ "$i" -gt 0 ] && sleep "$interval"
+    dest=$out/$i
+    rm -rf "$dest"
+
+    for f in stat meminfo loadavg uptime mounts diskstats \
+        net/dev net/route net/if_inet6; do
+        copy "/proc/$f" "$dest"
+    done
+    copy /sys/devices/system/cpu/present "$dest"
+    for b in /sys/block/*; do
+        mkdir -p "$dest$b"
+        copy "$b/ro" "$dest"
+    done
+    for p in /proc/[0-9]*; do
+        for f in stat cmdline io; do
+            copy "$p/$f" "$dest"
+        done
+        rmdir "$dest$p" 2>/dev/null || true
+    done
+
+    i=$((i + 1))
+done
@@ -1,7 +1,11 @@
 #include "catch2/catch.hpp"
 
 #include <config.h>
+#include <conky.h>
 #include <content/algebra.h>
+#include <content/text_object.h>
+#include <core.h>
+#include <lua/lua-config.hh>
 
 TEST_CASE("GetMatchTypeTest - ValidOperators") {
   REQUIRE(get_match_type("a==b") == OP_EQ);
@@ -131,3 +135,39 @@ TEST_CASE("CompareTest - More test cases") {
   REQUIRE(compare("\"FRITZ!Box 7520 HI\" == \"off/any\"") ==
           0);  // "FRITZ!Box 7520 HI" == "off/any"
 }
+
+static int check_match(const char *expr) {
+  struct text_object obj{};
+  init_if_match(&obj, expr);
+  int result = check_if_match(&obj);
+  obj.callbacks.free(&obj);
+  free_text_objects(obj.sub);
+  free(obj.sub);
+  return result;
+}
+
+TEST_CASE("check_if_match evaluates compiled expressions", "[check_if_match]") {
+  state = std::make_unique<lua::state>();
+  conky::export_symbols(*state);
+
+  SECTION("Constant expressions") {
+    REQUIRE(check_match("1 < 2") == 1);
+    REQUIRE(check_match("2.5 <= 2") == 0);
+    REQUIRE(check_match("\"a!=b\" == \"a!=b\"") == 1);
+  }
+
+  SECTION("Expressions with variables") {
+    REQUIRE(check_match("${to_bytes 2k} == 2048") == 1);
+    REQUIRE(check_match("2048.5 < ${to_bytes 2k}") == 0);
+    REQUIRE(check_match("\"${to_bytes 1}\" != \"1\"") == 0);
+  }
+
+  SECTION("Mismatched types are true, like failed compares") {
+    REQUIRE(check_match("\"x\" == ${to_bytes 1}") == 1);
+  }
+
+  SECTION("A lone quote is a bad argument, not a crash") {
+    REQUIRE(check_match("1 == \"") == 1);
+    REQUIRE(check_match("${to_bytes 1} == \"") == 1);
+  }
+}
@@ -29,7 +29,15 @@
 #include "catch2/catch.hpp"
 
 #include <conky.h>
+#include <content/profile.h>
+#include <content/text_object.h>
+#include <core.h>
 #include <lua/lua-config.hh>
+#include <output/text-damage.h>
+
+#include <array>
+#include <string>
+#include <vector>
 
 TEST_CASE("Expressions can be evaluated", "[evaluate]") {
   state = std::make_unique<lua::state>();
@@ -44,3 +52,231 @@ TEST_CASE("Expressions can be evaluated", "[evaluate]") {
     REQUIRE(strncmp(input, result, kMaxSize) == 0);
   }
 }
+
+namespace {
+// generates text once through the compiled program and once by walking the
+// object list, returning both
+std::pair<std::string, std::string> generate_both(const char *text,
+                                                  int size = 256) {
+  struct text_object root {};
+  std::string compiled(size, '\0'), walked(size, '\0');
+
+  extract_variable_text_internal(&root, text);
+  REQUIRE(root.program != nullptr);
+  generate_text_internal(compiled.data(), size, root);
+
+  struct text_object uncompiled = root;
+  uncompiled.program = nullptr;
+  generate_text_internal(walked.data(), size, uncompiled);
+
+  free_text_objects(&root);
+  compiled.resize(strlen(compiled.c_str()));
+  walked.resize(strlen(walked.c_str()));
+  return {compiled, walked};
+}
+
+// a conky.text with lots of plain text, ifblocks and cheap objects
+std::string large_sample_text() {
+  std::string text;
+  for (int i = 0; i < 200; i++) {
+    text +=
+        "CPU ${to_bytes 2k} $$ ${if_match 1 < 2}yes${else}no${endif}\n"
+        "${if_empty ${to_bytes 1}}empty${else}${to_bytes 3k}${endif} "
+        "# a comment\n"
+        "${if_match \"a\" == \"b\"}${to_bytes 1}${if_match 1 == 1}x"
+        "${endif}${endif} tail\n";
+  }
+  return text;
+}
+}  // namespace
+
+TEST_CASE("Compiled text programs match the object list walk",
+          "[generate_text_internal]") {
+  state = std::make_unique<lua::state>();
+  conky::export_symbols(*state);
+
+  SECTION("plain text and ifblocks") {
+    const char *texts[] = {
+        "text",
+        "a$$b",
+        "${if_match 1 < 2}yes${else}no${endif} after",
+        "${if_match 1 > 2}yes${else}no${endif} after",
+        "${if_match 1 > 2}a${if_match 1 < 2}b${else}c${endif}d${endif}e",
+        "${if_match 1 < 2}a${if_match 1 > 2}b${else}c${endif}d${endif}e",
+        "${if_match 1 > 2}missing endif",
+        "x${if_match 1 > 2}${endif}y${to_bytes 2k}z",
+    };
+    for (const char *text : texts) {
+      auto [compiled, walked] = generate_both(text);
+      REQUIRE(compiled == walked);
+    }
+  }
+
+  SECTION("output is truncated the same way") {
+    for (int size : {1, 2, 5, 17}) {
+      auto [compiled, walked] =
+          generate_both("abc${to_bytes 2k}def${if_match 1 < 2}ghij${endif}",
+                        size);
+      REQUIRE(compiled == walked);
+    }
+  }
+
+  SECTION("large sample") {
+    auto [compiled, walked] = generate_both(large_sample_text().c_str(), 65536);
+    REQUIRE(compiled == walked);
+    REQUIRE(!compiled.empty());
+  }
+}
+
+// Run with: test-conky "[benchmark]"
+TEST_CASE("Per-frame text generation cost", "[.][benchmark]") {
+  state = std::make_unique<lua::state>();
+  conky::export_symbols(*state);
+
+  constexpr int kSize = 65536;
+  std::string out(kSize, '\0');
+  struct text_object root {};
+  extract_variable_text_internal(&root, large_sample_text().c_str());
+  struct text_object uncompiled = root;
+  uncompiled.program = nullptr;
+
+  BENCHMARK("object list walk") {
+    generate_text_internal(out.data(), kSize, uncompiled);
+    return out[0];
+  };
+
+  BENCHMARK("compiled program") {
+    generate_text_internal(out.data(), kSize, root);
+    return out[0];
+  };
+
+  free_text_objects(&root);
+}
+
+TEST_CASE("Objects with a profile entry are timed", "[profile]") {
+  state = std::make_unique<lua::state>();
+  conky::export_symbols(*state);
+
+  struct text_object root {};
+  extract_variable_text_internal(&root, "a${to_bytes 2k}b");
+  object_profile *p = profile_object("to_bytes", 1);
+  /* the plain texts around it stay unprofiled */
+  root.next->next->profile = p;
+
+  char out[64];
+  for (int i = 0; i < 3; i++) { generate_text_internal(out, sizeof out, root); }
+  REQUIRE(p->calls == 3);
+  REQUIRE(p->max_ns <= p->total_ns);
+  REQUIRE(profile_object("to_bytes", 1) == p);
+
+  std::string json = profile_json();
+  REQUIRE(json.find("\"name\":\"to_bytes\",\"line\":1,\"calls\":3") !=
+          std::string::npos);
+
+  free_text_objects(&root);
+}
+
+namespace {
+struct sample_line {
+  std::string text;
+  std::vector<special_node> specials;
+};
+
+/* signs the lines as a layout of one text run per line plus its specials,
+ * each line drawn 10 pixels below the previous one */
+std::vector<line_signature> sign_lines(const std::vector<sample_line> &lines) {
+  std::vector<line_signature> signatures;
+  line_signer signer;
+  for (const auto &line : lines) {
+    signer.add_text(line.text.data(), line.text.size());
+    for (const auto &special : line.specials) { signer.add_special(special); }
+    line_signature signature = signer.end_line(1 + line.specials.size());
+    signature.top = 10 * static_cast<int>(signatures.size());
+    signature.bottom = signature.top + 10;
+    signatures.push_back(signature);
+  }
+  return signatures;
+}
+
+special_node graph(std::vector<double> data, short height = 20) {
+  special_node node{};
+  node.type = text_node_t::GRAPH;
+  node.height = height;
+  node.graph_data = std::move(data);
+  return node;
+}
+
+special_node colour(double arg) {
+  special_node node{};
+  node.type = text_node_t::FG;
+  node.arg = arg;
+  return node;
+}
+
+using box = std::array<int, 4>;
+
+std::vector<box> boxes(const std::vector<conky::rect<int>> &bands) {
+  std::vector<box> out;
+  for (const auto &b : bands) {
+    out.push_back(box{b.x(), b.y(), b.width(), b.height()});
+  }
+  return out;
+}
+}  // namespace
+
+TEST_CASE("Text damage covers the lines that changed", "[text_damage]") {
+  const conky::rect<int> area(conky::vec2i(5, 0), conky::vec2i(100, 40));
+  std::vector<sample_line> sample = {
+      {"cpu 3%", {}}, {"mem 1GiB", {graph({1, 2, 3})}}, {"up 2d", {}}};
+  std::vector<line_signature> drawn = sign_lines(sample);
+  std::vector<conky::rect<int>> bands;
+
+  SECTION("nothing drawn yet repaints everything") {
+    REQUIRE_FALSE(diff_text_lines({}, drawn, area, bands));
+  }
+
+  SECTION("unchanged lines need no repaint") {
+    REQUIRE(diff_text_lines(drawn, sign_lines(sample), area, bands));
+    REQUIRE(bands.empty());
+  }
+
+  SECTION("a changed line repaints its own band") {
+    sample[2].text = "up 3d";
+    REQUIRE(diff_text_lines(drawn, sign_lines(sample), area, bands));
+    REQUIRE(boxes(bands) == std::vector<box>{{3, 18, 104, 14}});
+  }
+
+  SECTION("new graph data repaints the graph's line") {
+    sample[1].specials[0] = graph({2, 3, 4});
+    REQUIRE(diff_text_lines(drawn, sign_lines(sample), area, bands));
+    REQUIRE(boxes(bands) == std::vector<box>{{3, 8, 104, 14}});
+  }
+
+  SECTION("a taller graph moves every line after it") {
+    sample[1].specials[0] = graph({1, 2, 3}, 30);
+    REQUIRE(diff_text_lines(drawn, sign_lines(sample), area, bands));
+    REQUIRE(boxes(bands) == std::vector<box>{{3, 8, 104, 34}});
+  }
+
+  SECTION("a colour carries over to the lines after it") {
+    sample[0].specials.push_back(colour(1));
+    drawn = sign_lines(sample);
+    sample[0].specials[0] = colour(2);
+    REQUIRE(diff_text_lines(drawn, sign_lines(sample), area, bands));
+    REQUIRE(boxes(bands) == std::vector<box>{{3, -2, 104, 14},
+                                             {3, 8, 104, 14},
+                                             {3, 18, 104, 14}});
+  }
+
+  SECTION("an added line repaints from the end of the old text") {
+    sample.push_back({"load 0.5", {}});
+    REQUIRE(diff_text_lines(drawn, sign_lines(sample), area, bands));
+    REQUIRE(boxes(bands) == std::vector<box>{{3, 28, 104, 14}});
+  }
+
+  SECTION("a removed line repaints from where it was") {
+    sample.erase(sample.begin() + 1);
+    REQUIRE(diff_text_lines(drawn, sign_lines(sample), area, bands));
+    REQUIRE(boxes(bands) == std::vector<box>{{3, 8, 104, 34}});
+  }
+}
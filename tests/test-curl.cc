@@ -0,0 +1,171 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2024 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <config.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <data/network/ccurl_thread.h>
+
+namespace {
+/*
+ * Minimal HTTP/1.1 stand-in on 127.0.0.1: answers every request with the same
+ * body and ETag, and with 304 to a matching If-None-Match unless
+ * ignore_conditional is set. Connections are kept alive.
+ */
+class test_server {
+  int listen_fd = -1;
+  std::thread acceptor;
+  std::vector<std::thread> connections;
+  std::vector<int> connection_fds;
+
+  void serve(int fd) {
+    std::string in;
+    char buf[1024];
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof buf)) > 0) {
+      in.append(buf, len);
+      size_t end;
+      while ((end = in.find("\r\n\r\n")) != std::string::npos) {
+        std::string request = in.substr(0, end);
+        in.erase(0, end + 4);
+        ++requests;
+
+        std::string response;
+        if (!ignore_conditional &&
+            request.find("If-None-Match: \"v1\"") != std::string::npos) {
+          ++conditional_hits;
+          response = "HTTP/1.1 304 Not Modified\r\n\r\n";
+        } else {
+          response =
+              "HTTP/1.1 200 OK\r\nETag: \"v1\"\r\n"
+              "Content-Length: 5\r\n\r\nhello";
+        }
+        if (write(fd, response.data(), response.size()) < 0) { break; }
+      }
+    }
+  }
+
+ public:
+  int port = 0;
+  std::atomic<int> accepted{0};
+  std::atomic<int> requests{0};
+  std::atomic<int> conditional_hits{0};
+  std::atomic<bool> ignore_conditional{false};
+
+  test_server() {
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr);
+    listen(listen_fd, 8);
+    socklen_t addr_len = sizeof addr;
+    getsockname(listen_fd, reinterpret_cast<sockaddr *>(&addr), &addr_len);
+    port = ntohs(addr.sin_port);
+
+    acceptor = std::thread([this] {
+      int fd;
+      while ((fd = accept(listen_fd, nullptr, nullptr)) >= 0) {
+        ++accepted;
+        connection_fds.push_back(fd);
+        connections.emplace_back(&test_server::serve, this, fd);
+      }
+    });
+  }
+
+  ~test_server() {
+    shutdown(listen_fd, SHUT_RDWR);
+    close(listen_fd);
+    acceptor.join();
+    // pooled client connections stay open, end them from this side
+    for (int fd : connection_fds) { shutdown(fd, SHUT_RDWR); }
+    for (auto &t : connections) { t.join(); }
+    for (int fd : connection_fds) { close(fd); }
+  }
+
+  std::string url() const {
+    return "http://127.0.0.1:" + std::to_string(port) + "/feed";
+  }
+};
+
+class counting_fetch : public priv::curl_internal {
+ public:
+  int processed = 0;
+  std::string body;
+
+  explicit counting_fetch(const std::string &url) : curl_internal(url) {}
+
+  void process_data() override {
+    ++processed;
+    body = data;
+  }
+};
+}  // namespace
+
+TEST_CASE("curl transfers share connections and honour validators",
+          "[curl]") {
+  test_server server;
+  counting_fetch feed(server.url());
+
+  feed.do_work();
+  REQUIRE(feed.processed == 1);
+  REQUIRE(feed.body == "hello");
+  REQUIRE(feed.etag == "\"v1\"");
+
+  SECTION("unchanged feeds are not processed again") {
+    feed.do_work();
+    REQUIRE(server.conditional_hits == 1);
+    REQUIRE(feed.processed == 1);
+    // the 304 carried no ETag, the old one is kept for the next request
+    feed.do_work();
+    REQUIRE(server.conditional_hits == 2);
+
+    server.ignore_conditional = true;
+    feed.do_work();
+    REQUIRE(server.requests == 4);
+    REQUIRE(feed.processed == 1);
+  }
+
+  SECTION("fetchers reuse the connection to the same host") {
+    counting_fetch other(server.url());
+    other.do_work();
+    REQUIRE(other.processed == 1);
+    REQUIRE(server.accepted == 1);
+  }
+}
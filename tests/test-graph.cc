@@ -64,14 +64,6 @@ static std::pair<struct graph, bool> test_parse(const char *s) {
   return {graph, result};
 }
 
-static void free_specials_list() {
-  while (specials != nullptr) {
-    auto *next = specials->next;
-    delete specials;
-    specials = next;
-  }
-}
-
 std::string unquote(const std::string &s) {
   auto out = s;
   out.erase(remove(out.begin(), out.end(), '\"'), out.end());
@@ -234,11 +226,11 @@ TEST_CASE("graph slot reuse across draw cycles") {
     special_count = 0;
     new_graph(&obj, buf, sizeof(buf), 2.0);
 
-    REQUIRE(specials->graph_data[0] == 2.0);
-    REQUIRE(specials->graph_data[1] == 1.0);
+    REQUIRE(specials[0].graph_data[0] == 2.0);
+    REQUIRE(specials[0].graph_data[1] == 1.0);
 
     obj.callbacks.free(&obj);
-    free_specials_list();
+    free_specials();
   }
 
   SECTION(
@@ -255,12 +247,12 @@ TEST_CASE("graph slot reuse across draw cycles") {
     special_count = 0;
     new_graph(&obj2, buf, sizeof(buf), 2.0);
 
-    REQUIRE(specials->graph_data[0] == 2.0);
-    REQUIRE(specials->graph_data[1] == 0.0);  // cleared, not 1.0
+    REQUIRE(specials[0].graph_data[0] == 2.0);
+    REQUIRE(specials[0].graph_data[1] == 0.0);  // cleared, not 1.0
 
     obj1.callbacks.free(&obj1);
     obj2.callbacks.free(&obj2);
-    free_specials_list();
+    free_specials();
   }
 }
 
@@ -0,0 +1,123 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2024 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <config.h>
+#include <conky.h>
+#include <lua/lua-config.hh>
+#include <output/display-http.hh>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+#include <microhttpd.h>
+
+#ifdef MHD_YES
+/* older API */
+#define MHD_Result int
+#endif /* MHD_YES */
+
+namespace conky {
+MHD_Result sendanswer(void *cls, struct MHD_Connection *connection,
+                      const char *url, const char *method, const char *version,
+                      const char *upload_data, size_t *upload_data_size,
+                      void **con_cls);
+}  // namespace conky
+
+namespace {
+sockaddr_in loopback(uint16_t port) {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  return addr;
+}
+
+uint16_t free_port() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = loopback(0);
+  socklen_t len = sizeof addr;
+  bind(fd, reinterpret_cast<sockaddr *>(&addr), len);
+  getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len);
+  close(fd);
+  return ntohs(addr.sin_port);
+}
+
+std::string http_get(uint16_t port, const std::string &path) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr = loopback(port);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof addr) != 0) {
+    close(fd);
+    return "";
+  }
+  std::string request = "GET " + path +
+                        " HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                        "Connection: close\r\n\r\n";
+  if (write(fd, request.data(), request.size()) < 0) {
+    close(fd);
+    return "";
+  }
+  std::string response;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof buf)) > 0) { response.append(buf, n); }
+  close(fd);
+  return response;
+}
+}  // namespace
+
+TEST_CASE("metrics are served over http", "[http]") {
+  state = std::make_unique<lua::state>();
+  conky::export_symbols(*state);
+  state->loadstring("conky.config = { http_metrics = true }");
+  state->call(0, 0);
+  conky::set_config_settings(*state);
+  conky::update_metrics();
+
+  uint16_t port = free_port();
+  struct MHD_Daemon *daemon =
+      MHD_start_daemon(MHD_USE_SELECT_INTERNALLY, port, nullptr, nullptr,
+                       &conky::sendanswer, nullptr, MHD_OPTION_END);
+  REQUIRE(daemon != nullptr);
+
+  std::string response = http_get(port, "/metrics");
+  MHD_stop_daemon(daemon);
+  conky::cleanup_config_settings(*state);
+
+  REQUIRE(response.rfind("HTTP/1.1 200", 0) == 0);
+  REQUIRE(response.find("text/plain; version=0.0.4") != std::string::npos);
+  REQUIRE(response.find("# TYPE conky_memory_bytes gauge\n") !=
+          std::string::npos);
+  REQUIRE(response.find("conky_memory_bytes{type=\"max\"} ") !=
+          std::string::npos);
+}
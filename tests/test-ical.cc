@@ -0,0 +1,176 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2024 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <conky.h>
+#include <content/text_object.h>
+#include <data/ical.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <update-cb.hh>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+const char *const calendar =
+    "BEGIN:VCALENDAR\n"
+    "VERSION:2.0\n"
+    "PRODID:-//conky//tests//EN\n"
+    "BEGIN:VEVENT\n"
+    "UID:weekly\n"
+    "DTSTART:20200106T090000Z\n"
+    "RRULE:FREQ=WEEKLY\n"
+    "SUMMARY:weekly\n"
+    "END:VEVENT\n"
+    "BEGIN:VEVENT\n"
+    "UID:counted\n"
+    "DTSTART:20200101T090000Z\n"
+    "RRULE:FREQ=YEARLY;COUNT=500\n"
+    "SUMMARY:counted\n"
+    "END:VEVENT\n"
+    "BEGIN:VEVENT\n"
+    "UID:exhausted\n"
+    "DTSTART:20200101T090000Z\n"
+    "RRULE:FREQ=DAILY;COUNT=3\n"
+    "SUMMARY:exhausted\n"
+    "END:VEVENT\n"
+    "BEGIN:VEVENT\n"
+    "UID:once\n"
+    "DTSTART:20200101T090000Z\n"
+    "SUMMARY:once\n"
+    "END:VEVENT\n"
+    "BEGIN:VEVENT\n"
+    "UID:future\n"
+    "DTSTART:20990101T090000Z\n"
+    "SUMMARY:future\n"
+    "END:VEVENT\n"
+    "END:VCALENDAR\n";
+
+const char *const rewritten =
+    "BEGIN:VCALENDAR\n"
+    "VERSION:2.0\n"
+    "PRODID:-//conky//tests//EN\n"
+    "BEGIN:VEVENT\n"
+    "UID:moved\n"
+    "DTSTART:20980101T090000Z\n"
+    "SUMMARY:moved\n"
+    "END:VEVENT\n"
+    "END:VCALENDAR\n";
+
+struct ical_file {
+  std::string dir;
+  std::string path;
+
+  ical_file() {
+    char tmpl[] = "/tmp/conky-ical-XXXXXX";
+    REQUIRE(mkdtemp(tmpl) != nullptr);
+    dir = tmpl;
+    path = dir + "/events.ics";
+  }
+  ~ical_file() {
+    unlink(path.c_str());
+    rmdir(dir.c_str());
+  }
+
+  void write(const char *text) const {
+    std::ofstream(path, std::ios::trunc) << text;
+  }
+};
+
+struct ical_objects {
+  std::vector<text_object> objs;
+
+  ical_objects(const std::string &path, unsigned int count) : objs(count) {
+    for (unsigned int i = 0; i < count; ++i) {
+      std::string arg = std::to_string(i + 1) + " " + path;
+      parse_ical_args(&objs[i], arg.c_str(), nullptr, nullptr);
+    }
+  }
+  ~ical_objects() {
+    for (text_object &obj : objs) { free_ical(&obj); }
+  }
+
+  std::vector<std::string> print() {
+    std::vector<std::string> out;
+    char buf[64];
+
+    for (text_object &obj : objs) {
+      buf[0] = '\0';
+      print_ical(&obj, buf, sizeof(buf));
+      out.emplace_back(buf);
+    }
+    return out;
+  }
+
+  /* the callback doesn't block the update, so give it a few */
+  std::vector<std::string> update_until(bool (*done)(
+      const std::vector<std::string> &)) {
+    std::vector<std::string> out;
+
+    for (int i = 0; i < 500; ++i) {
+      conky::run_all_callbacks();
+      out = print();
+      if (done(out)) { break; }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return out;
+  }
+};
+}  // namespace
+
+TEST_CASE("ical lists the upcoming events soonest first", "[ical]") {
+  ical_file file;
+  file.write(calendar);
+  ical_objects ical(file.path, 4);
+
+  std::vector<std::string> events =
+      ical.update_until([](const std::vector<std::string> &out) {
+        return !out[0].empty();
+      });
+
+  // past one-off events and exhausted COUNT rules are gone; both open
+  // rules have an occurrence in the next year, in either order
+  REQUIRE(((events[0] == "weekly" && events[1] == "counted") ||
+           (events[0] == "counted" && events[1] == "weekly")));
+  REQUIRE(events[2] == "future");
+  REQUIRE(events[3].empty());
+
+  SECTION("a rewritten file is read again") {
+    file.write(rewritten);
+    events = ical.update_until([](const std::vector<std::string> &out) {
+      return out[0] == "moved";
+    });
+    REQUIRE(events[0] == "moved");
+    REQUIRE(events[1].empty());
+  }
+}
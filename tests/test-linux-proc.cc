@@ -32,6 +32,7 @@
 #include <conky.h>
 #include <content/text_object.h>
 #include <data/proc.h>
+#include <data/top.h>
 #include <sys/prctl.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -58,6 +59,9 @@ void ensure_lua_state() {
   conky::export_symbols(*state);
 }
 
+/* pid_* objects cache what they read for the length of one update */
+void next_update() { current_update_time += 1.0; }
+
 struct sub_text_object {
   struct text_object root{};
   struct text_object obj{};
@@ -178,9 +182,13 @@ bool parse_proc_stat_times(const std::string &stat, unsigned long int *utime,
 
 TEST_CASE("cmdline_to_pid finds the current process",
           "[proc][cmdline_to_pid]") {
+  ensure_lua_state();
   std::string cmdline = read_cmdline();
   REQUIRE_FALSE(cmdline.empty());
 
+  top_running = 1;
+  update_top();
+
   struct text_object obj{};
   obj.data.s = strdup(cmdline.c_str());
 
@@ -192,8 +200,44 @@ TEST_CASE("cmdline_to_pid finds the current process",
   REQUIRE(std::string(buf) == std::to_string(getpid()));
 }
 
+TEST_CASE("cmdline_to_pid matches past the first BUFFER_LEN bytes",
+          "[proc][cmdline_to_pid]") {
+  ensure_lua_state();
+  std::string marker = "conky-test-long-cmdline-" + std::to_string(getpid());
+  std::string arg = std::string(2 * BUFFER_LEN, 'x') + marker;
+
+  pid_t child = fork();
+  REQUIRE(child >= 0);
+  if (child == 0) {
+    /* the trailing `:` keeps sh from exec'ing sleep in its place */
+    execl("/bin/sh", "sh", "-c", "sleep 10; :", "sh", arg.c_str(), nullptr);
+    _exit(127);
+  }
+
+  /* wait for the exec to show up in /proc */
+  std::string path = "/proc/" + std::to_string(child) + "/cmdline";
+  for (int i = 0; i < 200; i++) {
+    std::ifstream input(path, std::ios::binary);
+    std::string cmdline((std::istreambuf_iterator<char>(input)),
+                        std::istreambuf_iterator<char>());
+    if (cmdline.find(marker) != std::string::npos) { break; }
+    usleep(10000);
+  }
+
+  top_running = 1;
+  next_update();
+  update_top();
+  pid_t found = get_pid_by_cmdline(marker);
+
+  kill(child, SIGKILL);
+  waitpid(child, nullptr, 0);
+
+  REQUIRE(found == child);
+}
+
 TEST_CASE("pid_time handles comm with spaces", "[proc][pid_time]") {
   ensure_lua_state();
+  next_update();
 
   proc_name_guard name_guard;
   REQUIRE(name_guard.ok);
@@ -225,6 +269,7 @@ TEST_CASE("pid_time handles comm with spaces", "[proc][pid_time]") {
 TEST_CASE("pid_time_kernelmode uses system time",
           "[proc][pid_time_kernelmode]") {
   ensure_lua_state();
+  next_update();
 
   std::ifstream input("/proc/self/stat", std::ios::binary);
   std::string stat((std::istreambuf_iterator<char>(input)),
@@ -251,6 +296,7 @@ TEST_CASE("pid_time_kernelmode uses system time",
 
 TEST_CASE("pid_time_usermode uses user time", "[proc][pid_time_usermode]") {
   ensure_lua_state();
+  next_update();
 
   std::ifstream input("/proc/self/stat", std::ios::binary);
   std::string stat((std::istreambuf_iterator<char>(input)),
@@ -275,9 +321,36 @@ TEST_CASE("pid_time_usermode uses user time", "[proc][pid_time_usermode]") {
   REQUIRE_THAT(actual, WithinAbs(expected, 0.01));
 }
 
+TEST_CASE("pid_* objects share one snapshot per update",
+          "[proc][pid_threads]") {
+  ensure_lua_state();
+  next_update();
+
+  std::string pid_str = std::to_string(getpid());
+  sub_text_object sub(pid_str.c_str());
+  struct text_object obj{};
+  obj.sub = &sub.root;
+
+  char before[32]{};
+  print_pid_threads(&obj, before, sizeof(before));
+  REQUIRE(before[0] != '\0');
+
+  thread_group group(3);
+
+  char during[32]{};
+  print_pid_threads(&obj, during, sizeof(during));
+  REQUIRE(std::string(during) == before);
+
+  next_update();
+  char after[32]{};
+  print_pid_threads(&obj, after, sizeof(after));
+  REQUIRE(std::stoi(after) == std::stoi(before) + 3);
+}
+
 TEST_CASE("pid_thread_list does not overflow small buffers",
           "[proc][pid_thread_list]") {
   ensure_lua_state();
+  next_update();
 
   thread_group group(4);
 
@@ -305,6 +378,7 @@ TEST_CASE("pid_thread_list does not overflow small buffers",
 TEST_CASE("pid_environ reads values from /proc environ",
           "[proc][pid_environ]") {
   ensure_lua_state();
+  next_update();
 
   const char *expected = getenv("PATH");
   REQUIRE(expected != nullptr);
@@ -324,6 +398,7 @@ TEST_CASE("pid_environ reads values from /proc environ",
 TEST_CASE("pid_state_short returns the short state",
           "[proc][pid_state_short]") {
   ensure_lua_state();
+  next_update();
 
   std::string state = read_status_value("State:");
   REQUIRE_FALSE(state.empty());
@@ -341,6 +416,7 @@ TEST_CASE("pid_state_short returns the short state",
 
 TEST_CASE("pid_vm values map to correct status entries", "[proc][pid_vm]") {
   ensure_lua_state();
+  next_update();
 
   pid_t child = spawn_stopped_child();
   REQUIRE(child > 0);
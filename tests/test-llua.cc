@@ -0,0 +1,110 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2024 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <conky.h>
+#include <lua/llua.h>
+#include <lua/lua-config.hh>
+#include <lua/setting.hh>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+extern lua_State *lua_L;
+
+namespace {
+struct lua_script {
+  std::string dir;
+  std::string path;
+
+  lua_script() {
+    char tmpl[] = "/tmp/conky-llua-XXXXXX";
+    REQUIRE(mkdtemp(tmpl) != nullptr);
+    dir = tmpl;
+    path = dir + "/hooks.lua";
+    std::ofstream(path) << "calls = 0\n"
+                           "function conky_count() calls = calls + 1 end\n";
+  }
+  ~lua_script() {
+    unlink(path.c_str());
+    rmdir(dir.c_str());
+  }
+};
+
+/* sets the config up the way initialisation() does */
+void load_config(const lua_script &script) {
+  state = std::make_unique<lua::state>();
+  conky::export_symbols(*state);
+  llua_init();
+
+  std::string config = "conky.config = { lua_load = '" + script.path +
+                       "', lua_startup_hook = 'count' }";
+  state->loadstring(config.c_str());
+  state->call(0, 0);
+  conky::set_config_settings(*state);
+}
+
+lua_Integer hook_calls() {
+  lua_getglobal(lua_L, "calls");
+  lua_Integer calls = lua_tointeger(lua_L, -1);
+  lua_pop(lua_L, 1);
+  return calls;
+}
+}  // namespace
+
+TEST_CASE("Lua hooks keep their call until the state is closed", "[llua]") {
+  lua_script script;
+  load_config(script);
+
+  llua_startup_hook();
+  REQUIRE(llua_cached_hooks() == 1);
+
+  // the cached function is called again, not the global looked up anew
+  REQUIRE(luaL_dostring(lua_L,
+                        "function conky_count() calls = calls + 100 end") ==
+          LUA_OK);
+  llua_startup_hook();
+  REQUIRE(hook_calls() == 2);
+  REQUIRE(llua_cached_hooks() == 1);
+
+  conky::cleanup_config_settings(*state);
+  REQUIRE(lua_L == nullptr);
+  REQUIRE(llua_cached_hooks() == 0);
+
+  SECTION("a reloaded config compiles the hook again") {
+    load_config(script);
+    llua_startup_hook();
+    REQUIRE(hook_calls() == 1);
+    REQUIRE(llua_cached_hooks() == 1);
+    conky::cleanup_config_settings(*state);
+  }
+}
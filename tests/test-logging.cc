@@ -0,0 +1,72 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2024 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <logging.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace {
+std::string read_file(const std::string &path) {
+  std::ifstream in(path);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+void record_span(const char *thread_name, const char *span) {
+  conky::log::set_thread_name(thread_name);
+  auto _scope = LOG_SCOPE(span);
+}
+}  // namespace
+
+TEST_CASE("Spans of exited threads reach the trace file", "[trace]") {
+  std::string path = std::string(P_tmpdir) + "/conky-test-trace.json";
+  conky::log::enable_tracing(path);
+
+  /* the second thread takes over the ring of the first one */
+  std::thread(record_span, "first-worker", "first-span").join();
+  std::thread(record_span, "second-worker", "second-span").join();
+  {
+    auto _scope = LOG_SCOPE("main-span");
+  }
+  conky::log::write_trace_file();
+
+  std::string trace = read_file(path);
+  remove(path.c_str());
+  for (const char *name : {"first-worker", "first-span", "second-worker",
+                           "second-span", "main-span"}) {
+    INFO(name);
+    REQUIRE(trace.find(std::string("\"") + name + "\"") != std::string::npos);
+  }
+}
@@ -0,0 +1,98 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2024 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <conky.h>
+#include <lua/lua-config.hh>
+#include <lua/setting.hh>
+
+// Snapshots are tied to the address of the lua state they were taken from, so
+// these tests use a state that's never freed (and whose address can't be
+// reused by the states other tests create).
+static lua::state &load_test_config() {
+  static auto *l = new lua::state();
+  conky::export_symbols(*l);
+  l->loadstring(
+      "conky.config = { text_buffer_size = 1024, cpu_avg_samples = 4 }");
+  l->call(0, 0);
+  return *l;
+}
+
+TEST_CASE("Settings are read from a snapshot once the config is loaded",
+          "[setting]") {
+  lua::state &l = load_test_config();
+  conky::set_config_settings(l);
+  uint32_t generation = cpu_avg_samples.generation();
+  REQUIRE(text_buffer_size.get(l) == 1024);
+  REQUIRE(cpu_avg_samples.get(l) == 4);
+
+  SECTION("lua_set updates the snapshot and the generation") {
+    l.pushinteger(8);
+    cpu_avg_samples.lua_set(l);
+
+    REQUIRE(cpu_avg_samples.get(l) == 8);
+    REQUIRE(cpu_avg_samples.generation() != generation);
+  }
+
+  SECTION("assignments from lua update the snapshot") {
+    l.loadstring("conky.config.cpu_avg_samples = 2");
+    l.call(0, 0);
+
+    REQUIRE(cpu_avg_samples.get(l) == 2);
+  }
+}
+
+// Run with: test-conky "[benchmark]"
+TEST_CASE("Setting lookup cost", "[.][benchmark]") {
+  constexpr int kLookupsPerFrame = 100;
+  lua::state &l = load_test_config();
+  conky::set_config_settings(l);
+
+  // what get() used to do on every call
+  BENCHMARK("lua table lookup") {
+    lua::integer sum = 0;
+    for (int i = 0; i < kLookupsPerFrame; i++) {
+      std::lock_guard<lua::state> guard(l);
+      l.getglobal("conky");
+      l.getfield(-1, "config");
+      l.getfield(-1, "text_buffer_size");
+      sum += l.tointeger(-1);
+      l.pop(3);
+    }
+    return sum;
+  };
+
+  BENCHMARK("snapshot lookup") {
+    unsigned int sum = 0;
+    for (int i = 0; i < kLookupsPerFrame; i++) {
+      sum += text_buffer_size.get(l);
+    }
+    return sum;
+  };
+}
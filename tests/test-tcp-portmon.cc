@@ -0,0 +1,200 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2024 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <arpa/inet.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "data/network/libtcp-portmon.h"
+
+namespace {
+/* names 127.0.0.1 and nothing else, counting how often it's asked */
+class stub_resolver : public tcp_host_resolver {
+ public:
+  std::atomic<int> calls{0};
+
+  std::string resolve(const struct sockaddr *sa, socklen_t len) override {
+    ++calls;
+    if (sa->sa_family != AF_INET) { return std::string(); }
+    auto sa4 = reinterpret_cast<const struct sockaddr_in *>(sa);
+    if (sa4->sin_addr.s_addr != htonl(INADDR_LOOPBACK)) {
+      return std::string();
+    }
+    return "loopback.example";
+  }
+};
+
+struct in6_addr mapped(const char *ip) {
+  struct in6_addr addr;
+  std::string v6 = std::string("::ffff:") + ip;
+  inet_pton(AF_INET6, v6.c_str(), &addr);
+  return addr;
+}
+
+std::string print(const struct in6_addr &addr) {
+  char buffer[256];
+  print_tcp_host(buffer, sizeof(buffer), &addr);
+  return buffer;
+}
+
+/* remote ports of the connections a monitor holds */
+std::multiset<std::string> remote_ports(tcp_port_monitor_t *monitor) {
+  std::multiset<std::string> ports;
+  char buffer[32];
+
+  peek_tcp_port_monitor(monitor, COUNT, 0, buffer, sizeof(buffer));
+  int count = std::stoi(buffer);
+  for (int i = 0; i < count; ++i) {
+    peek_tcp_port_monitor(monitor, REMOTEPORT, i, buffer, sizeof(buffer));
+    ports.insert(buffer);
+  }
+  return ports;
+}
+
+/* connections seen by a collection reading from source */
+std::multiset<std::string> connections_from(tcp_port_monitor_source source,
+                                            in_port_t port) {
+  tcp_port_monitor_args_t args = {8192};
+  tcp_port_monitor_collection_t *collection =
+      create_tcp_port_monitor_collection();
+  set_tcp_port_monitor_source(collection, source);
+  insert_new_tcp_port_monitor_into_collection(collection, port, port, &args);
+  /* more ranges around it, for the index and the filter to sort out */
+  insert_new_tcp_port_monitor_into_collection(collection, 1, port - 2, &args);
+  insert_new_tcp_port_monitor_into_collection(collection, port - 1, port + 1,
+                                              &args);
+  insert_new_tcp_port_monitor_into_collection(collection, port + 3, port + 9,
+                                              &args);
+  update_tcp_port_monitor_collection(collection);
+  auto ports = remote_ports(find_tcp_port_monitor(collection, port, port));
+  destroy_tcp_port_monitor_collection(collection);
+  return ports;
+}
+
+/* prints addr until it reads differently from first, or gives up */
+std::string wait_for_change(const struct in6_addr &addr,
+                            const std::string &first) {
+  std::string current = print(addr);
+  for (int i = 0; i < 200 && current == first; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    current = print(addr);
+  }
+  return current;
+}
+}  // namespace
+
+TEST_CASE("tcp_portmon host names are looked up in the background",
+          "[tcp_portmon]") {
+  auto resolver = std::make_shared<stub_resolver>();
+  set_tcp_host_resolver(resolver);
+
+  SECTION("numeric until the name arrives, then cached") {
+    struct in6_addr addr = mapped("127.0.0.1");
+    REQUIRE(print(addr) == "127.0.0.1");
+    REQUIRE(wait_for_change(addr, "127.0.0.1") == "loopback.example");
+    REQUIRE(print(addr) == "loopback.example");
+    REQUIRE(resolver->calls == 1);
+  }
+
+  SECTION("addresses without a name are cached too") {
+    struct in6_addr addr = mapped("192.0.2.1");
+    REQUIRE(print(addr) == "192.0.2.1");
+    for (int i = 0; i < 200 && resolver->calls == 0; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE(resolver->calls == 1);
+    REQUIRE(print(addr) == "192.0.2.1");
+    REQUIRE(print(addr) == "192.0.2.1");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    REQUIRE(resolver->calls == 1);
+  }
+
+  set_tcp_host_resolver(nullptr);
+}
+
+TEST_CASE("tcp_portmon sock_diag and /proc see the same connections",
+          "[tcp_portmon]") {
+  int probe = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_SOCK_DIAG);
+  if (probe < 0) { SKIP("no sock_diag netlink here"); }
+  close(probe);
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  REQUIRE(listener >= 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  REQUIRE(bind(listener, reinterpret_cast<struct sockaddr *>(&addr), len) ==
+          0);
+  REQUIRE(listen(listener, 128) == 0);
+  REQUIRE(getsockname(listener, reinterpret_cast<struct sockaddr *>(&addr),
+                      &len) == 0);
+  in_port_t port = ntohs(addr.sin_port);
+
+  // each connection takes two descriptors; leave room for the ones the
+  // collectors open while reading the table back
+  struct rlimit nofile = {};
+  REQUIRE(getrlimit(RLIMIT_NOFILE, &nofile) == 0);
+  rlim_t budget = nofile.rlim_cur == RLIM_INFINITY ? 4096 : nofile.rlim_cur;
+  size_t pairs = budget > 256 ? std::min<rlim_t>(1000, (budget - 128) / 2) : 0;
+  if (pairs < 100) { SKIP("not enough file descriptors"); }
+
+  std::vector<int> fds;
+  for (size_t i = 0; i < pairs; ++i) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(client >= 0);
+    REQUIRE(connect(client, reinterpret_cast<struct sockaddr *>(&addr),
+                    sizeof(addr)) == 0);
+    int server = accept(listener, nullptr, nullptr);
+    REQUIRE(server >= 0);
+    fds.push_back(client);
+    fds.push_back(server);
+  }
+
+  auto from_proc = connections_from(TCP_SOURCE_PROC, port);
+  auto from_diag = connections_from(TCP_SOURCE_NETLINK, port);
+  REQUIRE(from_proc.size() == fds.size() / 2);
+  REQUIRE(from_diag == from_proc);
+
+  for (int fd : fds) { close(fd); }
+  close(listener);
+}